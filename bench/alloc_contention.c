@@ -0,0 +1,152 @@
+/**
+ * Contention benchmark for the BAT allocator.
+ *
+ * N threads create files at the same time on an RAM-backed volume: every file gets one block for its FAT section
+ * (allocated near the last file of the same thread) and a few lose data blocks; once a thread has enough files, it
+ * deletes its oldest one, so the volume stays at a constant fill level.
+ *
+ * Every thread count is run twice: once with every libtabfs call wrapped into one global mutex (what multi-threaded
+ * users needed to do before the allocation groups existed) and once calling libtabfs directly, where threads only
+ * wait for each other if they allocate from the same group.
+ *
+ * usage: alloc_contention [max_threads] [seconds_per_run]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libtabfs.h"
+#include "ramdisk.h"
+
+#ifndef LIBTABFS_THREADSAFE
+    #error "the contention benchmark needs libtabfs to be compiled with LIBTABFS_THREADSAFE"
+#endif
+
+#define SECTION_BLOCKS      2       // every section covers ~8k blocks, so every section is an group of its own
+#define SECTION_COUNT       64
+#define FILES_PER_THREAD    256     // files a thread keeps before it deletes the oldest one
+#define DATA_BLOCKS         4       // lose data blocks per file
+
+//--------------------------------------------------------------------------------
+// Workload
+//--------------------------------------------------------------------------------
+
+struct file {
+    libtabfs_lba_28_t fat_lba;
+    long long data[DATA_BLOCKS];
+};
+
+struct worker {
+    pthread_t thread;
+    int id;
+    int thread_count;
+    long ops;
+    long failed;
+};
+
+static libtabfs_volume_t* volume;
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool use_global_lock;
+static bool running;
+
+#define CALL(expr) \
+    do { \
+        if (use_global_lock) { pthread_mutex_lock(&global_lock); } \
+        expr; \
+        if (use_global_lock) { pthread_mutex_unlock(&global_lock); } \
+    } while (0)
+
+static void* worker_main(void* arg) {
+    struct worker* w = (struct worker*) arg;
+    struct file* files = (struct file*) calloc(FILES_PER_THREAD, sizeof(struct file));
+    long count = 0;
+
+    // every thread starts in its own part of the volume, like files created in different directories
+    libtabfs_lba_28_t goal = (libtabfs_lba_28_t) ((ramdisk_blockcount / w->thread_count) * w->id);
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        struct file* f = &(files[count % FILES_PER_THREAD]);
+        if (count >= FILES_PER_THREAD) {
+            // delete the oldest file
+            CALL(libtabfs_bat_freeLoseBlocks(volume, DATA_BLOCKS, f->data));
+            CALL(libtabfs_bat_freeChainedBlocks(volume, 1, f->fat_lba));
+        }
+
+        CALL(f->fat_lba = libtabfs_bat_allocateChainedBlocksAt(volume, 1, goal));
+        bool ok = !LIBTABFS_IS_INVALID_LBA28(f->fat_lba);
+        if (ok) {
+            CALL(ok = libtabfs_bat_allocateLoseBlocksAt(volume, DATA_BLOCKS, f->fat_lba + 1, f->data));
+            if (!ok) { CALL(libtabfs_bat_freeChainedBlocks(volume, 1, f->fat_lba)); }
+        }
+        if (!ok) {
+            w->failed++;
+            break;
+        }
+
+        goal = f->data[DATA_BLOCKS - 1] + 1;
+        count++;
+        w->ops++;
+    }
+
+    free(files);
+    return NULL;
+}
+
+/**
+ * @brief runs the workload with an fresh volume
+ *
+ * @return files created per second
+ */
+static double run(int thread_count, double seconds, bool global) {
+    ramdisk_create(SECTION_BLOCKS, SECTION_COUNT);
+    if (libtabfs_new_volume(NULL, 0, true, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct worker* workers = (struct worker*) calloc(thread_count, sizeof(struct worker));
+    use_global_lock = global;
+    __atomic_store_n(&running, true, __ATOMIC_RELAXED);
+
+    double start = ramdisk_now();
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].id = i;
+        workers[i].thread_count = thread_count;
+        pthread_create(&(workers[i].thread), NULL, worker_main, &(workers[i]));
+    }
+    struct timespec wait = { (time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9) };
+    nanosleep(&wait, NULL);
+    __atomic_store_n(&running, false, __ATOMIC_RELAXED);
+
+    long ops = 0;
+    long failed = 0;
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ops += workers[i].ops;
+        failed += workers[i].failed;
+    }
+    double elapsed = ramdisk_now() - start;
+    if (failed > 0) {
+        fprintf(stderr, "%ld threads ran out of blocks\n", failed);
+    }
+
+    libtabfs_destroy_volume(volume);
+    free(workers);
+    ramdisk_destroy();
+    return ops / elapsed;
+}
+
+int main(int argc, char** argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+
+    printf("%-8s %16s %16s %8s\n", "threads", "global mutex", "alloc groups", "speedup");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double global = run(threads, seconds, true);
+        double groups = run(threads, seconds, false);
+        printf("%-8d %11.0f op/s %11.0f op/s %7.2fx\n", threads, global, groups, groups / global);
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * Compares the allocation policies of bat.h on an aged image.
+ *
+ * Every policy gets an fresh RAM-backed volume that is first filled up to FILL_PERCENT with an mix of allocations
+ * and is then aged by deleting random runs and allocating new ones in their place. The mix has power-of-two
+ * sizes like entrytable and FAT sections, small files and a few large continuous files (e.g. kernel images).
+ * All policies see the same sequence of requests; only where the runs end up differs.
+ *
+ * Reported are the latency of the allocations while aging, how many of them failed although enough blocks where free,
+ * and how fragmented the free space is afterwards.
+ *
+ * usage: alloc_policies [aging_ops]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libtabfs.h"
+#include "ramdisk.h"
+
+#define SECTION_BLOCKS      8
+#define SECTION_COUNT       8
+#define FILL_PERCENT        75
+#define MAX_LIVE            (1 << 20)
+
+struct run {
+    libtabfs_lba_28_t lba;
+    unsigned short count;
+};
+
+static unsigned int rng_state;
+
+static unsigned int rng(void) {
+    unsigned int x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+/**
+ * @brief size of the next allocation
+ */
+static unsigned short next_size(void) {
+    unsigned int kind = rng() % 100;
+    if (kind < 45) {
+        // entrytable and FAT sections
+        return 1 << (rng() % 4);
+    }
+    if (kind < 95) {
+        return 1 + (rng() % 32);
+    }
+    return 64 + (rng() % 961);
+}
+
+static int compare_long(const void* a, const void* b) {
+    long x = *((const long*) a);
+    long y = *((const long*) b);
+    return (x > y) - (x < y);
+}
+
+static void run_policy(const libtabfs_alloc_policy_t* policy, long aging_ops) {
+    ramdisk_create(SECTION_BLOCKS, SECTION_COUNT);
+    libtabfs_volume_options_t options = { .alloc_policy = policy };
+    libtabfs_volume_t* volume = NULL;
+    if (libtabfs_new_volume_ex(NULL, 0, true, &options, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct run* live = (struct run*) malloc(sizeof(struct run) * MAX_LIVE);
+    long* latency = (long*) malloc(sizeof(long) * aging_ops);
+    long live_count = 0;
+    long used = 0;
+    long failed = 0;
+    long target = (ramdisk_blockcount * FILL_PERCENT) / 100;
+    rng_state = 0x9E3779B9;
+
+    // fill
+    while (used < target && live_count < MAX_LIVE) {
+        unsigned short count = next_size();
+        libtabfs_lba_28_t lba = libtabfs_bat_allocateChainedBlocks(volume, count);
+        if (LIBTABFS_IS_INVALID_LBA28(lba)) { break; }
+        live[live_count].lba = lba;
+        live[live_count].count = count;
+        live_count++;
+        used += count;
+    }
+
+    // age: every new run replaces an random old one
+    long timed = 0;
+    for (long op = 0; op < aging_ops && live_count > 0; op++) {
+        long victim = rng() % live_count;
+        libtabfs_bat_freeChainedBlocks(volume, live[victim].count, live[victim].lba);
+        used -= live[victim].count;
+        live[victim] = live[--live_count];
+
+        while (used < target) {
+            unsigned short count = next_size();
+            double start = ramdisk_now();
+            libtabfs_lba_28_t lba = libtabfs_bat_allocateChainedBlocks(volume, count);
+            double end = ramdisk_now();
+            if (timed < aging_ops) {
+                latency[timed++] = (long) ((end - start) * 1e9);
+            }
+            if (LIBTABFS_IS_INVALID_LBA28(lba)) {
+                failed++;
+                break;
+            }
+            live[live_count].lba = lba;
+            live[live_count].count = count;
+            live_count++;
+            used += count;
+        }
+    }
+
+    long extents = 0;
+    for (unsigned int i = 0; i < volume->__bat_region_count; i++) {
+        extents += volume->__bat_regions[i].bat->__free_extents.count;
+    }
+    libtabfs_volume_statfs_t stat;
+    libtabfs_volume_statfs(volume, &stat);
+
+    double sum = 0;
+    for (long i = 0; i < timed; i++) { sum += latency[i]; }
+    qsort(latency, timed, sizeof(long), compare_long);
+
+    printf(
+        "%-10s %8.0f ns %8ld ns %8ld %10ld %10llu %10llu\n",
+        policy->name,
+        timed > 0 ? sum / timed : 0.0, timed > 0 ? latency[(timed * 99) / 100] : 0,
+        failed, extents, stat.free_blocks, stat.largest_free_extent
+    );
+
+    libtabfs_destroy_volume(volume);
+    free(latency);
+    free(live);
+    ramdisk_destroy();
+}
+
+int main(int argc, char** argv) {
+    long aging_ops = argc > 1 ? atol(argv[1]) : 200000;
+
+    printf("%-10s %11s %11s %8s %10s %10s %10s\n", "policy", "avg", "p99", "failed", "holes", "free", "largest");
+    run_policy(&libtabfs_alloc_first_fit, aging_ops);
+    run_policy(&libtabfs_alloc_next_fit, aging_ops);
+    run_policy(&libtabfs_alloc_best_fit, aging_ops);
+    run_policy(&libtabfs_alloc_buddy, aging_ops);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/**
+ * Compares the bitmap scans of bitmap.h with the per-bit loops the BAT allocator used before, which tested every
+ * bit with `0x80 >> j`.
+ *
+ * The bitmap has the size of an large BAT section. Three patterns are scanned:
+ *  - an full bitmap with one clear bit at the end (searching free space late in the life of an volume)
+ *  - an empty bitmap, measuring the length of the free run at its start (libtabfs_bat_are_blocks_free)
+ *  - every 61st bit clear, visiting all clear bits one after another (an fragmented section)
+ * Every scan is repeated RUNS times; reported is the average time of one scan with both variants.
+ *
+ * Which scanning path is measured depends on how the benchmark is built: bitmap_scan uses the default of the
+ * library (SSE2 on x86-64), bitmap_scan_portable is built with LIBTABFS_NO_SIMD and bitmap_scan_avx2 with AVX2.
+ *
+ * usage: bitmap_scan [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "ramdisk.h"
+
+#define BITMAP_BYTES        (64 * 1024)     // 512k bits
+#define BITMAP_BITS         ((long) BITMAP_BYTES * 8)
+#define FRAGMENT_STRIDE     61
+
+#if defined(LIBTABFS_NO_SIMD) || !(defined(__AVX2__) || defined(__SSE2__))
+    #define SCAN_PATH   "portable"
+#elif defined(__AVX2__)
+    #define SCAN_PATH   "avx2"
+#else
+    #define SCAN_PATH   "sse2"
+#endif
+
+static unsigned char* map;
+
+//--------------------------------------------------------------------------------
+// The loops used before bitmap.h
+//--------------------------------------------------------------------------------
+
+static long old_find_clear(const unsigned char* map, long from, long to) {
+    for (long i = from; i < to; i++) {
+        if (map[i / 8] == 0xff) {
+            i |= 7;
+            continue;
+        }
+        if ((map[i / 8] & (0x80 >> (i % 8))) == 0) {
+            return i;
+        }
+    }
+    return to;
+}
+
+static long old_find_set(const unsigned char* map, long from, long to) {
+    for (long i = from; i < to; i++) {
+        if ((map[i / 8] & (0x80 >> (i % 8))) != 0) {
+            return i;
+        }
+    }
+    return to;
+}
+
+//--------------------------------------------------------------------------------
+// Patterns
+//--------------------------------------------------------------------------------
+
+typedef long (*scan_fn)(const unsigned char* map, long from, long to);
+
+/**
+ * @brief visits all clear bits of the bitmap
+ *
+ * @return count of clear bits found
+ */
+static long visit_clear(scan_fn find_clear) {
+    long found = 0;
+    for (long i = find_clear(map, 0, BITMAP_BITS); i < BITMAP_BITS; i = find_clear(map, i + 1, BITMAP_BITS)) {
+        found++;
+    }
+    return found;
+}
+
+static void run_pattern(const char* label, scan_fn old_fn, scan_fn new_fn, bool visit, int runs) {
+    volatile long sink = 0;
+    long old_result = visit ? visit_clear(old_fn) : old_fn(map, 0, BITMAP_BITS);
+    long new_result = visit ? visit_clear(new_fn) : new_fn(map, 0, BITMAP_BITS);
+    if (old_result != new_result) {
+        fprintf(stderr, "%s: per-bit loop found %ld, %s scan %ld\n", label, old_result, SCAN_PATH, new_result);
+        exit(EXIT_FAILURE);
+    }
+
+    double start = ramdisk_now();
+    for (int i = 0; i < runs; i++) {
+        sink += visit ? visit_clear(old_fn) : old_fn(map, 0, BITMAP_BITS);
+    }
+    double old_time = ramdisk_now() - start;
+
+    start = ramdisk_now();
+    for (int i = 0; i < runs; i++) {
+        sink += visit ? visit_clear(new_fn) : new_fn(map, 0, BITMAP_BITS);
+    }
+    double new_time = ramdisk_now() - start;
+
+    (void) sink;
+    printf(
+        "%-28s %12.2f us %12.2f us %8.1fx\n",
+        label, old_time * 1e6 / runs, new_time * 1e6 / runs, old_time / new_time
+    );
+}
+
+int main(int argc, char** argv) {
+    int runs = argc > 1 ? atoi(argv[1]) : 200;
+
+    #if defined(__AVX2__) && !defined(LIBTABFS_NO_SIMD)
+        if (!__builtin_cpu_supports("avx2")) {
+            printf("this cpu has no AVX2; nothing to measure\n");
+            return 0;
+        }
+    #endif
+
+    map = (unsigned char*) malloc(BITMAP_BYTES);
+    printf("scanning path: %s, %ld bits\n", SCAN_PATH, BITMAP_BITS);
+    printf("%-28s %15s %15s %9s\n", "pattern", "per-bit loop", "bitmap.h", "speedup");
+
+    memset(map, 0xff, BITMAP_BYTES);
+    map[BITMAP_BYTES - 1] = 0xfe;
+    run_pattern("full, last bit free", old_find_clear, libtabfs_bitmap_find_clear, false, runs);
+
+    memset(map, 0x00, BITMAP_BYTES);
+    map[BITMAP_BYTES - 1] = 0x01;
+    run_pattern("empty, measure free run", old_find_set, libtabfs_bitmap_find_set, false, runs);
+
+    memset(map, 0xff, BITMAP_BYTES);
+    for (long i = 0; i < BITMAP_BITS; i += FRAGMENT_STRIDE) {
+        map[i / 8] &= ~(0x80 >> (i % 8));
+    }
+    run_pattern("fragmented, visit all free", old_find_clear, libtabfs_bitmap_find_clear, true, runs);
+
+    free(map);
+    return 0;
+}
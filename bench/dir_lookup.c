@@ -0,0 +1,176 @@
+/**
+ * Measures name lookups in directories of growing size.
+ *
+ * Every directory gets an fresh RAM-backed volume with an single directory that is filled with N entries
+ * (spread over N/15 sections). Reported are the time of the first lookup, which builds the name index of the
+ * directory, the average time of lookups afterwards, and for comparison the average time of an linear scan
+ * over all sections comparing every name, which is what an lookup without the index has to do.
+ *
+ * The same entries are also put into an hashed directory (about 8 entries per bucket); its lookups are averaged
+ * the same way. At last the volume is mounted again and the first lookup in each directory is timed, where nothing
+ * is cached yet: the linear directory has to read all its sections, the hashed one only one bucket.
+ *
+ * usage: dir_lookup [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libtabfs.h"
+#include "ramdisk.h"
+
+#define SECTION_BLOCKS      8
+#define SECTION_COUNT       2
+
+static unsigned int rng_state;
+
+static unsigned int rng(void) {
+    unsigned int x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+/**
+ * @brief the lookup without an index: compares every entry of every section
+ */
+static libtabfs_entrytable_entry_t* scan(libtabfs_entrytable_t* section, char* name) {
+    while (section != NULL) {
+        int entryCount = section->__byteSize / 64;
+        for (int i = 1; i < entryCount; i++) {
+            libtabfs_entrytable_entry_t* entry = &(section->entries[i]);
+            if (
+                entry->flags.type != LIBTABFS_ENTRYTYPE_UNKNOWN &&
+                entry->longname_data.longname_identifier == 0x00 &&
+                strcmp(entry->name, name) == 0
+            ) {
+                return entry;
+            }
+        }
+        section = libtabfs_entrytable_nextsection(section);
+    }
+    return NULL;
+}
+
+static libtabfs_entrytable_t* open_dir(libtabfs_volume_t* volume, char* name) {
+    libtabfs_entrytable_entry_t* entry = NULL;
+    libtabfs_entrytab_findentry(volume->__root_table, name, &entry, NULL, NULL);
+    return libtabfs_get_entrytable(volume, entry->data.dir.lba, entry->data.dir.size);
+}
+
+static void run_size(int entries, long lookups) {
+    ramdisk_create(SECTION_BLOCKS, SECTION_COUNT);
+    libtabfs_volume_t* volume = NULL;
+    if (libtabfs_new_volume(NULL, 0, true, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    libtabfs_fileflags_t flags = {};
+    libtabfs_time_t ts = {};
+    libtabfs_entrytable_t* dir = NULL;
+    if (libtabfs_create_dir(volume->__root_table, "dir", flags, ts, 0, 0, &dir) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not create the directory\n");
+        exit(EXIT_FAILURE);
+    }
+    libtabfs_entrytable_pin(dir);
+
+    unsigned int bucket_bits = 0;
+    while ((8 << bucket_bits) < entries) { bucket_bits++; }
+    libtabfs_entrytable_t* hashed = NULL;
+    if (libtabfs_create_hashed_dir(volume->__root_table, "hashed", flags, ts, 0, 0, bucket_bits, &hashed) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not create the hashed directory\n");
+        exit(EXIT_FAILURE);
+    }
+    libtabfs_entrytable_pin(hashed);
+
+    char name[22];
+    for (int i = 0; i < entries; i++) {
+        sprintf(name, "entry%d", i);
+        if (
+            libtabfs_create_chardevice(dir, name, flags, ts, 0, 0, i, 0) != LIBTABFS_ERR_NONE ||
+            libtabfs_create_chardevice(hashed, name, flags, ts, 0, 0, i, 0) != LIBTABFS_ERR_NONE
+        ) {
+            fprintf(stderr, "could not create entry %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    libtabfs_entrytable_entry_t* entry = NULL;
+    double start = ramdisk_now();
+    libtabfs_entrytab_findentry(dir, "entry0", &entry, NULL, NULL);
+    double build = ramdisk_now() - start;
+
+    rng_state = 0x9E3779B9;
+    long missing = 0;
+    start = ramdisk_now();
+    for (long i = 0; i < lookups; i++) {
+        sprintf(name, "entry%u", rng() % entries);
+        libtabfs_entrytab_findentry(dir, name, &entry, NULL, NULL);
+        if (entry == NULL) { missing++; }
+    }
+    double indexed = ramdisk_now() - start;
+
+    rng_state = 0x9E3779B9;
+    long scan_lookups = lookups / 10 + 1;
+    start = ramdisk_now();
+    for (long i = 0; i < scan_lookups; i++) {
+        sprintf(name, "entry%u", rng() % entries);
+        if (scan(dir, name) == NULL) { missing++; }
+    }
+    double scanned = ramdisk_now() - start;
+
+    rng_state = 0x9E3779B9;
+    start = ramdisk_now();
+    for (long i = 0; i < lookups; i++) {
+        sprintf(name, "entry%u", rng() % entries);
+        libtabfs_entrytab_findentry(hashed, name, &entry, NULL, NULL);
+        if (entry == NULL) { missing++; }
+    }
+    double hashed_time = ramdisk_now() - start;
+
+    libtabfs_entrytable_unpin(dir);
+    libtabfs_entrytable_unpin(hashed);
+    libtabfs_destroy_volume(volume);
+
+    // cold lookups: nothing but the root table is cached after mounting
+    sprintf(name, "entry%d", entries - 1);
+    double cold[2];
+    for (int h = 0; h < 2; h++) {
+        if (libtabfs_new_volume(NULL, 0, true, &volume) != LIBTABFS_ERR_NONE) {
+            fprintf(stderr, "could not mount the ram disk again\n");
+            exit(EXIT_FAILURE);
+        }
+        libtabfs_entrytable_t* table = open_dir(volume, h == 0 ? "dir" : "hashed");
+        start = ramdisk_now();
+        libtabfs_entrytab_findentry(table, name, &entry, NULL, NULL);
+        cold[h] = ramdisk_now() - start;
+        if (entry == NULL) { missing++; }
+        libtabfs_destroy_volume(volume);
+    }
+
+    printf(
+        "%8d %12.0f ns %10.0f ns %10.0f ns %10.0f ns %12.0f ns %12.0f ns %8ld\n",
+        entries, build * 1e9, (indexed * 1e9) / lookups, (scanned * 1e9) / scan_lookups, (hashed_time * 1e9) / lookups,
+        cold[0] * 1e9, cold[1] * 1e9, missing
+    );
+
+    ramdisk_destroy();
+}
+
+int main(int argc, char** argv) {
+    long lookups = argc > 1 ? atol(argv[1]) : 100000;
+
+    printf(
+        "%8s %15s %13s %13s %13s %15s %15s %8s\n",
+        "entries", "index build", "lookup", "scan", "hashed", "cold linear", "cold hashed", "missing"
+    );
+    run_size(100, lookups);
+    run_size(1000, lookups);
+    run_size(5000, lookups);
+    run_size(20000, lookups);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * Measures how long it takes to find an free slot in long entrytable and FAT chains.
+ *
+ * Every size gets an fresh RAM-backed volume. An directory is filled with N entries and an fatfile gets N blocks
+ * appended one at a time; reported is the average time of the last SAMPLE creates / appends, when the chains
+ * are about N/15 and N/63 sections long. Without the used-maps and the free-section hint both searches walk the whole chain;
+ * appends still look up the latest entry of the block index over the whole FAT, so they stay linear in N.
+ *
+ * usage: free_slots
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libtabfs.h"
+#include "ramdisk.h"
+
+#define SECTION_BLOCKS      8
+#define SECTION_COUNT       4
+#define SAMPLE              1000
+
+static void run_size(int count) {
+    ramdisk_create(SECTION_BLOCKS, SECTION_COUNT);
+    libtabfs_volume_t* volume = NULL;
+    if (libtabfs_new_volume(NULL, 0, true, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    libtabfs_fileflags_t flags = {};
+    libtabfs_time_t ts = {};
+    libtabfs_entrytable_t* dir = NULL;
+    if (libtabfs_create_dir(volume->__root_table, "dir", flags, ts, 0, 0, &dir) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not create the directory\n");
+        exit(EXIT_FAILURE);
+    }
+    libtabfs_entrytable_pin(dir);
+
+    char name[22];
+    double start = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == count - SAMPLE) { start = ramdisk_now(); }
+        sprintf(name, "entry%d", i);
+        if (libtabfs_create_chardevice(dir, name, flags, ts, 0, 0, i, 0) != LIBTABFS_ERR_NONE) {
+            fprintf(stderr, "could not create entry %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    double creates = ramdisk_now() - start;
+
+    libtabfs_entrytable_entry_t* file = NULL;
+    if (libtabfs_create_fatfile(volume->__root_table, "file", flags, ts, 0, 0, &file) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not create the file\n");
+        exit(EXIT_FAILURE);
+    }
+    libtabfs_entrytable_pin(volume->__root_table);
+
+    unsigned char block[RAMDISK_BLOCK_SIZE] = {0};
+    for (int i = 0; i < count; i++) {
+        if (i == count - SAMPLE) { start = ramdisk_now(); }
+        unsigned long int written = 0;
+        libtabfs_error err = libtabfs_write_file(volume, file, (unsigned long) i * RAMDISK_BLOCK_SIZE, RAMDISK_BLOCK_SIZE, block, &written);
+        if (err != LIBTABFS_ERR_NONE) {
+            fprintf(stderr, "could not append block %d: %s\n", i, libtabfs_errstr(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+    double appends = ramdisk_now() - start;
+
+    printf("%8d %10.0f ns %10.0f ns\n", count, (creates * 1e9) / SAMPLE, (appends * 1e9) / SAMPLE);
+
+    libtabfs_entrytable_unpin(volume->__root_table);
+    libtabfs_entrytable_unpin(dir);
+    libtabfs_destroy_volume(volume);
+    ramdisk_destroy();
+}
+
+int main(int argc, char** argv) {
+    printf("%8s %13s %13s\n", "count", "create", "append");
+    run_size(2000);
+    run_size(10000);
+    run_size(40000);
+    return 0;
+}
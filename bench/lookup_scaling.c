@@ -0,0 +1,200 @@
+/**
+ * Scaling benchmark for concurrent path lookups.
+ *
+ * The image has DIRS directories with FILES entries each; N threads resolve random paths of the form
+ * "tree/dirX/fileY" with libtabfs_entrytab_traversetree_n. All tables are cached before the timing starts, so the lookups
+ * only read cached metadata.
+ *
+ * Every thread count is run three times: once with every libtabfs call wrapped into one global mutex (what
+ * multi-threaded users needed to do before), once calling libtabfs directly, where lookups only take the shared
+ * locks of the directories and caches, and once more directly with every WRITE_EVERY'th operation of an thread
+ * creating an entry in an directory of its own, so writers and readers are mixed.
+ *
+ * usage: lookup_scaling [max_threads] [seconds_per_run]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libtabfs.h"
+#include "ramdisk.h"
+
+#ifndef LIBTABFS_THREADSAFE
+    #error "the lookup scaling benchmark needs libtabfs to be compiled with LIBTABFS_THREADSAFE"
+#endif
+
+#define SECTION_BLOCKS      8
+#define SECTION_COUNT       8
+#define DIRS                64
+#define FILES               128     // entries in every directory
+#define WRITE_EVERY         32      // in the mixed runs, every n'th operation creates an entry
+#define MAX_CREATES         2048    // entries an thread creates at most in its own directory
+
+//--------------------------------------------------------------------------------
+// Workload
+//--------------------------------------------------------------------------------
+
+struct worker {
+    pthread_t thread;
+    int id;
+    libtabfs_entrytable_t* own_dir;
+    long ops;
+    long failed;
+};
+
+static libtabfs_volume_t* volume;
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool use_global_lock;
+static bool mixed;
+static bool running;
+
+static libtabfs_fileflags_t flags = { .raw_user = 7, .raw_group = 7, .raw_other = 7 };
+static libtabfs_time_t ts = {};
+
+#define CALL(expr) \
+    do { \
+        if (use_global_lock) { pthread_mutex_lock(&global_lock); } \
+        expr; \
+        if (use_global_lock) { pthread_mutex_unlock(&global_lock); } \
+    } while (0)
+
+static void* worker_main(void* arg) {
+    struct worker* w = (struct worker*) arg;
+    unsigned int seed = w->id * 7919 + 1;
+    long created = 0;
+    char path[40];
+    char name[16];
+
+    while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        libtabfs_error err;
+        if (mixed && (w->ops % WRITE_EVERY) == 0 && created < MAX_CREATES) {
+            sprintf(name, "new%ld", created++);
+            CALL(err = libtabfs_create_chardevice(w->own_dir, name, flags, ts, 0, 0, 0, 0));
+        }
+        else {
+            int len = sprintf(path, "tree/dir%d/file%d", rand_r(&seed) % DIRS, rand_r(&seed) % FILES);
+            libtabfs_entrytable_entry_t* entry = NULL;
+            CALL(err = libtabfs_entrytab_traversetree_n(volume->__root_table, path, len, false, 0, 0, &entry, NULL, NULL));
+            if (err == LIBTABFS_ERR_NONE && entry == NULL) { err = LIBTABFS_ERR_NOT_FOUND; }
+        }
+        if (err != LIBTABFS_ERR_NONE) {
+            w->failed++;
+            break;
+        }
+        w->ops++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief creates the directory tree on an fresh volume and reads every table once, so it is cached
+ */
+static void setup(int thread_count, struct worker* workers) {
+    ramdisk_create(SECTION_BLOCKS, SECTION_COUNT);
+    if (libtabfs_new_volume(NULL, 0, true, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the root table cant grow, so everything is placed in an directory below it
+    libtabfs_entrytable_t* tree = NULL;
+    if (libtabfs_create_dir(volume->__root_table, "tree", flags, ts, 0, 0, &tree) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not create tree\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char name[16];
+    for (int d = 0; d < DIRS; d++) {
+        libtabfs_entrytable_t* dir = NULL;
+        sprintf(name, "dir%d", d);
+        if (libtabfs_create_dir(tree, name, flags, ts, 0, 0, &dir) != LIBTABFS_ERR_NONE) {
+            fprintf(stderr, "could not create %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+        for (int f = 0; f < FILES; f++) {
+            sprintf(name, "file%d", f);
+            if (libtabfs_create_chardevice(dir, name, flags, ts, 0, 0, f, 0) != LIBTABFS_ERR_NONE) {
+                fprintf(stderr, "could not create %s\n", name);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        sprintf(name, "own%d", i);
+        if (libtabfs_create_dir(tree, name, flags, ts, 0, 0, &(workers[i].own_dir)) != LIBTABFS_ERR_NONE) {
+            fprintf(stderr, "could not create %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char path[40];
+    for (int d = 0; d < DIRS; d++) {
+        for (int f = 0; f < FILES; f++) {
+            int len = sprintf(path, "tree/dir%d/file%d", d, f);
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_entrytab_traversetree_n(volume->__root_table, path, len, false, 0, 0, &entry, NULL, NULL);
+        }
+    }
+}
+
+/**
+ * @brief runs the workload with an fresh volume
+ *
+ * @return operations per second
+ */
+static double run(int thread_count, double seconds, bool global, bool with_writes) {
+    struct worker* workers = (struct worker*) calloc(thread_count, sizeof(struct worker));
+    setup(thread_count, workers);
+    use_global_lock = global;
+    mixed = with_writes;
+    __atomic_store_n(&running, true, __ATOMIC_RELAXED);
+
+    double start = ramdisk_now();
+    for (int i = 0; i < thread_count; i++) {
+        workers[i].id = i;
+        pthread_create(&(workers[i].thread), NULL, worker_main, &(workers[i]));
+    }
+    struct timespec wait = { (time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9) };
+    nanosleep(&wait, NULL);
+    __atomic_store_n(&running, false, __ATOMIC_RELAXED);
+
+    long ops = 0;
+    long failed = 0;
+    for (int i = 0; i < thread_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ops += workers[i].ops;
+        failed += workers[i].failed;
+    }
+    double elapsed = ramdisk_now() - start;
+    if (failed > 0) {
+        fprintf(stderr, "%ld threads got an error\n", failed);
+    }
+
+    libtabfs_destroy_volume(volume);
+    free(workers);
+    ramdisk_destroy();
+    return ops / elapsed;
+}
+
+int main(int argc, char** argv) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+    double seconds = argc > 2 ? atof(argv[2]) : 1.0;
+
+    printf("%-8s %16s %16s %8s %16s\n", "threads", "global mutex", "shared locks", "speedup", "with writes");
+    double first = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double global = run(threads, seconds, true, false);
+        double shared = run(threads, seconds, false, false);
+        double writes = run(threads, seconds, false, true);
+        if (threads == 1) { first = shared; }
+        printf(
+            "%-8d %11.0f op/s %11.0f op/s %7.2fx %11.0f op/s   (%.2fx of 1 thread)\n",
+            threads, global, shared, shared / global, writes, shared / first
+        );
+    }
+    return 0;
+}
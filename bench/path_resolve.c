@@ -0,0 +1,94 @@
+/**
+ * Measures libtabfs_entrytab_traversetree on an deep path, with and without the dentry cache.
+ *
+ * The image has an chain of DEPTH directories, each with FANOUT other entries next to the one on the path; the last
+ * directory uses the hashed layout. Timed are lookups of the full path, and of an missing name in the last directory,
+ * which without the dentry cache has to read the bucket table from the device every time.
+ *
+ * usage: path_resolve [lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libtabfs.h"
+#include "ramdisk.h"
+
+#define SECTION_BLOCKS      8
+#define SECTION_COUNT       2
+#define DEPTH               8
+#define FANOUT              200
+
+static double run(long lookups, unsigned int dentry_cache_slots, const char* path) {
+    libtabfs_volume_options_t options = { .dentry_cache_slots = dentry_cache_slots };
+    libtabfs_volume_t* volume = NULL;
+    if (libtabfs_new_volume_ex(NULL, 0, true, &options, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the path isnt written to, so it dosnt need to be copied before every lookup
+    int pathlen = strlen(path);
+    libtabfs_entrytable_entry_t* entry = NULL;
+    double start = ramdisk_now();
+    for (long i = 0; i < lookups; i++) {
+        libtabfs_entrytab_traversetree_n(volume->__root_table, path, pathlen, false, 0, 0, &entry, NULL, NULL);
+    }
+    double elapsed = ramdisk_now() - start;
+
+    libtabfs_destroy_volume(volume);
+    return (elapsed * 1e9) / lookups;
+}
+
+int main(int argc, char** argv) {
+    long lookups = argc > 1 ? atol(argv[1]) : 200000;
+
+    ramdisk_create(SECTION_BLOCKS, SECTION_COUNT);
+    libtabfs_volume_t* volume = NULL;
+    if (libtabfs_new_volume(NULL, 0, true, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    libtabfs_fileflags_t flags = { .raw_user = 7, .raw_group = 7, .raw_other = 7 };
+    libtabfs_time_t ts = {};
+    char path[256] = "";
+    char name[22];
+
+    libtabfs_entrytable_t* dir = volume->__root_table;
+    for (int d = 0; d < DEPTH; d++) {
+        libtabfs_entrytable_t* next = NULL;
+        sprintf(name, "level%d", d);
+        libtabfs_error err = d == DEPTH - 1
+            ? libtabfs_create_hashed_dir(dir, name, flags, ts, 0, 0, 4, &next)
+            : libtabfs_create_dir(dir, name, flags, ts, 0, 0, &next);
+        if (err != LIBTABFS_ERR_NONE) {
+            fprintf(stderr, "could not create %s\n", name);
+            exit(EXIT_FAILURE);
+        }
+        strcat(path, name);
+        strcat(path, "/");
+        dir = next;
+
+        for (int i = 0; i < FANOUT; i++) {
+            sprintf(name, "other%d", i);
+            if (libtabfs_create_chardevice(dir, name, flags, ts, 0, 0, i, 0) != LIBTABFS_ERR_NONE) {
+                fprintf(stderr, "could not create %s\n", name);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    libtabfs_destroy_volume(volume);
+
+    char found[256], missing[256];
+    sprintf(found, "%sother%d", path, FANOUT / 2);
+    sprintf(missing, "%smissing", path);
+
+    printf("%-10s %13s %13s\n", "dcache", "path", "missing");
+    printf("%-10s %10.0f ns %10.0f ns\n", "off", run(lookups, 0, found), run(lookups, 0, missing));
+    printf("%-10s %10.0f ns %10.0f ns\n", "1024", run(lookups, 1024, found), run(lookups, 1024, missing));
+
+    ramdisk_destroy();
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ramdisk.h"
+
+#ifdef LIBTABFS_THREADSAFE
+    #include <pthread.h>
+#endif
+
+uint8_t* ramdisk;
+long ramdisk_blockcount;
+
+//--------------------------------------------------------------------------------
+// Bridge
+//--------------------------------------------------------------------------------
+
+void libtabfs_read_device(void* dev_data, libtabfs_lba_28_t lba_address, bool is_absolute_lba, int offset, void* buffer, int bufferSize) {
+    memcpy(buffer, ramdisk + ((long) lba_address * RAMDISK_BLOCK_SIZE) + offset, bufferSize);
+}
+
+void libtabfs_write_device(void* dev_data, libtabfs_lba_28_t lba_address, bool is_absolute_lba, int offset, void* buffer, int bufferSize) {
+    memcpy(ramdisk + ((long) lba_address * RAMDISK_BLOCK_SIZE) + offset, buffer, bufferSize);
+}
+
+void libtabfs_set_range_device(void* dev_data, libtabfs_lba_28_t lba_address, bool is_absolute_lba, int offset, unsigned char b, int size) {
+    memset(ramdisk + ((long) lba_address * RAMDISK_BLOCK_SIZE) + offset, b, size);
+}
+
+int libtabfs_strlen(char* str) { return strlen(str); }
+char* libtabfs_strchr(char* str, char c) { return strchr(str, c); }
+int libtabfs_strcmp(char* a, char* b) { return strcmp(a, b); }
+void libtabfs_memcpy(void* dest, void* src, int count) { memcpy(dest, src, count); }
+void* libtabfs_alloc(int size) { return calloc(size, 1); }
+void libtabfs_free(void* ptr, int size) { free(ptr); }
+
+void libtabfs_get_current_time(libtabfs_time_t* time) {
+    // fat entries are told apart by their modify date, so every call gets an later one
+    static unsigned long long now = 0;
+    time->i64_data = __atomic_add_fetch(&now, 1, __ATOMIC_RELAXED);
+}
+
+#ifdef LIBTABFS_THREADSAFE
+    void* libtabfs_lock_create(void) {
+        pthread_mutex_t* lock = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+        pthread_mutex_init(lock, NULL);
+        return lock;
+    }
+
+    void libtabfs_lock_destroy(void* lock) {
+        pthread_mutex_destroy((pthread_mutex_t*) lock);
+        free(lock);
+    }
+
+    void libtabfs_lock_acquire(void* lock) { pthread_mutex_lock((pthread_mutex_t*) lock); }
+    bool libtabfs_lock_try_acquire(void* lock) { return pthread_mutex_trylock((pthread_mutex_t*) lock) == 0; }
+    void libtabfs_lock_release(void* lock) { pthread_mutex_unlock((pthread_mutex_t*) lock); }
+
+    void* libtabfs_rwlock_create(void) {
+        pthread_rwlock_t* lock = (pthread_rwlock_t*) malloc(sizeof(pthread_rwlock_t));
+        pthread_rwlock_init(lock, NULL);
+        return lock;
+    }
+
+    void libtabfs_rwlock_destroy(void* lock) {
+        pthread_rwlock_destroy((pthread_rwlock_t*) lock);
+        free(lock);
+    }
+
+    void libtabfs_rwlock_acquire_shared(void* lock) { pthread_rwlock_rdlock((pthread_rwlock_t*) lock); }
+    void libtabfs_rwlock_release_shared(void* lock) { pthread_rwlock_unlock((pthread_rwlock_t*) lock); }
+    void libtabfs_rwlock_acquire_exclusive(void* lock) { pthread_rwlock_wrlock((pthread_rwlock_t*) lock); }
+    void libtabfs_rwlock_release_exclusive(void* lock) { pthread_rwlock_unlock((pthread_rwlock_t*) lock); }
+#endif
+
+//--------------------------------------------------------------------------------
+// Image
+//--------------------------------------------------------------------------------
+
+static void ramdisk_mark_used(long bits_per_section, long lba) {
+    long section = lba / bits_per_section;
+    long bit = lba % bits_per_section;
+    long section_lba = section == 0 ? 2 : section * bits_per_section;
+    ramdisk[(section_lba * RAMDISK_BLOCK_SIZE) + 6 + (bit / 8)] |= 0x80 >> (bit % 8);
+}
+
+void ramdisk_create(int section_blocks, int section_count) {
+    long bits = (((long) section_blocks * RAMDISK_BLOCK_SIZE) - 6) * 8;
+    ramdisk_blockcount = bits * section_count;
+    ramdisk = (uint8_t*) calloc(ramdisk_blockcount, RAMDISK_BLOCK_SIZE);
+    uint32_t root_lba = 2 + section_blocks;
+    uint32_t u32;
+    uint16_t u16;
+
+    // header
+    memcpy(ramdisk + 0x1C0, "TABFS-28", 9);
+    u16 = 1; memcpy(ramdisk + 0x1F0, &u16, 2);
+    uint64_t info_lba = 1; memcpy(ramdisk + 0x1F6, &info_lba, 8);
+    ramdisk[0x1FE] = 0x55;
+    ramdisk[0x1FF] = 0xAA;
+
+    // volume info
+    uint8_t* info = ramdisk + RAMDISK_BLOCK_SIZE;
+    memcpy(info, "TABFS-28", 9);
+    u32 = 2; memcpy(info + 0x10, &u32, 4);                          // bat LBA
+    u32 = 0; memcpy(info + 0x14, &u32, 4);                          // min LBA
+    u32 = 0; memcpy(info + 0x18, &u32, 4);                          // bat-start LBA
+    u32 = ramdisk_blockcount - 1; memcpy(info + 0x1C, &u32, 4);     // max LBA
+    u32 = RAMDISK_BLOCK_SIZE; memcpy(info + 0x20, &u32, 4);
+    info[0x24] = 1;
+    u16 = 1; memcpy(info + 0x26, &u16, 2);
+    memcpy(info + 0x28, &root_lba, 4);
+    u32 = 2 * RAMDISK_BLOCK_SIZE; memcpy(info + 0x2C, &u32, 4);
+
+    // bat sections
+    for (long s = 0; s < section_count; s++) {
+        long section_lba = s == 0 ? 2 : s * bits;
+        uint8_t* section = ramdisk + (section_lba * RAMDISK_BLOCK_SIZE);
+        u32 = (s + 1 < section_count) ? (uint32_t) ((s + 1) * bits) : 0;
+        memcpy(section, &u32, 4);
+        u16 = section_blocks; memcpy(section + 4, &u16, 2);
+        for (long b = 0; b < section_blocks; b++) {
+            ramdisk_mark_used(bits, section_lba + b);
+        }
+    }
+    ramdisk_mark_used(bits, 0);
+    ramdisk_mark_used(bits, 1);
+    ramdisk_mark_used(bits, root_lba);
+    ramdisk_mark_used(bits, root_lba + 1);
+
+    // root table
+    ramdisk[root_lba * RAMDISK_BLOCK_SIZE] = 0xE0;
+}
+
+void ramdisk_destroy(void) {
+    free(ramdisk);
+    ramdisk = NULL;
+    ramdisk_blockcount = 0;
+}
+
+double ramdisk_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
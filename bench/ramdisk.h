@@ -0,0 +1,42 @@
+#ifndef __LIBTABFS_BENCH_RAMDISK_H__
+#define __LIBTABFS_BENCH_RAMDISK_H__
+
+#include <stdint.h>
+
+#include "libtabfs.h"
+
+/**
+ * Bridge for the benchmarks: the device is an buffer in RAM, locks are pthread mutexes.
+ */
+
+#define RAMDISK_BLOCK_SIZE  512
+
+extern uint8_t* ramdisk;
+extern long ramdisk_blockcount;
+
+/**
+ * @brief creates an freshly formatted image; the BAT has section_count sections with section_blocks blocks each,
+ * which together cover the whole image. Layout:
+ *
+ * 0x0 - bootsector with tabfs header
+ * 0x1 - tabfs volume info
+ * 0x2 - first section of the bat; covers the blocks from 0x0 on
+ * after it - root table (2 blocks)
+ * all other sections are placed on the first blocks they cover
+ *
+ * @param section_blocks blocks of every BAT section
+ * @param section_count count of BAT sections
+ */
+void ramdisk_create(int section_blocks, int section_count);
+
+/**
+ * @brief frees the image
+ */
+void ramdisk_destroy(void);
+
+/**
+ * @brief monotonic time in seconds
+ */
+double ramdisk_now(void);
+
+#endif // __LIBTABFS_BENCH_RAMDISK_H__
\ No newline at end of file
@@ -0,0 +1,90 @@
+/**
+ * Measures libtabfs_bat_mark_range and libtabfs_bat_clear_range on large ranges.
+ *
+ * The ranges either lie inside one BAT section or start shortly before the end of one and cross into the following
+ * ones. Since the RAM disk places every section on the first blocks it covers, an crossing range also covers the
+ * blocks of the sections it crosses into; those are marked again after every clear (not timed), so the volume stays
+ * intact. Every range is marked and cleared RUNS times; reported is the average time of one call.
+ *
+ * usage: range_mark [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libtabfs.h"
+#include "ramdisk.h"
+
+#define SECTION_BLOCKS      8       // every section covers ~32k blocks
+#define SECTION_COUNT       16
+
+static libtabfs_volume_t* volume;
+
+static unsigned long long free_blocks(void) {
+    libtabfs_volume_statfs_t stat;
+    libtabfs_volume_statfs(volume, &stat);
+    return stat.free_blocks;
+}
+
+/**
+ * @brief marks the blocks of every section that starts inside (from, to) as used again
+ */
+static void restore_sections(libtabfs_lba_28_t from, libtabfs_lba_28_t to) {
+    for (libtabfs_bat_t* bat = volume->__bat_root; bat != NULL; bat = bat->__next_bat) {
+        libtabfs_lba_28_t start = libtabfs_bat_getstart(bat);
+        if (start > from && start < to) {
+            libtabfs_bat_mark_range(bat, 0, 0, SECTION_BLOCKS);
+        }
+    }
+}
+
+static void run_range(const char* label, libtabfs_lba_28_t lba, unsigned int count, int runs) {
+    libtabfs_bat_t* bat = libtabfs_bat_getBatRegion(volume, lba);
+    long bit = lba - libtabfs_bat_getstart(bat);
+    unsigned long long free_before = free_blocks();
+
+    double mark = 0;
+    double clear = 0;
+    for (int i = 0; i < runs; i++) {
+        double start = ramdisk_now();
+        libtabfs_bat_mark_range(bat, bit / 8, bit % 8, count);
+        mark += ramdisk_now() - start;
+
+        start = ramdisk_now();
+        libtabfs_bat_clear_range(bat, bit / 8, bit % 8, count);
+        clear += ramdisk_now() - start;
+
+        restore_sections(lba, lba + count);
+    }
+
+    if (free_blocks() != free_before) {
+        fprintf(stderr, "%s: free blocks changed from %llu to %llu\n", label, free_before, free_blocks());
+        exit(EXIT_FAILURE);
+    }
+    printf("%-28s %8u %12.2f us %12.2f us\n", label, count, mark * 1e6 / runs, clear * 1e6 / runs);
+}
+
+int main(int argc, char** argv) {
+    int runs = argc > 1 ? atoi(argv[1]) : 200;
+
+    ramdisk_create(SECTION_BLOCKS, SECTION_COUNT);
+    if (libtabfs_new_volume(NULL, 0, true, &volume) != LIBTABFS_ERR_NONE) {
+        fprintf(stderr, "could not mount the ram disk\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // section 1 and the ones after it are completely free, except for their own blocks
+    libtabfs_bat_t* second = volume->__bat_root->__next_bat;
+    libtabfs_lba_28_t inside = libtabfs_bat_getstart(second) + SECTION_BLOCKS + 13;
+    libtabfs_lba_28_t crossing = libtabfs_bat_getstart(second) + libtabfs_bat_getcount(second) - 1003;
+
+    printf("%-28s %8s %15s %15s\n", "range", "blocks", "mark", "clear");
+    run_range("inside one section", inside, 1000, runs);
+    run_range("inside one section", inside, 30000, runs);
+    run_range("crossing into the next", crossing, 60000, runs);
+    run_range("crossing 8 sections", crossing, 8 * libtabfs_bat_getcount(second), runs);
+
+    libtabfs_destroy_volume(volume);
+    ramdisk_destroy();
+    return 0;
+}
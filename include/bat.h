@@ -3,21 +3,94 @@
 
 #include "./common.h"
 #include "./volume.h"
+#include "./extent.h"
 
 struct libtabfs_bat {
     libtabfs_volume_t* __volume;
     struct libtabfs_bat* __next_bat;
     libtabfs_lba_28_t __lba;
+    libtabfs_lba_28_t __start_lba;  // first lba described by this section; set by libtabfs_bat_build_index
+    bool __indexed;                 // if the free counter, summary and free-extent index are built; see libtabfs_bat_ensure_indexed
+    libtabfs_extenttree_t __free_extents;   // free runs of this section in bit positions; kept in sync by mark / clear
+    long __free_count;              // count of clear bits in the bitmap
+    unsigned char* __full_words;    // summary of the bitmap; one bit per 64bit word of it, set if the word is fully allocated
+    unsigned char* __dirty_blocks;  // one bit per block of the section; set if the block changed since it was last written
+    unsigned char** __pages;        // the blocks of the section as read from disk; NULL if not in memory (lazy mode only)
+    unsigned char* __referenced;    // one bit per block; set when the page is used, cleared by the page eviction
+    struct libtabfs_alloc_group* __group;   // allocation group the section belongs to; set by libtabfs_bat_build_index
 
-    // data fields read from disk
+    // data fields read from disk; the bitmap itself follows them on disk and is accessed via the pages
     unsigned int next_bat;
     unsigned short block_count;
-    unsigned char data[1];          // contains actually more than one byte
 };
 typedef struct libtabfs_bat libtabfs_bat_t;
 
 /**
- * @brief loads an BAT section from disk
+ * @brief entry of the per-volume region index; one for every BAT section, ordered like the __next_bat chain
+ */
+struct libtabfs_bat_region {
+    libtabfs_lba_28_t start_lba;    // first lba covered by the section
+    libtabfs_lba_28_t end_lba;      // first lba after the section
+    libtabfs_bat_t* bat;
+};
+typedef struct libtabfs_bat_region libtabfs_bat_region_t;
+
+/**
+ * @brief an allocation group; one or more adjacent BAT sections that are allocated from under their own lock.
+ * Threads allocating at the same time are spread over the groups, so they only wait for each other when they
+ * need the same group. Sections are grouped until a group covers at least LIBTABFS_ALLOC_GROUP_MIN_BLOCKS blocks.
+ * Everything inside the sections of a group (bitmap, summary, extents, dirty flags) is protected by its lock
+ */
+struct libtabfs_alloc_group {
+    unsigned int index;             // position inside the group array of the volume
+    libtabfs_bat_t* first;          // first section of the group
+    libtabfs_bat_t* last;           // last section of the group; the ones between are reached through __next_bat
+    long long free_count;           // free blocks inside the indexed sections of the group
+    void* lock;                     // NULL without LIBTABFS_THREADSAFE
+};
+typedef struct libtabfs_alloc_group libtabfs_alloc_group_t;
+
+/**
+ * @brief an allocation policy; decides where inside an BAT section an run of chained blocks is placed.
+ * The policy of an volume is chosen when its mounted (see libtabfs_volume_options_t) and can be changed
+ * with libtabfs_volume_set_alloc_policy. Runs that only fit across the end of an section and lose blocks
+ * are placed the same way by all policies
+ */
+struct libtabfs_alloc_policy {
+    const char* name;
+
+    // searches without an goal start at the allocation cursor (the lba after the last allocation) instead of the start of the volume
+    bool from_cursor;
+
+    /**
+     * @brief searches count free blocks after each other inside an section; its free-extent index (bat->__free_extents)
+     * is up to date when this is called
+     *
+     * @param bat the section to search in
+     * @param from the lowest bit of the section that may be returned
+     * @param count the count of free blocks needed
+     * @return the first bit of the found run or -1 if the section has none
+     */
+    long (*find)(libtabfs_bat_t* bat, long from, unsigned int count);
+};
+typedef struct libtabfs_alloc_policy libtabfs_alloc_policy_t;
+
+// takes the lowest run that is big enough; the default
+extern const libtabfs_alloc_policy_t libtabfs_alloc_first_fit;
+
+// like first-fit, but continues after the last allocation; good for append-heavy workloads like logs
+extern const libtabfs_alloc_policy_t libtabfs_alloc_next_fit;
+
+// takes the smallest run that is big enough inside the first section that has one; leaves big runs for big files
+extern const libtabfs_alloc_policy_t libtabfs_alloc_best_fit;
+
+// places runs with an power-of-two size (like entrytable and FAT sections) on an lba thats an multiple of their size,
+// so freed runs merge again into bigger aligned ones; other sizes are placed first-fit
+extern const libtabfs_alloc_policy_t libtabfs_alloc_buddy;
+
+/**
+ * @brief loads an BAT section from disk; in lazy mode only its header is read, the bitmap is loaded page by page
+ * when its accessed
  * 
  * @param volume the volume to read from
  * @param bat_addr the LBA 28 where to start reading
@@ -25,6 +98,74 @@ typedef struct libtabfs_bat libtabfs_bat_t;
  */
 libtabfs_bat_t* libtabfs_load_bat(libtabfs_volume_t* volume, libtabfs_lba_28_t bat_addr);
 
+/**
+ * @brief returns an pointer to an byte of the bitmap of an BAT section; loads the page holding it if needed.
+ * The pointer is only valid until the next page of the volume is loaded, since that can evict other pages
+ *
+ * @param bat the BAT section
+ * @param byte the byte offset into the bitmap
+ * @return pointer to the byte
+ */
+unsigned char* libtabfs_bat_getdata(libtabfs_bat_t* bat, long byte);
+
+/**
+ * @brief builds the free counter, summary and free-extent index of an BAT section if not done already;
+ * in lazy mode this reads all pages of the section once
+ *
+ * @param bat the BAT section to index
+ */
+void libtabfs_bat_ensure_indexed(libtabfs_bat_t* bat);
+
+/**
+ * @brief builds the region index and the allocation groups of an volume from its __bat_root chain; calculates the start lba
+ * of every section so lookups dont need to walk the chain anymore. Sections appended by libtabfs_bat_grow are added to the
+ * index by it; for any other change of the chain this needs to be called again (not while other threads use the volume).
+ *
+ * @param volume the volume to build the index for
+ */
+void libtabfs_bat_build_index(libtabfs_volume_t* volume);
+
+/**
+ * @brief frees the region index and the allocation groups (and their locks) of an volume
+ *
+ * @param volume the volume to free the index of
+ */
+void libtabfs_bat_free_index(libtabfs_volume_t* volume);
+
+/**
+ * @brief (re)builds the free-extent index of an BAT section from its bitmap
+ *
+ * @param bat the BAT section to index
+ */
+void libtabfs_bat_build_extents(libtabfs_bat_t* bat);
+
+/**
+ * @brief (re)builds the free counter and the full-word summary of an BAT section from its bitmap
+ *
+ * @param bat the BAT section to summarize
+ */
+void libtabfs_bat_build_summary(libtabfs_bat_t* bat);
+
+/**
+ * @brief searches the first free block of an BAT section at or after an given bit position;
+ * words marked as full in the summary are skipped without reading them
+ *
+ * @param bat the BAT section to search in
+ * @param from the first bit position to check
+ * @return the bit position of the free block or libtabfs_bat_getcount(bat) if there is none
+ */
+long libtabfs_bat_find_free(libtabfs_bat_t* bat, long from);
+
+/**
+ * @brief returns the longest run of free blocks of an volume, runs crossing section borders included;
+ * only looks at the largest extent and the extents at the borders of each section, so its O(count of sections).
+ * Sections that are not indexed yet are skipped.
+ *
+ * @param volume the volume to search in
+ * @return the length of the longest free run
+ */
+long long libtabfs_bat_largest_free(libtabfs_volume_t* volume);
+
 /**
  * @brief destroys / free's an BAT section
  * 
@@ -67,21 +208,37 @@ libtabfs_lba_28_t libtabfs_bat_getstart(libtabfs_bat_t* bat);
 libtabfs_lba_28_t libtabfs_bat_getlba(libtabfs_bat_t* bat, int bytePos, int bitPos);
 
 /**
- * @brief flush a complete BAT section to disk
+ * @brief flags the blocks of an BAT section that hold the given bytes of data as dirty, so the next sync writes them
+ *
+ * @param bat the BAT section that was modified
+ * @param byte_from first modified byte of data
+ * @param byte_to byte after the last modified byte of data (exclusive)
+ */
+void libtabfs_bat_mark_dirty(libtabfs_bat_t* bat, long byte_from, long byte_to);
+
+/**
+ * @brief flush a complete BAT section to disk; clears all dirty flags of the section
  * 
  * @param bat the BAT section to flush
  */
 void libtabfs_bat_flush_to_disk(libtabfs_bat_t* bat);
 
 /**
- * @brief syncs all BAT sections to disk
+ * @brief flushes only the dirty blocks of an BAT section to disk; runs of adjacent dirty blocks are written at once
+ *
+ * @param bat the BAT section to flush
+ */
+void libtabfs_bat_flush_dirty_to_disk(libtabfs_bat_t* bat);
+
+/**
+ * @brief syncs all BAT sections to disk; only blocks that changed since the last sync are written
  * 
  * @param bat the BAT section to start syncing
  */
 void libtabfs_bat_sync(libtabfs_bat_t* bat);
 
 /**
- * @brief only flushes one block of the BAT to disk
+ * @brief only flushes one block of the BAT to disk; clears the dirty flag of the block
  * 
  * @param bat the BAT section which block to flush
  * @param block_off offset of the block into the section
@@ -89,7 +246,17 @@ void libtabfs_bat_sync(libtabfs_bat_t* bat);
 void libtabfs_bat_flush_part_to_disk(libtabfs_bat_t* bat, int block_off);
 
 /**
- * @brief returns the BAT region of an LBA; LBA should *not* be relative to bat_start_LBA
+ * @brief sends all pending discards of an volume to the device (see libtabfs_discard_device); adjacent freed ranges
+ * are merged, so every range is sent once. Does nothing if libtabfs is compiled without LIBTABFS_DISCARD.
+ * Syncs the BAT before sending them, so the device never drops blocks the BAT on disk still marks as used
+ *
+ * @param volume the volume to discard the freed blocks of
+ */
+void libtabfs_bat_discard_flush(libtabfs_volume_t* volume);
+
+/**
+ * @brief returns the BAT region of an LBA; LBA should *not* be relative to bat_start_LBA.
+ * Uses an binary search over the region index of the volume
  * 
  * @param volume the volume to use
  * @param lba the lba to find the coresponding BAT region
@@ -97,6 +264,18 @@ void libtabfs_bat_flush_part_to_disk(libtabfs_bat_t* bat, int block_off);
  */
 libtabfs_bat_t* libtabfs_bat_getBatRegion(libtabfs_volume_t* volume, libtabfs_lba_28_t lba);
 
+/**
+ * @brief appends an new section to the BAT chain that covers the blocks after the last section; used by the allocators
+ * when no section has enough free blocks left. The new section is placed on the first blocks it covers and is sized to
+ * cover as much as the BAT did before (so the covered range doubles), at least count free blocks and at most up to max_LBA.
+ * The section gets an allocation group of its own and is appended to the index; growing is serialized by an lock of the volume
+ *
+ * @param volume the volume to grow the BAT of
+ * @param count the count of free blocks the new section needs to have at least
+ * @return the new section or NULL if max_LBA dosnt leave room for it
+ */
+libtabfs_bat_t* libtabfs_bat_grow(libtabfs_volume_t* volume, unsigned int count);
+
 /**
  * @brief checks if an given range (count) of blocks are free from the given start position
  * 
@@ -111,7 +290,9 @@ libtabfs_bat_t* libtabfs_bat_getBatRegion(libtabfs_volume_t* volume, libtabfs_lb
 libtabfs_error libtabfs_bat_are_blocks_free(libtabfs_bat_t* bat, int bytePos, int bitPos, unsigned int count);
 
 /**
- * @brief marks an range; should be first tested by libtabfs_bat_are_blocks_free
+ * @brief marks an range; should be first tested by libtabfs_bat_are_blocks_free.
+ * Also removes the range from the free-extent index and updates the free counter and summary;
+ * continues into the next BAT section(s) if the range crosses the end of this one
  * 
  * @param bat the bat region to start
  * @param bytePos the starting byte offset
@@ -122,6 +303,8 @@ void libtabfs_bat_mark_range(libtabfs_bat_t* bat, int bytePos, int bitPos, unsig
 
 /**
  * @brief clears an range; this dosnt test if the range was set before!
+ * Also adds the range to the free-extent index and updates the free counter and summary;
+ * continues into the next BAT section(s) if the range crosses the end of this one
  * 
  * @param bat the bat region to start
  * @param bytePos the starting byte offset
@@ -131,17 +314,30 @@ void libtabfs_bat_mark_range(libtabfs_bat_t* bat, int bytePos, int bitPos, unsig
 void libtabfs_bat_clear_range(libtabfs_bat_t* bat, int bytePos, int bitPos, unsigned int count);
 
 /**
- * @brief try and allocate a specific amount of lose blocks (not neccessarily near each other)
+ * @brief try and allocate a specific amount of lose blocks (not neccessarily near each other);
+ * all blocks are collected in one pass over the free-extent index, lowest lba first
  * 
  * @param volume the tabfs instance to operate on
  * @param count the amount of lose blocks to allocate; also acts as a minimum size to lba_out
- * @param lba_out buffer that will hold the allocated blocks after this call
- * @return true if the allocation was successfull, false when not (out of blocks)
+ * @param lba_out buffer that will hold the allocated blocks after this call; sorted ascending
+ * @return true if the allocation was successfull, false when not (out of blocks); nothing is allocated in that case
  */
 bool libtabfs_bat_allocateLoseBlocks(libtabfs_volume_t* volume, unsigned short count, long long* lba_out);
 
 /**
- * @brief deallocate/free a specific amount of lose blocks
+ * @brief like libtabfs_bat_allocateLoseBlocks, but takes the free blocks starting at an goal lba;
+ * if there are not enough after it, the search wraps around to the start of the device
+ * 
+ * @param volume the tabfs instance to operate on
+ * @param count the amount of lose blocks to allocate; also acts as a minimum size to lba_out
+ * @param goal the lba where the search starts; if LIBTABFS_INVALID_LBA28, the allocation cursor of the volume is used
+ * @param lba_out buffer that will hold the allocated blocks after this call; sorted ascending
+ * @return true if the allocation was successfull, false when not (out of blocks); nothing is allocated in that case
+ */
+bool libtabfs_bat_allocateLoseBlocksAt(libtabfs_volume_t* volume, unsigned short count, libtabfs_lba_28_t goal, long long* lba_out);
+
+/**
+ * @brief deallocate/free a specific amount of lose blocks; runs of adjacent lba's are freed at once
  * 
  * @param volume the tabfs instance to operate on
  * @param count the amount of lose blocks to free; also acts as a minimum size to lba_in
@@ -150,7 +346,9 @@ bool libtabfs_bat_allocateLoseBlocks(libtabfs_volume_t* volume, unsigned short c
 void libtabfs_bat_freeLoseBlocks(libtabfs_volume_t* volume, unsigned short count, long long* lba_in);
 
 /**
- * @brief try and allocate a specific amount of chained blocks (all after each other)
+ * @brief try and allocate a specific amount of chained blocks (all after each other);
+ * uses the free-extent index of the BAT sections to find an run that is big enough. Where the run is placed
+ * depends on the allocation policy of the volume; with the default (first-fit) its the first one
  * 
  * @param volume the tabfs instance to operate on
  * @param count the amount of blocks to allocate
@@ -158,6 +356,19 @@ void libtabfs_bat_freeLoseBlocks(libtabfs_volume_t* volume, unsigned short count
  */
 libtabfs_lba_28_t libtabfs_bat_allocateChainedBlocks(libtabfs_volume_t* volume, unsigned short count);
 
+/**
+ * @brief try and allocate a specific amount of chained blocks near an goal lba; the search starts at the goal,
+ * goes up to the end of the device and then wraps around to the start. Useful to place blocks of an file
+ * after each other or an entrytable near its parent. Inside every section the run is placed by the allocation policy of the volume
+ * 
+ * @param volume the tabfs instance to operate on
+ * @param count the amount of blocks to allocate
+ * @param goal the lba where the search starts; if LIBTABFS_INVALID_LBA28, the allocation cursor of the volume
+ *              (the lba after the last allocation) is used, which makes this an next-fit allocation
+ * @return the first LBA of the chain of blocks or negative one if out of blocks
+ */
+libtabfs_lba_28_t libtabfs_bat_allocateChainedBlocksAt(libtabfs_volume_t* volume, unsigned short count, libtabfs_lba_28_t goal);
+
 /**
  * @brief try and free a specific amount of chained blocks
  * 
@@ -0,0 +1,60 @@
+#ifndef __LIBTABFS_BITMAP_H__
+#define __LIBTABFS_BITMAP_H__
+
+#include "./common.h"
+
+/**
+ * Bitmaps in tabfs are stored MSB-first: bit 0 of an bitmap is the most significant bit of the first byte,
+ * so the bit at index i is tested with `map[i / 8] & (0x80 >> (i % 8))`.
+ *
+ * The scanning functions below read the bitmap 64 bits at a time and use count-leading-zeros to find the bit
+ * they search for. When the library is compiled with SSE2 or AVX2 enabled, runs of bytes that can be skipped
+ * completely are checked 16 or 32 bytes at a time, and with AVX2 bits are also counted 32 bytes at a time;
+ * define LIBTABFS_NO_SIMD to always use the portable path.
+ *
+ * SSE2 is part of every x86-64 cpu, so its always used there. AVX2 isnt, so its only enabled on request:
+ * `make SIMD=avx2` or `xmake f --avx2=y`; otherwise the AVX2 path isnt compiled in.
+ */
+
+/**
+ * @brief searches the first clear (zero) bit inside an range of an bitmap
+ *
+ * @param map the bitmap to search in
+ * @param from index of the first bit to check
+ * @param to index after the last bit to check (exclusive)
+ * @return index of the first clear bit; if all bits in the range are set, `to` is returned
+ */
+long libtabfs_bitmap_find_clear(const unsigned char* map, long from, long to);
+
+/**
+ * @brief searches the first set (one) bit inside an range of an bitmap
+ *
+ * @param map the bitmap to search in
+ * @param from index of the first bit to check
+ * @param to index after the last bit to check (exclusive)
+ * @return index of the first set bit; if all bits in the range are clear, `to` is returned
+ */
+long libtabfs_bitmap_find_set(const unsigned char* map, long from, long to);
+
+/**
+ * @brief counts the set (one) bits inside an range of an bitmap
+ *
+ * @param map the bitmap to count in
+ * @param from index of the first bit to count
+ * @param to index after the last bit to count (exclusive)
+ * @return count of set bits in the range
+ */
+long libtabfs_bitmap_count_set(const unsigned char* map, long from, long to);
+
+/**
+ * @brief sets or clears all bits inside an range of an bitmap; partial bytes at the start and end of the range
+ * are masked, everything in between is filled a word at a time
+ *
+ * @param map the bitmap to modify
+ * @param from index of the first bit to change
+ * @param to index after the last bit to change (exclusive)
+ * @param set true to set the bits, false to clear them
+ */
+void libtabfs_bitmap_fill(unsigned char* map, long from, long to, bool set);
+
+#endif // __LIBTABFS_BITMAP_H__
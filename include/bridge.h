@@ -111,9 +111,121 @@ extern void libtabfs_free(void* ptr, int size);
  */
 extern void libtabfs_get_current_time(libtabfs_time_t* time);
 
+#ifdef LIBTABFS_DISCARD
+    /**
+     * @brief tells a device that an range of blocks is not used anymore (TRIM / UNMAP); their content can be dropped.
+     * Only needed when libtabfs is compiled with LIBTABFS_DISCARD defined; bridges without it dont need to implement it.
+     * With LIBTABFS_THREADSAFE this is called while an lock of the volume is held, so it must not call back into libtabfs
+     * 
+     * @param dev_data the devicedata provided in the call to libtabfs_new_volume
+     * @param lba the first lba of the range
+     * @param is_absolute_lba true if the lba is absolute; false otherwise (relative to partition or similar)
+     * @param count how many blocks the range has
+     */
+    extern void libtabfs_discard_device(
+        void* dev_data,
+        libtabfs_lba_28_t lba, bool is_absolute_lba,
+        unsigned int count
+    );
+#endif
+
+#ifdef LIBTABFS_THREADSAFE
+    /**
+     * @brief creates an new (non-recursive) mutex; only needed when libtabfs is compiled with LIBTABFS_THREADSAFE defined
+     * 
+     * @return the new lock; passed to all other lock functions
+     */
+    extern void* libtabfs_lock_create(void);
+
+    /**
+     * @brief destroys an lock created by libtabfs_lock_create; its never held when this is called
+     * 
+     * @param lock the lock to destroy
+     */
+    extern void libtabfs_lock_destroy(void* lock);
+
+    /**
+     * @brief acquires an lock; blocks until its available
+     * 
+     * @param lock the lock to acquire
+     */
+    extern void libtabfs_lock_acquire(void* lock);
+
+    /**
+     * @brief tries to acquire an lock without blocking
+     * 
+     * @param lock the lock to acquire
+     * @return true if the lock was acquired; false if its held by someone else
+     */
+    extern bool libtabfs_lock_try_acquire(void* lock);
+
+    /**
+     * @brief releases an lock acquired by libtabfs_lock_acquire or libtabfs_lock_try_acquire
+     * 
+     * @param lock the lock to release
+     */
+    extern void libtabfs_lock_release(void* lock);
+
+    /**
+     * @brief creates an new reader-writer lock; only needed when libtabfs is compiled with LIBTABFS_THREADSAFE defined.
+     * Its never acquired twice by the same thread, so it dosnt need to be recursive
+     * 
+     * @return the new lock; passed to all other rwlock functions
+     */
+    extern void* libtabfs_rwlock_create(void);
+
+    /**
+     * @brief destroys an lock created by libtabfs_rwlock_create; its never held when this is called
+     * 
+     * @param lock the lock to destroy
+     */
+    extern void libtabfs_rwlock_destroy(void* lock);
+
+    /**
+     * @brief acquires an reader-writer lock shared; any count of threads can hold it shared at the same time.
+     * Blocks while its held exclusive
+     * 
+     * @param lock the lock to acquire
+     */
+    extern void libtabfs_rwlock_acquire_shared(void* lock);
+
+    /**
+     * @brief releases an reader-writer lock acquired by libtabfs_rwlock_acquire_shared
+     * 
+     * @param lock the lock to release
+     */
+    extern void libtabfs_rwlock_release_shared(void* lock);
+
+    /**
+     * @brief acquires an reader-writer lock exclusive; blocks while its held by anyone else, shared or exclusive
+     * 
+     * @param lock the lock to acquire
+     */
+    extern void libtabfs_rwlock_acquire_exclusive(void* lock);
+
+    /**
+     * @brief releases an reader-writer lock acquired by libtabfs_rwlock_acquire_exclusive
+     * 
+     * @param lock the lock to release
+     */
+    extern void libtabfs_rwlock_release_exclusive(void* lock);
+#endif
+
 #ifndef libtabfs_realloc
     void* libtabfs_realloc(void* old, int old_size, int new_size);
     #define LIBTABFS_DEFAULT_REALLOC
 #endif
 
+/**
+ * @brief sets count bytes of dest to value; if not defined as an macro, an simple byte loop is used
+ *
+ * @param dest buffer to fill
+ * @param value byte to fill it with
+ * @param count number of bytes to set
+ */
+#ifndef libtabfs_memset
+    void libtabfs_memset(void* dest, unsigned char value, int count);
+    #define LIBTABFS_DEFAULT_MEMSET
+#endif
+
 #endif //__LIBTABFS_BRIDGE_H__
\ No newline at end of file
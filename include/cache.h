@@ -0,0 +1,182 @@
+#ifndef __LIBTABFS_CACHE_H__
+#define __LIBTABFS_CACHE_H__
+
+#include "./common.h"
+#include "./linkedlist.h"
+
+struct libtabfs_cache;
+
+/**
+ * @brief memory budget shared by all caches of an volume (entrytables, fats, directory indexes and bucket tables).
+ * Once the sections inside them need more bytes than the limit, the least-recently-used ones are written back and freed;
+ * except sections that are pinned, and sections that were used by the libtabfs call that is running right now or that
+ * returned last. Sections a call hands out through its out-pointers are pinned until the caller releases them
+ * (libtabfs_entrytable_release, libtabfs_fat_release); other pointers stay valid until the end of the next call.
+ *
+ * Nothing is evicted while an call is running (depth > 0), since internal code holds pointers into sections
+ * across loads; the cache is trimmed when the outermost call returns, or when an section is loaded outside of one.
+ */
+struct libtabfs_cache_budget {
+    unsigned long limit;            // max bytes of all sections together; 0 = no limit
+    unsigned long bytes;            // bytes of all sections currently cached
+    unsigned long long clock;       // advanced on every use of an section; orders sections of different caches
+    unsigned int epoch;             // advanced when an outermost call starts
+    unsigned int depth;             // count of nested libtabfs calls running right now
+    struct libtabfs_cache* caches[4];
+    unsigned int cache_count;
+};
+typedef struct libtabfs_cache_budget libtabfs_cache_budget_t;
+
+/**
+ * @brief an cached section; part of the lru list of its cache while its not pinned
+ */
+struct libtabfs_cache_node {
+    libtabfs_lba_28_t lba;
+    void* data;
+    unsigned int size;
+    unsigned int pins;
+    unsigned int epoch;             // epoch of the budget when the section was last used
+    unsigned long long last_use;
+    struct libtabfs_cache_node* lru_prev;   // towards the most recently used section
+    struct libtabfs_cache_node* lru_next;   // towards the least recently used section
+};
+typedef struct libtabfs_cache_node libtabfs_cache_node_t;
+
+/**
+ * @brief an slot of an cache; empty if data is NULL
+ */
+struct libtabfs_cache_slot {
+    libtabfs_lba_28_t lba;
+    void* data;
+    libtabfs_cache_node_t* node;
+};
+typedef struct libtabfs_cache_slot libtabfs_cache_slot_t;
+
+/**
+ * @brief cache of loaded sections (entrytables or fats) keyed by their lba; an open-addressing hashtable with
+ * linear probing. The cache owns the sections inside it: they are handed to free_callback when they are evicted
+ * or the cache is destroyed, which needs to write them back.
+ */
+struct libtabfs_cache {
+    libtabfs_free_callback free_callback;
+    libtabfs_cache_budget_t* budget;
+    libtabfs_cache_slot_t* slots;
+    unsigned int capacity;      // always an power of two
+    unsigned int count;
+    libtabfs_cache_node_t* lru_head;    // most recently used
+    libtabfs_cache_node_t* lru_tail;    // least recently used
+    void* lock;                 // rwlock; shared by lookups, exclusive when the table changes (LIBTABFS_THREADSAFE only)
+};
+typedef struct libtabfs_cache libtabfs_cache_t;
+
+/**
+ * @brief iterates over all used slots of an cache; the cache must not be modified inside the loop
+ */
+#define LIBTABFS_CACHE_FOREACH(cache, slot) \
+    for (libtabfs_cache_slot_t* slot = (cache)->slots; slot < (cache)->slots + (cache)->capacity; slot++) \
+        if (slot->data != NULL)
+
+/**
+ * @brief creates an new, empty cache
+ *
+ * @param free_callback an callback, that gets called for every section that is evicted or still inside the cache
+ *      when its destroyed
+ * @param budget optional memory budget the cache is part of; NULL if the cache should never evict anything
+ * @return the new cache
+ */
+libtabfs_cache_t* libtabfs_cache_create(libtabfs_free_callback free_callback, libtabfs_cache_budget_t* budget);
+
+/**
+ * @brief destroys an cache; calls the free_callback for every section still inside it
+ *
+ * @param cache the cache to destroy
+ */
+void libtabfs_cache_destroy(libtabfs_cache_t* cache);
+
+/**
+ * @brief adds an section to the cache. If there is an section with the same lba inside it already (another thread
+ * loaded it at the same time), nothing is added and the caller needs to free its section and use the returned one.
+ * Outside of an call, other sections might be evicted first to make room
+ *
+ * @param cache the cache to add to
+ * @param lba the lba of the section
+ * @param data the section
+ * @param size bytes the section uses
+ * @return the section that is inside the cache for the lba now
+ */
+void* libtabfs_cache_add(libtabfs_cache_t* cache, libtabfs_lba_28_t lba, void* data, unsigned int size);
+
+/**
+ * @brief searches an section by its lba and marks it as used; with LIBTABFS_THREADSAFE its only searched, since
+ * nothing is evicted anyway
+ *
+ * @param cache the cache to search in
+ * @param lba the lba of the section
+ * @return the section or NULL if it isnt cached
+ */
+void* libtabfs_cache_find(libtabfs_cache_t* cache, libtabfs_lba_28_t lba);
+
+/**
+ * @brief removes an section from the cache; dosnt call the free_callback, since the caller does this
+ *
+ * @param cache the cache to remove from
+ * @param lba the lba of the section
+ */
+void libtabfs_cache_remove(libtabfs_cache_t* cache, libtabfs_lba_28_t lba);
+
+/**
+ * @brief changes the bytes an cached section uses, for sections that grow while they are cached
+ *
+ * @param cache the cache of the section
+ * @param lba the lba of the section
+ * @param size bytes the section uses now
+ */
+void libtabfs_cache_resize(libtabfs_cache_t* cache, libtabfs_lba_28_t lba, unsigned int size);
+
+/**
+ * @brief pins an cached section, so its never evicted; pins are counted, every pin needs an unpin
+ *
+ * @param cache the cache of the section
+ * @param lba the lba of the section
+ */
+void libtabfs_cache_pin(libtabfs_cache_t* cache, libtabfs_lba_28_t lba);
+
+/**
+ * @brief releases an pin of an cached section
+ *
+ * @param cache the cache of the section
+ * @param lba the lba of the section
+ */
+void libtabfs_cache_unpin(libtabfs_cache_t* cache, libtabfs_lba_28_t lba);
+
+/**
+ * @brief initializes an budget without any cache
+ *
+ * @param budget the budget to initialize
+ * @param limit max bytes of all sections together; 0 = no limit
+ */
+void libtabfs_cache_budget_init(libtabfs_cache_budget_t* budget, unsigned long limit);
+
+/**
+ * @brief evicts the least recently used sections of all caches of an budget until their bytes are at most the limit
+ * (or only sections are left that cant be evicted)
+ *
+ * @param budget the budget to trim
+ */
+void libtabfs_cache_trim(libtabfs_cache_budget_t* budget);
+
+/**
+ * @brief marks the start of an libtabfs call; nothing is evicted until the matching libtabfs_cache_leave
+ *
+ * @param budget the budget of the volume
+ */
+void libtabfs_cache_enter(libtabfs_cache_budget_t* budget);
+
+/**
+ * @brief marks the end of an libtabfs call; trims the caches once the outermost call ends
+ *
+ * @param budget the budget of the volume
+ */
+void libtabfs_cache_leave(libtabfs_cache_budget_t* budget);
+
+#endif // __LIBTABFS_CACHE_H__
\ No newline at end of file
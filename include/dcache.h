@@ -0,0 +1,109 @@
+#ifndef __LIBTABFS_DCACHE_H__
+#define __LIBTABFS_DCACHE_H__
+
+#include "./common.h"
+#include "./volume.h"
+#include "./entrytable.h"
+
+/**
+ * Dentry cache
+ *
+ * An per-volume table that remembers where libtabfs_entrytab_traversetree found each path component: the key is the
+ * first section of the directory plus the name, the value the position of the entry (section + offset) or that there
+ * is no entry with the name (an negative dentry). So resolving an path again costs one probe per component instead of
+ * an lookup inside every directory; the permission checks are still done every time.
+ *
+ * The table has an fixed count of slots (volume option dentry_cache_slots) and each key has exactly one slot it can be
+ * in, so an new dentry just replaces whatever was in its slot before; nothing else has to be evicted.
+ * Dentries are forgotten by libtabfs_create_entry (negative dentry of the new name) and when an section is removed
+ * (every dentry of its directory or pointing into it). Code that renames or frees an entry has to call
+ * libtabfs_dcache_forget for the old name. An positive dentry is only used if the entry it points to still has the name,
+ * so an entry that was freed or reused without that is just searched again.
+ */
+
+/**
+ * @brief an slot of the dentry cache; empty if dir_lba is 0
+ */
+struct libtabfs_dentry {
+    libtabfs_lba_28_t dir_lba;  // first section of the directory the name was searched in
+    unsigned int hash;          // libtabfs_name_hash of the name
+    libtabfs_lba_28_t lba;      // section of the entry
+    unsigned int size;          // size of that section in bytes; 0 for an negative dentry
+    unsigned int offset;        // entry offset inside the section
+    unsigned char namelen;
+    char name[63];
+};
+typedef struct libtabfs_dentry libtabfs_dentry_t;
+
+struct libtabfs_dcache {
+    libtabfs_dentry_t* slots;
+    unsigned int capacity;      // always an power of two
+    void* lock;                 // rwlock; shared by lookups, exclusive by all others (LIBTABFS_THREADSAFE only)
+};
+typedef struct libtabfs_dcache libtabfs_dcache_t;
+
+/**
+ * @brief creates an dentry cache
+ *
+ * @param slots count of slots; rounded up to the next power of two
+ * @return the new dentry cache
+ */
+libtabfs_dcache_t* libtabfs_dcache_create(unsigned int slots);
+
+/**
+ * @brief frees an dentry cache
+ *
+ * @param dcache the dentry cache to free
+ */
+void libtabfs_dcache_destroy(libtabfs_dcache_t* dcache);
+
+/**
+ * @brief searches the dentry of an name inside an directory
+ *
+ * @param dcache the dentry cache to search in
+ * @param dir_lba lba of the first section of the directory
+ * @param name the name to search
+ * @param namelen length of the name
+ * @param hash libtabfs_name_hash of the name
+ * @param dentry_out the dentry is copied to this, since its slot can be replaced by an other thread right after
+ * @return true if there was an dentry; check its size to see if its an negative one
+ */
+bool libtabfs_dcache_lookup(
+    libtabfs_dcache_t* dcache, libtabfs_lba_28_t dir_lba, const char* name, int namelen, unsigned int hash,
+    libtabfs_dentry_t* dentry_out
+);
+
+/**
+ * @brief remembers the result of an lookup
+ *
+ * @param dcache the dentry cache
+ * @param dir_lba lba of the first section of the directory
+ * @param name the name that was searched
+ * @param namelen length of the name
+ * @param hash libtabfs_name_hash of the name
+ * @param section the section of the found entry; NULL for an negative dentry
+ * @param offset offset of the found entry inside its section
+ */
+void libtabfs_dcache_insert(
+    libtabfs_dcache_t* dcache, libtabfs_lba_28_t dir_lba, const char* name, int namelen, unsigned int hash,
+    libtabfs_entrytable_t* section, int offset
+);
+
+/**
+ * @brief forgets the dentry of an name inside an directory, if there is one
+ *
+ * @param volume the volume of the directory; does nothing if it has no dentry cache
+ * @param dir_lba lba of the first section of the directory
+ * @param name the name
+ */
+void libtabfs_dcache_forget(libtabfs_volume_t* volume, libtabfs_lba_28_t dir_lba, char* name);
+
+/**
+ * @brief forgets all dentries of an directory and all that point into an section
+ *
+ * @param volume the volume of the section; does nothing if it has no dentry cache
+ * @param lba the lba of the section
+ */
+void libtabfs_dcache_forget_section(libtabfs_volume_t* volume, libtabfs_lba_28_t lba);
+
+#endif // __LIBTABFS_DCACHE_H__
\ No newline at end of file
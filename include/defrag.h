@@ -0,0 +1,91 @@
+#ifndef __LIBTABFS_DEFRAG_H__
+#define __LIBTABFS_DEFRAG_H__
+
+#include "./common.h"
+#include "./volume.h"
+
+/**
+ * Online defragmentation
+ *
+ * The defragmenter walks the directory tree of an volume and
+ * - moves the blocks of FAT files that are spread over the disk into one chained run right after (or as near as possible to)
+ *   their FAT section, updating the FAT entries to the new blocks;
+ * - moves continuous files into the first hole before them that can hold them, updating the lba of their entry,
+ *   so the free space behind them merges into bigger runs.
+ * Data is always copied first, then the pointers to it are updated and synced, and only then the old blocks are freed.
+ *
+ * All work is done in steps with an budget, so it can run in idle periods without stalling anything else.
+ * Between two steps the volume can be used normally; the defragmenter dosnt keep pointers into the caches,
+ * only lba's, and checks them again in the next step. Kernels and entrytable sections are never moved, since
+ * they are referenced from places the defragmenter cant update (bootloaders, longname and parent links).
+ * Steps lock every file while its moved (see lock.h), so other calls can run at the same time.
+ */
+
+/**
+ * @brief first section of an directory that still needs to be visited
+ */
+struct libtabfs_defrag_dir {
+    libtabfs_lba_28_t lba;
+    unsigned int size;
+};
+typedef struct libtabfs_defrag_dir libtabfs_defrag_dir_t;
+
+/**
+ * @brief state of an defragmentation pass; create with libtabfs_defrag_create
+ */
+struct libtabfs_defrag {
+    libtabfs_volume_t* __volume;
+
+    // directories not visited yet
+    libtabfs_defrag_dir_t* __dirs;
+    unsigned int __dir_count;
+    unsigned int __dir_capacity;
+
+    // current position; __section_size is 0 when the next directory needs to be taken
+    libtabfs_lba_28_t __section_lba;
+    unsigned int __section_size;
+    int __offset;
+
+    // chained run the FAT file at the current position is moved into; __run_count is 0 if no file is in progress
+    libtabfs_lba_28_t __run_fat_lba;
+    libtabfs_lba_28_t __run_lba;
+    unsigned int __run_count;
+    unsigned int __run_done;
+
+    bool done;
+    unsigned long files_moved;      // files that ended up in one run
+    unsigned long files_skipped;    // fragmented files for which no run big enough was free
+    unsigned long blocks_moved;
+};
+typedef struct libtabfs_defrag libtabfs_defrag_t;
+
+/**
+ * @brief starts an new defragmentation pass over an volume; the pass starts at the root directory
+ *
+ * @param volume the volume to defragment
+ * @return the state of the pass; free it with libtabfs_defrag_destroy
+ */
+libtabfs_defrag_t* libtabfs_defrag_create(libtabfs_volume_t* volume);
+
+/**
+ * @brief does the next part of an defragmentation pass. Every block that is copied and every entrytable or FAT section
+ * that needs to be looked at costs one unit of the budget; the step returns once its used up.
+ * FAT files bigger than the budget are moved over multiple steps; continuous files are only moved if they fit into
+ * the budget that is left, so ones bigger than the whole budget stay where they are.
+ *
+ * @param defrag the pass to continue
+ * @param budget the amount of work this step is allowed to do
+ * @param done_out optional pointer which will be set to true once the whole tree was visited
+ * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
+ */
+libtabfs_error libtabfs_defrag_step(libtabfs_defrag_t* defrag, unsigned int budget, bool* done_out);
+
+/**
+ * @brief ends an defragmentation pass; blocks reserved for an file that was not completely moved yet are given back,
+ * the blocks already moved stay where they are
+ *
+ * @param defrag the pass to end
+ */
+void libtabfs_defrag_destroy(libtabfs_defrag_t* defrag);
+
+#endif // __LIBTABFS_DEFRAG_H__
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef __LIBTABFS_DIRINDEX_H__
+#define __LIBTABFS_DIRINDEX_H__
+
+#include "./common.h"
+#include "./volume.h"
+#include "./entrytable.h"
+
+/**
+ * Directory name index
+ *
+ * An hashtable per directory that maps the hash of an name to the position of its entry (section + offset), over all
+ * sections of the directory. Its build the first time an name is searched in the directory and updated by
+ * libtabfs_create_entry, so an lookup costs one probe plus comparing the name of the entry it points to.
+ *
+ * Since only positions are stored, the index stays valid while the sections are evicted from the tablecache.
+ * Entries are always compared on lookup, so records that point to an entry that was freed or reused
+ * (for example by an create that failed halfway) are just skipped.
+ */
+
+/**
+ * @brief an record of an directory index; empty if size is 0
+ */
+struct libtabfs_dirindex_slot {
+    unsigned int hash;
+    libtabfs_lba_28_t lba;      // section of the entry
+    unsigned int size;          // size of that section in bytes
+    unsigned int offset;        // entry offset inside the section
+};
+typedef struct libtabfs_dirindex_slot libtabfs_dirindex_slot_t;
+
+/**
+ * @brief name index of an directory; keyed by the lba of its first section inside the volume's __dir_indexes
+ */
+struct libtabfs_dirindex {
+    libtabfs_lba_28_t lba;
+    libtabfs_dirindex_slot_t* slots;
+    unsigned int capacity;      // always an power of two
+    unsigned int count;
+};
+typedef struct libtabfs_dirindex libtabfs_dirindex_t;
+
+/**
+ * @brief hash of an name as used by the directory index (32bit FNV-1a)
+ *
+ * @param name the name to hash
+ * @return the hash
+ */
+unsigned int libtabfs_name_hash(char* name);
+
+/**
+ * @brief like libtabfs_name_hash, but for an name that is not terminated
+ *
+ * @param name the name to hash
+ * @param namelen length of the name
+ * @return the hash
+ */
+unsigned int libtabfs_name_hash_n(const char* name, int namelen);
+
+/**
+ * @brief retrieves the index of an directory; its build from all sections of the directory if it dosnt exist yet
+ *
+ * @param first_section the first section of the directory
+ * @return the index of the directory
+ */
+libtabfs_dirindex_t* libtabfs_dirindex_get(libtabfs_entrytable_t* first_section);
+
+/**
+ * @brief searches an entry by its name in an directory using its index; internal function, that needs to run inside
+ * an libtabfs call: the section isnt pinned (libtabfs_entrytab_findentry is the public variant)
+ *
+ * @param first_section the first section of the directory
+ * @param name the name to search; dosnt need to be terminated
+ * @param namelen length of the name
+ * @param entry_out pointer to where the found entry should be stored; NULL if there is none with the name
+ * @param entrytable_out optional pointer to where the section of the found entry should be stored
+ * @param offset_out optional pointer to where the offset of the found entry inside its section should be stored
+ * @return LIBTABFS_ERR_NONE if the operation was successfull (even if nothing was found); other errorcode otherwise
+ */
+libtabfs_error libtabfs_dirindex_lookup(
+    libtabfs_entrytable_t* first_section, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
+/**
+ * @brief records an new entry in the index of its directory; does nothing if the directory has no index yet,
+ * since the entry is found when its build
+ *
+ * @param first_section the first section of the directory
+ * @param name the name of the entry
+ * @param section the section the entry is inside
+ * @param offset offset of the entry inside its section
+ */
+void libtabfs_dirindex_add(libtabfs_entrytable_t* first_section, char* name, libtabfs_entrytable_t* section, int offset);
+
+/**
+ * @brief removes the record of an entry from the index of its directory; must be called before the entry is freed
+ * or renamed, otherwise the record stays in the index until its rebuild (but is skipped on lookups)
+ *
+ * @param first_section the first section of the directory
+ * @param name the name of the entry
+ * @param section the section the entry is inside
+ * @param offset offset of the entry inside its section
+ */
+void libtabfs_dirindex_remove(libtabfs_entrytable_t* first_section, char* name, libtabfs_entrytable_t* section, int offset);
+
+/**
+ * @brief throws away the index of an directory, if there is one
+ *
+ * @param volume the volume of the directory
+ * @param lba the lba of the first section of the directory
+ */
+void libtabfs_dirindex_drop(libtabfs_volume_t* volume, libtabfs_lba_28_t lba);
+
+/**
+ * @brief removes all records that point into an section from every index; called before the section is freed,
+ * since its lba can be reused by anything else afterwards
+ *
+ * @param volume the volume of the section
+ * @param lba the lba of the section
+ */
+void libtabfs_dirindex_forget_section(libtabfs_volume_t* volume, libtabfs_lba_28_t lba);
+
+/**
+ * @brief internal function; called when an index inside __dir_indexes needs to be free'd
+ *
+ * @param index the index to free
+ */
+void libtabfs_dirindex_destroy(libtabfs_dirindex_t* index);
+
+#endif // __LIBTABFS_DIRINDEX_H__
\ No newline at end of file
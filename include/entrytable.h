@@ -80,13 +80,22 @@ struct libtabfs_entrytable_tableinfo {
         } flags;
         unsigned char rawflags;
     };
-    unsigned char __unused[39];
+    unsigned char format;                   // LIBTABFS_DIRFORMAT_*; only set in the first section of an directory
+    unsigned char bucket_bits;              // hashed: log2 of the count of buckets (first section only)
+    libtabfs_lba_28_t bucket_table_lba;     // hashed: first lba of the bucket table (first section only)
+    libtabfs_lba_28_t bucket_next_lba; int bucket_next_size;   // hashed: next section of the same bucket
+    unsigned char __unused[25];
     libtabfs_lba_28_t parent_lba; int parent_size;
     libtabfs_lba_28_t prev_lba; int prev_size;
     libtabfs_lba_28_t next_lba; int next_size;
 } LIBTABFS_PACKED;
 typedef struct libtabfs_entrytable_tableinfo libtabfs_entrytable_tableinfo_t;
 
+#define LIBTABFS_DIRFORMAT_LINEAR   0x00    // entries are placed in the first free slot of any section
+#define LIBTABFS_DIRFORMAT_HASHED   0x48    // entries are placed in the sections of the bucket of their name hash (see hashdir.h)
+
+#define LIBTABFS_LONGNAME_FINGERPRINT   0x46    // entries with an longname carry the hash of it, so lookups only load matching ones
+
 #define LIBTABFS_TAB_ENTRY_ACLUSR(e)    ((e->rawflags & 0b1) << 2 | (((e->rawflags >> 8) & 0b11000000) >> 6))
 #define LIBTABFS_TAB_ENTRY_ACLGRP(e)    (((e->rawflags >> 8) & 0b00111000) >> 3)
 #define LIBTABFS_TAB_ENTRY_ACLOTH(e)    ((e->rawflags >> 8) & 0b00000111)
@@ -111,7 +120,9 @@ struct libtabfs_entrytable_entry {
     union {
         char name[22];
         struct {
-            char unused[9];
+            unsigned char fingerprint_identifier;   // LIBTABFS_LONGNAME_FINGERPRINT if fingerprint is set
+            unsigned int fingerprint;               // libtabfs_name_hash() of the longname
+            char unused[4];
             libtabfs_lba_28_t longname_lba;
             int longname_lba_size;
             int longname_offset;
@@ -125,6 +136,9 @@ struct libtabfs_entrytable {
     libtabfs_volume_t* __volume;
     unsigned int __byteSize;
     libtabfs_lba_28_t __lba;
+    unsigned char* __used_map;                  // bit i set: entry i is in use; build by the first search for an free entry
+    libtabfs_lba_28_t __free_hint_lba;          // first section after this one that can have free entries; set when an
+    unsigned int __free_hint_size;              // search started here, reset when an entry is freed; 0 if not known
 
     // --------------------------------
     libtabfs_entrytable_entry_t entries[1]; // actually more than one;
@@ -278,6 +292,69 @@ void libtabfs_entry_touch(libtabfs_entrytable_entry_t* entry, libtabfs_time_t m_
  */
 libtabfs_entrytable_t* libtabfs_find_cached_entrytable(libtabfs_volume_t* volume, libtabfs_lba_28_t entrytable_lba);
 
+/**
+ * @brief pins an entrytable section, so its never evicted from the tablecache while the volume has an cache_budget;
+ * needed when an pointer to it is kept longer than until the end of the next libtabfs call. Every pin needs an unpin
+ * 
+ * @param entrytable the section to pin
+ */
+void libtabfs_entrytable_pin(libtabfs_entrytable_t* entrytable);
+
+/**
+ * @brief releases an pin of an entrytable section made with libtabfs_entrytable_pin
+ * 
+ * @param entrytable the section to unpin
+ */
+void libtabfs_entrytable_unpin(libtabfs_entrytable_t* entrytable);
+
+/**
+ * @brief releases an section an call handed out; calls that store an section into an entrytable_out or
+ * entrytable_newdir_out pin it, so it stays loaded until its released. Entries handed out without their section
+ * are only valid until the end of the next libtabfs call
+ *
+ * @param entrytable the section to release; NULL is ignored
+ */
+void libtabfs_entrytable_release(libtabfs_entrytable_t* entrytable);
+
+/**
+ * @brief locks the directory an section belongs to (see lock.h); does nothing without LIBTABFS_THREADSAFE.
+ * Lookups and the create functions do this themselves; its only needed around internal functions like
+ * libtabfs_create_entry, and no other function that locks an directory or file may be called while its held
+ * 
+ * @param section any section of the directory
+ * @param exclusive true to lock it for changes, false for lookups
+ * @return the lock to pass to libtabfs_entrytable_unlock
+ */
+void* libtabfs_entrytable_lock(libtabfs_entrytable_t* section, bool exclusive);
+
+/**
+ * @brief unlocks an directory locked by libtabfs_entrytable_lock
+ * 
+ * @param lock the lock returned by libtabfs_entrytable_lock
+ * @param exclusive the same as given to libtabfs_entrytable_lock
+ */
+void libtabfs_entrytable_unlock(void* lock, bool exclusive);
+
+/**
+ * @brief locks an continuous file (see lock.h); shared for reads, exclusive for writes and for moving its blocks.
+ * Its keyed by the entry, since the lba of the file changes when the defragmenter moves it
+ * 
+ * @param volume the volume of the file
+ * @param entry the entry of the file
+ * @param held an lock the caller already holds exclusive or NULL; its not taken again when the file shares it
+ * @param exclusive true to lock it for changes, false for reads
+ * @return the lock to pass to libtabfs_continuousfile_unlock; NULL if nothing was locked
+ */
+void* libtabfs_continuousfile_lock(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, void* held, bool exclusive);
+
+/**
+ * @brief unlocks an continuous file locked by libtabfs_continuousfile_lock
+ * 
+ * @param lock the lock returned by libtabfs_continuousfile_lock
+ * @param exclusive the same as given to libtabfs_continuousfile_lock
+ */
+void libtabfs_continuousfile_unlock(void* lock, bool exclusive);
+
 /**
  * @brief follows all prev-link's in all tableinfo entrys to find the first section of an entrytable
  * 
@@ -303,11 +380,32 @@ libtabfs_entrytable_t* libtabfs_entrytable_get_parent(libtabfs_entrytable_t* sec
 libtabfs_entrytable_t* libtabfs_entrytable_nextsection(libtabfs_entrytable_t* section);
 
 /**
- * @brief searches after an free entry inside an entrytable section
+ * @brief searches the first free entry of an single section with the map of used entries of the section;
+ * entries that got used since the map was build are noticed here and marked in the map
+ * 
+ * @param section the section to search in
+ * @return offset of the free entry or -1 if the section is full
+ */
+int libtabfs_entrytable_first_free(libtabfs_entrytable_t* section);
+
+/**
+ * @brief frees an entry of an section: removes it from the index and the dcache of its directory, clears it (and the
+ * longname entry of its name, if it has one), clears its bit in the map of used entries and resets the free-hints of
+ * the sections before it, so the entry can be found again
+ * 
+ * @param section the section the entry is in
+ * @param offset offset of the entry in the section
+ */
+void libtabfs_entrytable_free_entry(libtabfs_entrytable_t* section, int offset);
+
+/**
+ * @brief searches after an free entry inside an entrytable section; the caller needs to hold the lock of the
+ * directory exclusive (see libtabfs_entrytable_lock)
  * 
  * @param entrytable the entrytable section to start searching from
  * @param entry_out pointer which will be set to the found entry on success
- * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success)
+ * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_entrytable_release
  * @param offset_out optional pointer which will be set to the offset of the entry into its entrytable section (only on success)
  * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
  */
@@ -337,6 +435,29 @@ libtabfs_error libtabfs_entrytable_count_entries(libtabfs_entrytable_t* entrytab
  */
 libtabfs_error libtabfs_entry_get_name(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, char** name_out);
 
+/**
+ * @brief checks if an entry is in use and has an specific name; names with 22 chars or more are only stored in longname entries,
+ * which are only loaded if the entry has no fingerprint or its fingerprint matches the hash
+ * 
+ * @param volume the volume to operate on
+ * @param entry the entry to check
+ * @param name the name to compare with; dosnt need to be terminated
+ * @param namelen length of the name
+ * @param hash libtabfs_name_hash() of the name
+ * @return true if the entry has the name
+ */
+bool libtabfs_entry_has_name(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, const char* name, int namelen, unsigned int hash);
+
+/**
+ * @brief gets the hash of the name of an entry (see libtabfs_name_hash); uses the fingerprint of longnames if there is one
+ * 
+ * @param volume the volume to operate on
+ * @param entry the entry
+ * @param hash_out pointer to where the hash should be stored
+ * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
+ */
+libtabfs_error libtabfs_entry_name_hash(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, unsigned int* hash_out);
+
 //--------------------------------------------------------------------------------
 // Find entrys inside an entrytable
 //--------------------------------------------------------------------------------
@@ -347,7 +468,8 @@ libtabfs_error libtabfs_entry_get_name(libtabfs_volume_t* volume, libtabfs_entry
  * @param entrytable the entrytable section to start searching from
  * @param name the name of the entry; must be smaller than 63 (max size of an longname)
  * @param entry_out pointer which will be set to the found entry on success
- * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success)
+ * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_entrytable_release
  * @param offset_out optional pointer which will be set to the offset of the entry into its entrytable section (only on success)
  * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
  */
@@ -358,6 +480,25 @@ libtabfs_error libtabfs_entrytab_findentry(
     int* offset_out
 );
 
+/**
+ * @brief same as libtabfs_entrytab_findentry, but the name is delimited by its length instead of an terminator
+ * 
+ * @param entrytable the entrytable section to start searching from
+ * @param name the name of the entry; only read, never written to
+ * @param namelen length of the name; must be smaller than 63 (max size of an longname)
+ * @param entry_out pointer which will be set to the found entry on success
+ * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_entrytable_release
+ * @param offset_out optional pointer which will be set to the offset of the entry into its entrytable section (only on success)
+ * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
+ */
+libtabfs_error libtabfs_entrytab_findentry_n(
+    libtabfs_entrytable_t* entrytable, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
 /**
  * @brief searches after the target of an symlink
  * 
@@ -366,7 +507,8 @@ libtabfs_error libtabfs_entrytab_findentry(
  * @param userid the userid to perform the action as
  * @param groupid the groupid to perform the action as
  * @param entry_out pointer which will be set to the found entry on success
- * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success)
+ * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_entrytable_release
  * @param offset_out optional pointer which will be set to the offset of the entry into its entrytable section (only on success)
  * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
  */
@@ -387,7 +529,8 @@ libtabfs_error libtabfs_entrytab_getsymlinktarget(
  * @param userid the userid to perform the action as
  * @param groupid the groupid to perform the action as
  * @param entry_out pointer which will be set to the found entry on success
- * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success)
+ * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_entrytable_release
  * @param offset_out optional pointer which will be set to the offset of the entry into its entrytable section (only on success)
  * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
  */
@@ -399,6 +542,30 @@ libtabfs_error libtabfs_entrytab_traversetree(
     int* offset_out
 );
 
+/**
+ * @brief same as libtabfs_entrytab_traversetree, but the path is delimited by its length instead of an terminator;
+ * the path is never written to, so string literals or an part of an larger buffer can be passed directly
+ * 
+ * @param entrytable the entrytable section to start from
+ * @param relative_path path to traverse; see libtabfs_entrytab_traversetree
+ * @param pathlen length of the path; nothing behind it is read
+ * @param follow_symlink if set to true, this function will follow symlinks along the path; if set to false, it treats symlinks as files
+ * @param userid the userid to perform the action as
+ * @param groupid the groupid to perform the action as
+ * @param entry_out pointer which will be set to the found entry on success
+ * @param entrytable_out optional pointer which will be set to the entrytable section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_entrytable_release
+ * @param offset_out optional pointer which will be set to the offset of the entry into its entrytable section (only on success)
+ * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
+ */
+libtabfs_error libtabfs_entrytab_traversetree_n(
+    libtabfs_entrytable_t* entrytable, const char* relative_path, int pathlen, bool follow_symlink,
+    unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
 //--------------------------------------------------------------------------------
 // Entry creation
 //--------------------------------------------------------------------------------
@@ -406,7 +573,8 @@ libtabfs_error libtabfs_entrytab_traversetree(
 /**
  * @brief generic function to create entries in an entrytable section;
  * this is an internal function. you should never use it, and instead use the create functions that directly creates
- * the wanted entry!
+ * the wanted entry! The caller needs to hold the lock of the directory exclusive until the entry is filled in
+ * (see libtabfs_entrytable_lock)
  * 
  * @param entrytable the entrytable section to start searching for a free spot
  * @param name the name of the entry; if longer than 21, an longname entry is created an linked; must not be longer than 61!
@@ -426,7 +594,8 @@ libtabfs_error libtabfs_create_entry(
  * @param create_ts creation timestamp
  * @param userid owning user
  * @param groupid owning group
- * @param entrytable_newdir_out pointer that will be set to the first entrytable section of the created directory
+ * @param entrytable_newdir_out pointer that will be set to the first entrytable section of the created directory; the section
+ *      is pinned, see libtabfs_entrytable_release
  * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
  */
 libtabfs_error libtabfs_create_dir(
@@ -435,6 +604,17 @@ libtabfs_error libtabfs_create_dir(
     libtabfs_entrytable_t** entrytable_newdir_out
 );
 
+/**
+ * @brief same as libtabfs_create_dir, but the caller needs to hold the lock of the directory exclusive
+ * (see libtabfs_entrytable_lock); this is an internal function, used to set up other kinds of directories
+ * before anyone else can see them
+ */
+libtabfs_error libtabfs_create_dir_locked(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_t** entrytable_newdir_out
+);
+
 /**
  * @brief creates a new device file to an character device
  * 
@@ -554,7 +734,8 @@ libtabfs_error libtabfs_create_continuousfile(
 /**
  * @brief reads data from a file into a buffer; this function is always synced
  * 
- * Note: this function assumes that an permission check was done before
+ * Note: this function assumes that an permission check was done before; blocks of an FAT file that were never
+ * written are read as zeros and are not created
  * 
  * @param volume the volume to operate on
  * @param entry the entry to be read from; needs to be a file
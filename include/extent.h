@@ -0,0 +1,114 @@
+#ifndef __LIBTABFS_EXTENT_H__
+#define __LIBTABFS_EXTENT_H__
+
+#include "./common.h"
+
+/**
+ * @brief an run of free blocks; node of an extenttree
+ */
+struct libtabfs_extent {
+    struct libtabfs_extent* left;
+    struct libtabfs_extent* right;
+    long start;
+    long length;
+    long max_length;            // largest length inside the subtree of this node
+    unsigned int priority;
+};
+typedef struct libtabfs_extent libtabfs_extent_t;
+
+/**
+ * @brief index of free runs (extents); an treap ordered by the start of the runs, where every node also knows the largest
+ * run in its subtree. This allows finding the first run that can hold an given count in O(log n).
+ * Adjacent runs are always merged, so no two extents in a tree touch each other.
+ */
+struct libtabfs_extenttree {
+    libtabfs_extent_t* root;
+    unsigned int count;         // count of extents in the tree
+    unsigned int seed;          // state for the node priorities
+};
+typedef struct libtabfs_extenttree libtabfs_extenttree_t;
+
+/**
+ * @brief initializes an empty extenttree
+ *
+ * @param tree the tree to initialize
+ */
+void libtabfs_extenttree_init(libtabfs_extenttree_t* tree);
+
+/**
+ * @brief frees all extents inside an tree; the tree is empty afterwards
+ *
+ * @param tree the tree to clear
+ */
+void libtabfs_extenttree_destroy(libtabfs_extenttree_t* tree);
+
+/**
+ * @brief adds an range to the tree (marks it free); merges it with all extents it overlaps or touches
+ *
+ * @param tree the tree to operate on
+ * @param start start of the range
+ * @param length length of the range
+ */
+void libtabfs_extenttree_add(libtabfs_extenttree_t* tree, long start, long length);
+
+/**
+ * @brief removes an range from the tree (marks it allocated); extents overlapping the range are shortened or split
+ *
+ * @param tree the tree to operate on
+ * @param start start of the range
+ * @param length length of the range
+ * @return the amount of units that were in the tree and got removed
+ */
+long libtabfs_extenttree_remove(libtabfs_extenttree_t* tree, long start, long length);
+
+/**
+ * @brief searches the lowest position at or after from where count units are free
+ *
+ * @param tree the tree to search in
+ * @param from the lowest position that may be returned
+ * @param count the count of units that need to be free
+ * @return the found position or -1 if there is none
+ */
+long libtabfs_extenttree_first_fit(libtabfs_extenttree_t* tree, long from, long count);
+
+/**
+ * @brief searches the smallest free run that can hold count units at or after from; only the part of an run after from counts
+ *
+ * @param tree the tree to search in
+ * @param from the lowest position that may be returned
+ * @param count the count of units that need to be free
+ * @return the start of the found run (or from, if the run contains it) or -1 if there is none
+ */
+long libtabfs_extenttree_best_fit(libtabfs_extenttree_t* tree, long from, long count);
+
+/**
+ * @brief like libtabfs_extenttree_first_fit, but only returns positions where base + position is an multiple of align
+ *
+ * @param tree the tree to search in
+ * @param from the lowest position that may be returned
+ * @param count the count of units that need to be free
+ * @param align the alignment the returned position needs to have
+ * @param base added to positions before the alignment is checked; e.g. the first lba the tree describes
+ * @return the found position or -1 if there is none
+ */
+long libtabfs_extenttree_aligned_fit(libtabfs_extenttree_t* tree, long from, long count, long align, long base);
+
+/**
+ * @brief returns the first extent that ends after an given position; this is the extent containing the position
+ * or the next one after it
+ *
+ * @param tree the tree to search in
+ * @param pos the position to search from
+ * @return the found extent or NULL if there is none
+ */
+libtabfs_extent_t* libtabfs_extenttree_next(libtabfs_extenttree_t* tree, long pos);
+
+/**
+ * @brief returns the extent with the highest start
+ *
+ * @param tree the tree to search in
+ * @return the last extent or NULL if the tree is empty
+ */
+libtabfs_extent_t* libtabfs_extenttree_last(libtabfs_extenttree_t* tree);
+
+#endif // __LIBTABFS_EXTENT_H__
\ No newline at end of file
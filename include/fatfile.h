@@ -15,6 +15,9 @@ struct libtabfs_fat {
     libtabfs_volume_t* __volume;
     unsigned int __byteSize;
     libtabfs_lba_28_t __lba;
+    unsigned char* __used_map;                  // bit i set: entry i is in use; build by the first search for an free entry
+    libtabfs_lba_28_t __free_hint_lba;          // first section after this one that can have free entries; set when an
+    unsigned int __free_hint_size;              // search started here, reset when an entry is freed; 0 if not known
 
     // --------------------------------
     libtabfs_lba_28_t next_section;
@@ -50,6 +53,29 @@ libtabfs_fat_t* libtabfs_read_fat(libtabfs_volume_t* volume, libtabfs_lba_28_t l
  */
 libtabfs_fat_t* libtabfs_find_cached_fat(libtabfs_volume_t* volume, libtabfs_lba_28_t fat_lba);
 
+/**
+ * @brief pins an fat section, so its never evicted from the fatcache while the volume has an cache_budget;
+ * needed when an pointer to it is kept longer than until the end of the next libtabfs call. Every pin needs an unpin
+ * 
+ * @param fat the section to pin
+ */
+void libtabfs_fat_pin(libtabfs_fat_t* fat);
+
+/**
+ * @brief releases an pin of an fat section made with libtabfs_fat_pin
+ * 
+ * @param fat the section to unpin
+ */
+void libtabfs_fat_unpin(libtabfs_fat_t* fat);
+
+/**
+ * @brief releases an section an call handed out; calls that store an section into an fat_out pin it,
+ * so it stays loaded until its released
+ *
+ * @param fat the section to release; NULL is ignored
+ */
+void libtabfs_fat_release(libtabfs_fat_t* fat);
+
 /**
  * @brief retrieves an fat section by first quering the fatcache; if not found, its loaded from disk using libtabfs_read_fat
  * 
@@ -95,7 +121,8 @@ void libtabfs_fat_cachefree_callback(libtabfs_fat_t* fat);
  * 
  * @param fat the fat section to start searching from
  * @param entry_out pointer which will be set to the found entry on success
- * @param fat_out optional pointer which will be set to the fat section containing the free entry (only on success)
+ * @param fat_out optional pointer which will be set to the fat section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_fat_release
  * @param offset_out optional pointer which will be set to the offset of the entry into its fat section (only on success)
  * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
  */
@@ -106,13 +133,24 @@ libtabfs_error libtabfs_fat_findfree(
     int* offset_out
 );
 
+/**
+ * @brief frees an entry of an fat section: clears it, clears its bit in the map of used entries and resets the
+ * free-hints of the sections before it, so the entry can be found again
+ * 
+ * @param fat the first section of the fat
+ * @param section the fat section the entry is in
+ * @param offset offset of the entry in the section
+ */
+void libtabfs_fat_free_entry(libtabfs_fat_t* fat, libtabfs_fat_t* section, int offset);
+
 /**
  * @brief searches after the latest entry for an particular index inside an fat section
  * 
  * @param index the index to search
  * @param fat the fat section to start searching from
  * @param entry_out pointer which will be set to the found entry on success
- * @param fat_out optional pointer which will be set to the fat section containing the free entry (only on success)
+ * @param fat_out optional pointer which will be set to the fat section containing the free entry (only on success);
+ *      the section is pinned, see libtabfs_fat_release
  * @param offset_out optional pointer which will be set to the offset of the entry into its fat section (only on success)
  * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
  */
@@ -146,6 +184,25 @@ libtabfs_error libtabfs_create_fatfile(
     libtabfs_entrytable_entry_t** entry_out
 );
 
+/**
+ * @brief locks an fat file (see lock.h); shared for reads, which never change the fat, exclusive otherwise.
+ * No other function that locks an directory or file may be called while its held
+ * 
+ * @param volume the volume of the file
+ * @param entry the entry of the file; NULL locks nothing
+ * @param exclusive true to lock it for changes, false for reads
+ * @return the lock to pass to libtabfs_fatfile_unlock; NULL if nothing was locked
+ */
+void* libtabfs_fatfile_lock(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, bool exclusive);
+
+/**
+ * @brief unlocks an fat file locked by libtabfs_fatfile_lock
+ * 
+ * @param lock the lock returned by libtabfs_fatfile_lock
+ * @param exclusive the same as given to libtabfs_fatfile_lock
+ */
+void libtabfs_fatfile_unlock(void* lock, bool exclusive);
+
 /**
  * @brief internal function; please use libtabfs_read_file instead!
  */
@@ -166,4 +223,22 @@ libtabfs_error libtabfs_fatfile_write(
     unsigned long int* bytesWritten
 );
 
+/**
+ * @brief reserves the blocks of an FAT file that a write of len bytes at offset would touch; blocks that dont exist
+ * yet are taken as one chained run where possible (as close behind the previous block as possible) and all their
+ * fat entries are filled at once. Writes into the range afterwards dont need to allocate anything.
+ * The content of the reserved blocks is undefined until its written.
+ * 
+ * @param volume the volume to operate on
+ * @param entry the entry of the file; needs to be an FAT file
+ * @param offset the byte offset into the file where the range starts
+ * @param len the length of the range in bytes
+ * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
+ */
+libtabfs_error libtabfs_fatfile_preallocate(
+    libtabfs_volume_t* volume,
+    libtabfs_entrytable_entry_t* entry,
+    unsigned long int offset, unsigned long int len
+);
+
 #endif // __LIBTABFS_FATFILE_H__
\ No newline at end of file
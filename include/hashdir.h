@@ -0,0 +1,155 @@
+#ifndef __LIBTABFS_HASHDIR_H__
+#define __LIBTABFS_HASHDIR_H__
+
+#include "./common.h"
+#include "./volume.h"
+#include "./entrytable.h"
+
+/**
+ * Hashed directories
+ *
+ * An optional on-disk layout for directories with many entries. The first section of the directory is marked with
+ * LIBTABFS_DIRFORMAT_HASHED in its tableinfo and points to an bucket table: 2^bucket_bits slots of
+ * libtabfs_hashdir_bucket_t, each the first section of an bucket. An entry is always placed in an section of the bucket
+ * of its name hash (see libtabfs_name_hash); the sections of an bucket are chained by bucket_next_lba / _size.
+ * So once the bucket table is in memory, an lookup only reads the sections of one bucket instead of all sections.
+ *
+ * All sections are still linked with prev / next / parent like in an linear directory, so code that walks over all
+ * entries works the same for both formats. The bucket table is read as a whole the first time the directory is used
+ * and then kept in the volume's __bucket_tables, until its evicted like an section; changes to it are written to the
+ * device slot by slot.
+ *
+ * The count of buckets is fixed when the directory is created; pick bucket_bits so that 2^bucket_bits * 15 is about
+ * the count of expected entries, since the sections of an bucket are searched one after another.
+ * Implementations that dont know this format must not add entries to such directories, since they place them
+ * in the first free slot, where lookups wont find them.
+ */
+
+#define LIBTABFS_HASHDIR_MAX_BUCKET_BITS    16
+
+/**
+ * @brief an slot of the bucket table; lba and size of the first section of the bucket, 0 if the bucket is empty
+ */
+struct libtabfs_hashdir_bucket {
+    libtabfs_lba_28_t lba;
+    unsigned int size;
+} LIBTABFS_PACKED;
+typedef struct libtabfs_hashdir_bucket libtabfs_hashdir_bucket_t;
+
+/**
+ * @brief in-memory copy of the bucket table of an directory; keyed by the lba of its first section inside the volume's
+ * __bucket_tables
+ */
+struct libtabfs_hashdir_table {
+    libtabfs_lba_28_t lba;
+    unsigned int count;                 // count of buckets
+    libtabfs_hashdir_bucket_t* buckets;
+};
+typedef struct libtabfs_hashdir_table libtabfs_hashdir_table_t;
+
+/**
+ * @brief creates an directory with the hashed layout
+ * 
+ * @param bucket_bits log2 of the count of buckets; at most LIBTABFS_HASHDIR_MAX_BUCKET_BITS
+ * @param entrytable_newdir_out pointer to where the first section of the new directory should be stored; the section is
+ *      pinned, see libtabfs_entrytable_release
+ * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
+ */
+libtabfs_error libtabfs_create_hashed_dir(
+    LIBTABFS_GENERIC_ENTRY_ARGS, unsigned int bucket_bits,
+    libtabfs_entrytable_t** entrytable_newdir_out
+);
+
+/**
+ * @brief checks if an directory uses the hashed layout
+ * 
+ * @param first_section the first section of the directory
+ * @return true if its an hashed directory
+ */
+bool libtabfs_hashdir_is_hashed(libtabfs_entrytable_t* first_section);
+
+/**
+ * @brief searches an entry by its name in an hashed directory; only the sections of the bucket of the name are read;
+ * the caller needs to hold the lock of the directory (see libtabfs_entrytable_lock)
+ * 
+ * @param first_section the first section of the directory
+ * @param name the name to search; dosnt need to be terminated
+ * @param namelen length of the name
+ * @param entry_out pointer to where the found entry should be stored; NULL if there is none with the name
+ * @param entrytable_out optional pointer to where the section of the found entry should be stored; the section is pinned,
+ *      see libtabfs_entrytable_release
+ * @param offset_out optional pointer to where the offset of the found entry inside its section should be stored
+ * @return LIBTABFS_ERR_NONE if the operation was successfull (even if nothing was found); other errorcode otherwise
+ */
+libtabfs_error libtabfs_hashdir_lookup(
+    libtabfs_entrytable_t* first_section, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
+/**
+ * @brief searches an free entry in the bucket of an name; adds an new section to the bucket if all of its sections are full;
+ * the caller needs to hold the lock of the directory exclusive (see libtabfs_entrytable_lock)
+ * 
+ * @param first_section the first section of the directory
+ * @param name the name the entry is for
+ * @param entry_out pointer to where the free entry should be stored
+ * @param entrytable_out optional pointer to where the section of the free entry should be stored; the section is pinned,
+ *      see libtabfs_entrytable_release
+ * @param offset_out optional pointer to where the offset of the free entry inside its section should be stored
+ * @return LIBTABFS_ERR_NONE if the operation was successfull; other errorcode otherwise
+ */
+libtabfs_error libtabfs_hashdir_findfree(
+    libtabfs_entrytable_t* first_section, char* name,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
+/**
+ * @brief internal function; same as libtabfs_hashdir_lookup, but the section isnt pinned. Only for code that runs
+ * inside an libtabfs call already and is done with the entry before it ends
+ */
+libtabfs_error libtabfs_hashdir_lookup_impl(
+    libtabfs_entrytable_t* first_section, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
+/**
+ * @brief internal function; same as libtabfs_hashdir_findfree, but the section isnt pinned. Only for code that runs
+ * inside an libtabfs call already and is done with the entry before it ends
+ */
+libtabfs_error libtabfs_hashdir_findfree_impl(
+    libtabfs_entrytable_t* first_section, char* name,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
+/**
+ * @brief throws away the in-memory bucket table of an directory, if there is one
+ *
+ * @param volume the volume of the directory
+ * @param lba the lba of the first section of the directory
+ */
+void libtabfs_hashdir_drop(libtabfs_volume_t* volume, libtabfs_lba_28_t lba);
+
+/**
+ * @brief frees the bucket table of an hashed directory on the device and throws away its in-memory copy; called when
+ * the first section of the directory is removed. Does nothing for other sections
+ *
+ * @param first_section the section that gets removed
+ */
+void libtabfs_hashdir_remove(libtabfs_entrytable_t* first_section);
+
+/**
+ * @brief internal function; called when an bucket table inside __bucket_tables needs to be free'd
+ *
+ * @param table the bucket table to free
+ */
+void libtabfs_hashdir_table_destroy(libtabfs_hashdir_table_t* table);
+
+#endif // __LIBTABFS_HASHDIR_H__
\ No newline at end of file
@@ -3,10 +3,18 @@
 
 #include "./common.h"
 #include "./linkedlist.h"
+#include "./cache.h"
+#include "./lock.h"
+#include "./bitmap.h"
+#include "./extent.h"
 #include "./volume.h"
 #include "./bat.h"
 #include "./entrytable.h"
+#include "./dirindex.h"
+#include "./hashdir.h"
+#include "./dcache.h"
 #include "./fatfile.h"
+#include "./defrag.h"
 
 #define LIBTABFS_VERSION "v0.3"
 #define LIBTABFS_VERSION_MAJOR 0
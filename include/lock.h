@@ -0,0 +1,67 @@
+#ifndef __LIBTABFS_LOCK_H__
+#define __LIBTABFS_LOCK_H__
+
+#include "./common.h"
+
+/**
+ * Locking used by the parts of libtabfs that can be called from multiple threads at once.
+ *
+ * When the library is compiled with LIBTABFS_THREADSAFE defined, the lock functions of bridge.h are used;
+ * otherwise all of these macros do nothing, so single-threaded users dont need to implement them.
+ *
+ * What is protected by what:
+ *  - every allocation group of the BAT has its own mutex (see bat.h)
+ *  - every cache (tablecache, fatcache, directory indexes) and the dentry cache has an reader-writer lock; lookups
+ *    take it shared, adding and removing sections exclusive. Its only held inside the cache functions
+ *  - directories and files are locked by the striped reader-writer locks of the volume
+ *    (libtabfs_volume_object_lock): lookups and reads take the lock of the directory or file shared, creating entries
+ *    and writing files exclusive. An call holds at most one of them at an time, and never while it calls into an other
+ *    locking function, so they cant deadlock; only the defragmenter locks an continuous file while it holds the lock
+ *    of its directory, which is fine since nothing locks them the other way round
+ *
+ * Since sections of other threads' calls cant be told apart, the cache budget is ignored and nothing is evicted; so
+ * pointers to entries and sections stay valid for the lifetime of the volume, their content can change once the
+ * lock of their directory is released though. libtabfs_volume_sync and libtabfs_destroy_volume need all other calls
+ * on the volume to be finished.
+ */
+
+#ifdef LIBTABFS_THREADSAFE
+    #include "./bridge.h"
+
+    #define LIBTABFS_LOCK_CREATE()          libtabfs_lock_create()
+    #define LIBTABFS_LOCK_DESTROY(lock)     libtabfs_lock_destroy(lock)
+    #define LIBTABFS_LOCK(lock)             libtabfs_lock_acquire(lock)
+    #define LIBTABFS_TRYLOCK(lock)          libtabfs_lock_try_acquire(lock)
+    #define LIBTABFS_UNLOCK(lock)           libtabfs_lock_release(lock)
+
+    #define LIBTABFS_RWLOCK_CREATE()            libtabfs_rwlock_create()
+    #define LIBTABFS_RWLOCK_DESTROY(lock)       libtabfs_rwlock_destroy(lock)
+    #define LIBTABFS_LOCK_SHARED(lock)          libtabfs_rwlock_acquire_shared(lock)
+    #define LIBTABFS_UNLOCK_SHARED(lock)        libtabfs_rwlock_release_shared(lock)
+    #define LIBTABFS_LOCK_EXCLUSIVE(lock)       libtabfs_rwlock_acquire_exclusive(lock)
+    #define LIBTABFS_UNLOCK_EXCLUSIVE(lock)     libtabfs_rwlock_release_exclusive(lock)
+
+    // for values that are read without holding the lock that protects their writes
+    #define LIBTABFS_ATOMIC_LOAD(var)       __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+    #define LIBTABFS_ATOMIC_STORE(var, val) __atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+    #define LIBTABFS_ATOMIC_ADD(var, val)   __atomic_add_fetch(&(var), (val), __ATOMIC_RELAXED)
+#else
+    #define LIBTABFS_LOCK_CREATE()          NULL
+    #define LIBTABFS_LOCK_DESTROY(lock)     ((void) (lock))
+    #define LIBTABFS_LOCK(lock)             ((void) (lock))
+    #define LIBTABFS_TRYLOCK(lock)          ((void) (lock), true)
+    #define LIBTABFS_UNLOCK(lock)           ((void) (lock))
+
+    #define LIBTABFS_RWLOCK_CREATE()            NULL
+    #define LIBTABFS_RWLOCK_DESTROY(lock)       ((void) (lock))
+    #define LIBTABFS_LOCK_SHARED(lock)          ((void) (lock))
+    #define LIBTABFS_UNLOCK_SHARED(lock)        ((void) (lock))
+    #define LIBTABFS_LOCK_EXCLUSIVE(lock)       ((void) (lock))
+    #define LIBTABFS_UNLOCK_EXCLUSIVE(lock)     ((void) (lock))
+
+    #define LIBTABFS_ATOMIC_LOAD(var)       (var)
+    #define LIBTABFS_ATOMIC_STORE(var, val) ((var) = (val))
+    #define LIBTABFS_ATOMIC_ADD(var, val)   ((var) += (val))
+#endif
+
+#endif // __LIBTABFS_LOCK_H__
\ No newline at end of file
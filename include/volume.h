@@ -3,6 +3,8 @@
 
 #include "./common.h"
 #include "./linkedlist.h"
+#include "./cache.h"
+#include "./extent.h"
 
 typedef struct {
     bool absolute_lbas : 1;
@@ -26,6 +28,9 @@ typedef struct libtabfs_header libtabfs_header_t;
 
 #define LIBTABFS_IS_BOOTABLE(header)   (header.bootSignature[0] == 0x55 && header.bootSignature[1] == 0xAA)
 
+// count of reader-writer locks directories and fat files are spread over (LIBTABFS_THREADSAFE only); an power of two
+#define LIBTABFS_VOLUME_OBJECT_LOCKS    64
+
 /**
  * @brief Volume descriptor
  */
@@ -50,12 +55,63 @@ struct libtabfs_volume {
     void* __dev_data;
     libtabfs_lba_28_t __lba;
     struct libtabfs_bat* __bat_root;
+    struct libtabfs_bat_region* __bat_regions;
+    unsigned int __bat_region_count;
+    struct libtabfs_alloc_group* __alloc_groups;
+    unsigned int __alloc_group_count;
+    unsigned int __bat_index_capacity;  // entries allocated for both the region and group index; they are only appended to
+    void* __bat_grow_lock;              // serializes libtabfs_bat_grow (LIBTABFS_THREADSAFE only)
+    libtabfs_lba_28_t __alloc_cursor;   // lba after the last allocated run; start of next-fit searches
+    const struct libtabfs_alloc_policy* __alloc_policy;
+    bool __bat_lazy;                    // BAT sections are loaded page by page on demand
+    unsigned int __bat_page_budget;     // max count of BAT pages in memory before some get evicted; 0 = no limit
+    unsigned int __bat_pages_loaded;
+    struct libtabfs_bat* __bat_clock_bat;   // position of the page eviction
+    long __bat_clock_page;
+    libtabfs_extenttree_t* __discard_pending;   // freed lba ranges not yet discarded (LIBTABFS_DISCARD only)
+    libtabfs_extenttree_t* __discard_inflight;  // ranges libtabfs_bat_discard_flush is sending right now
+    void* __discard_lock;                       // protects both discard trees (LIBTABFS_THREADSAFE only)
+    long __discard_pending_blocks;
     struct libtabfs_entrytable* __root_table;
-    libtabfs_linkedlist_t* __table_cache;
-    libtabfs_linkedlist_t* __fat_cache;
+    libtabfs_cache_t* __table_cache;
+    libtabfs_cache_t* __fat_cache;
+    libtabfs_cache_budget_t* __cache_budget;    // shared by all four caches; limit 0 if they are unbounded
+    libtabfs_cache_t* __dir_indexes;            // name indexes of directories searched lately, by lba of their first section
+    libtabfs_cache_t* __bucket_tables;          // bucket tables of hashed directories used lately, by the same key
+    struct libtabfs_dcache* __dcache;           // path components resolved by traversetree; NULL if disabled (see dcache.h)
+    void** __object_locks;                      // LIBTABFS_VOLUME_OBJECT_LOCKS rwlocks (LIBTABFS_THREADSAFE only; see lock.h)
 } LIBTABFS_PACKED;
 typedef struct libtabfs_volume libtabfs_volume_t;
 
+/**
+ * @brief options for mounting an volume with libtabfs_new_volume_ex
+ */
+struct libtabfs_volume_options {
+    bool lazy_bat;                  // only read the headers of the BAT sections at mount; their blocks are read on first access.
+                                    // ignored with LIBTABFS_THREADSAFE, since pages of other allocation groups cant be evicted
+    unsigned int bat_page_budget;   // with lazy_bat, max count of BAT blocks kept in memory; dirty ones are written back
+                                    // before they get evicted. 0 = no limit
+    const struct libtabfs_alloc_policy* alloc_policy;   // where chained blocks are placed; NULL for first-fit (see bat.h)
+    unsigned long cache_budget;     // max bytes of entrytable and FAT sections, directory indexes and bucket tables kept in
+                                    // memory; the least recently used ones get written back and evicted. 0 = no limit (see cache.h for which ones are kept).
+                                    // ignored with LIBTABFS_THREADSAFE, since sections used by other threads cant be evicted
+    unsigned int dentry_cache_slots;    // count of path components libtabfs_entrytab_traversetree remembers, found or not;
+                                        // rounded up to an power of two. 0 = no dentry cache (see dcache.h)
+};
+typedef struct libtabfs_volume_options libtabfs_volume_options_t;
+
+/**
+ * @brief usage statistics of an volume; filled by libtabfs_volume_statfs
+ */
+struct libtabfs_volume_statfs {
+    unsigned int block_size;                // size of one block in bytes
+    unsigned long long total_blocks;        // count of blocks managed by the BAT (up to max_LBA)
+    unsigned long long free_blocks;
+    unsigned long long used_blocks;
+    unsigned long long largest_free_extent; // longest run of continuous free blocks; an upper bound for allocateChainedBlocks
+};
+typedef struct libtabfs_volume_statfs libtabfs_volume_statfs_t;
+
 /**
  * @brief creates an new volume from an specific device and an specific lba address;
  * The address given must contain an tabfs header
@@ -70,6 +126,20 @@ typedef struct libtabfs_volume libtabfs_volume_t;
  */
 libtabfs_error libtabfs_new_volume(void* dev_data, long long lba_address, bool absolute_lba, libtabfs_volume_t** volume_out);
 
+/**
+ * @brief like libtabfs_new_volume, but with options for how the volume is handled in memory
+ * 
+ * @param lba_address the address to load from
+ * @param absolute_lba if this is true, lba_address is an absolute address; used by the read-command
+ * @param options options for the volume; NULL for the defaults (same as libtabfs_new_volume)
+ * @param volume_out an new volume instance
+ * @return errorcode of the operation; see libtabfs_new_volume
+ */
+libtabfs_error libtabfs_new_volume_ex(
+    void* dev_data, long long lba_address, bool absolute_lba,
+    const libtabfs_volume_options_t* options, libtabfs_volume_t** volume_out
+);
+
 /**
  * @brief syncs an complete volume to the disk
  * 
@@ -98,6 +168,37 @@ libtabfs_error libtabfs_volume_set_label(libtabfs_volume_t* volume, char* label,
  */
 const char* libtabfs_volume_get_label(libtabfs_volume_t* volume);
 
+/**
+ * @brief sets the allocation policy of an volume; only allocations made after this call are affected
+ * 
+ * @param volume the volume to set the policy for
+ * @param policy the new policy, e.g. &libtabfs_alloc_best_fit; NULL for first-fit
+ */
+void libtabfs_volume_set_alloc_policy(libtabfs_volume_t* volume, const struct libtabfs_alloc_policy* policy);
+
+/**
+ * @brief returns the usage statistics of an volume. The free count is maintained by every allocation and free,
+ * so this dosnt scan the BAT; only with lazy_bat, sections that where never touched get indexed on the first call.
+ * 
+ * @param volume the volume to get the statistics for
+ * @param stat_out the statistics are written to this
+ * @return errorcode of the operation;
+ *      LIBTABFS_ERR_ARGS: if stat_out is NULL
+ *      LIBTABFS_ERR_NONE: if all went right
+ */
+libtabfs_error libtabfs_volume_statfs(libtabfs_volume_t* volume, libtabfs_volume_statfs_t* stat_out);
+
+/**
+ * @brief gets the reader-writer lock of an directory or fat file (see lock.h); objects share their lock with every
+ * other object whose lba falls onto the same one
+ * 
+ * @param volume the volume of the object
+ * @param lba the lba of the first entrytable section of the directory, or of the first fat section of the file
+ *      (continuous files use their entry instead, see libtabfs_continuousfile_lock)
+ * @return the lock; NULL without LIBTABFS_THREADSAFE
+ */
+void* libtabfs_volume_object_lock(libtabfs_volume_t* volume, libtabfs_lba_28_t lba);
+
 /**
  * @brief destroys an volume; syncs it to disk before full destory
  * 
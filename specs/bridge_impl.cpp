@@ -32,7 +32,7 @@ extern "C" {
     }
 
     uint8_t* example_disk;
-    const int example_disk_lbacount = 16;
+    const int example_disk_lbacount = 0x3000;
 
     void my_device_read(dev_t __linux_dev_t, long long lba_address, bool is_absolute_lba, int offset, void* buffer, int bufferSize) {
         printf(
@@ -90,6 +90,20 @@ extern "C" {
         *time = now;
     }
 
+#ifdef LIBTABFS_DISCARD
+    discarded_range_t discarded_ranges[LIBTABFS_SPECS_MAX_DISCARDS];
+    int discarded_count = 0;
+
+    void libtabfs_discard_device(void* dev_data, unsigned int lba, bool is_absolute_lba, unsigned int count) {
+        printf("discard_device(dev=0x%x, lba=0x%x, is_abs_lba=%s, count=%u)\n", *((dev_t*)dev_data), lba, (is_absolute_lba ? "yes" : "no "), count);
+        if (discarded_count < LIBTABFS_SPECS_MAX_DISCARDS) {
+            discarded_ranges[discarded_count].lba = lba;
+            discarded_ranges[discarded_count].count = count;
+        }
+        discarded_count++;
+    }
+#endif
+
 }
 
 void init_example_disk() {
@@ -152,4 +166,89 @@ void init_example_disk() {
     {
         write_i8(0x3, 0, 0xE0);
     }
+}
+
+void init_grow_disk() {
+    // an second image; replaces the example disk until the caller puts it back
+    example_disk = (uint8_t*) calloc( 512 * example_disk_lbacount, sizeof(uint8_t) );
+
+    /**
+     * layout:
+     * 
+     * 0x0 - preload / bootsector with tabfs header
+     * 0x1 - tabfs volume info; max LBA is 0x17FF, but the bat only covers 0x0 - 0xFCF
+     * 0x2 - the only section of the bat with one block (0x2)
+     * 0x3 - root table
+     * 0x4 - free!
+     */
+
+    memcpy(example_disk + 0x1C0, "TABFS-28", 9);
+    write_i16(example_disk + 0x1F0, 0b0000000000000001);
+    write_i64(example_disk + 0x1F6, 0x1);
+    write_i16(example_disk + 0x1FE, 0xAA55);
+
+    memcpy(example_disk + 512, "TABFS-28", 9);
+    write_i32(0x1, 0x10, 0x2);                  // bat LBA
+    write_i32(0x1, 0x14, 0x0);                  // min LBA
+    write_i32(0x1, 0x18, 0x0);                  // bat-start LBA
+    write_i32(0x1, 0x1C, 0x17FF);               // max LBA
+    write_i32(0x1, 0x20, 512);                  // blockSize
+    write_i8(0x1, 0x24, 1);                     // BS
+    write_i16(0x1, 0x26, 0b0000000000000001);   // flags
+    write_i32(0x1, 0x28, 0x3);                  // root LBA
+    write_i32(0x1, 0x2C, 512);                  // root size
+
+    write_i32(0x2, 0, 0);
+    write_i16(0x2, 4, 1);
+    write_i8(0x2, 6, 0b11110000);
+
+    write_i8(0x3, 0, 0xE0);
+}
+
+void init_lazy_disk() {
+    // an third image for mounting with lazy_bat; replaces the example disk until the caller puts it back
+    example_disk = (uint8_t*) calloc( 512 * example_disk_lbacount, sizeof(uint8_t) );
+
+    /**
+     * layout:
+     * 
+     * 0x0 - preload / bootsector with tabfs header
+     * 0x1 - tabfs volume info; max LBA is 0x2FFF
+     * 0x2 - section 1 of bat with one block (0x2); covers 0x0 - 0xFCF
+     * 0x3 - root table
+     * 0x4 - section 2 of bat with one block (0x4); covers 0xFD0 - 0x1F9F
+     * 0x5 - section 3 of bat with two blocks (0x5, 0x6); covers 0x1FA0 - 0x2FFF
+     * 0x6 - ///
+     * 0x7 - free!
+     */
+
+    memcpy(example_disk + 0x1C0, "TABFS-28", 9);
+    write_i16(example_disk + 0x1F0, 0b0000000000000001);
+    write_i64(example_disk + 0x1F6, 0x1);
+    write_i16(example_disk + 0x1FE, 0xAA55);
+
+    memcpy(example_disk + 512, "TABFS-28", 9);
+    write_i32(0x1, 0x10, 0x2);                  // bat LBA
+    write_i32(0x1, 0x14, 0x0);                  // min LBA
+    write_i32(0x1, 0x18, 0x0);                  // bat-start LBA
+    write_i32(0x1, 0x1C, 0x2FFF);               // max LBA
+    write_i32(0x1, 0x20, 512);                  // blockSize
+    write_i8(0x1, 0x24, 1);                     // BS
+    write_i16(0x1, 0x26, 0b0000000000000001);   // flags
+    write_i32(0x1, 0x28, 0x3);                  // root LBA
+    write_i32(0x1, 0x2C, 512);                  // root size
+
+    write_i32(0x2, 0, 0x4);
+    write_i16(0x2, 4, 1);
+    write_i8(0x2, 6, 0b11111110);
+
+    write_i32(0x4, 0, 0x5);
+    write_i16(0x4, 4, 1);
+
+    write_i32(0x5, 0, 0);
+    write_i16(0x5, 4, 2);
+    // the blocks behind max LBA (0x3000 - 0x3F6F) are taken
+    write_clear(0x5, 6 + ((0x3000 - 0x1FA0) / 8), 0xFF, 1024 - 6 - ((0x3000 - 0x1FA0) / 8));
+
+    write_i8(0x3, 0, 0xE0);
 }
\ No newline at end of file
@@ -19,6 +19,17 @@ extern "C" {
     void libtabfs_write_device(void* dev_data, long long lba_address, bool is_absolute_lba, int offset, void* buffer, int bufferSize);
     void libtabfs_set_range_device(void* dev_data, long long lba_address, bool is_absolute_lba, int offset, unsigned char b, int size);
     void libtabfs_get_current_time(long long* time);
+
+#ifdef LIBTABFS_DISCARD
+    // the first ranges libtabfs_discard_device was called with, in order; reset discarded_count to forget them
+    #define LIBTABFS_SPECS_MAX_DISCARDS 256
+    typedef struct { unsigned int lba; unsigned int count; } discarded_range_t;
+    extern discarded_range_t discarded_ranges[LIBTABFS_SPECS_MAX_DISCARDS];
+    extern int discarded_count;
+    void libtabfs_discard_device(void* dev_data, unsigned int lba, bool is_absolute_lba, unsigned int count);
+#endif
 }
 
-void init_example_disk();
\ No newline at end of file
+void init_example_disk();
+void init_grow_disk();
+void init_lazy_disk();
\ No newline at end of file
@@ -83,6 +83,82 @@ describe(libtabfs, $ {
         });
     });
 
+    explain("libtabfs_cache", $ {
+        it("should find sections by their lba after growing", _ {
+            libtabfs_cache_t* cache = libtabfs_cache_create(my_linkedlist_free, NULL);
+            cleanup([cache] () {
+                libtabfs_cache_destroy(cache);
+            });
+
+            for (uintptr_t lba = 2; lba < 2000; lba += 2) {
+                libtabfs_cache_add(cache, lba, (void*) (lba * 16), 0);
+            }
+            expect(cache->count).to_eq(999u);
+            expect(cache->count * 2 <= cache->capacity).to_eq(true);
+            for (uintptr_t lba = 2; lba < 2000; lba += 2) {
+                expect(libtabfs_cache_find(cache, lba)).to_eq((void*) (lba * 16));
+            }
+            expect(libtabfs_cache_find(cache, 3)).to_eq(nullptr);
+        });
+        it("should still find all other sections after removing some", _ {
+            libtabfs_cache_t* cache = libtabfs_cache_create(my_linkedlist_free, NULL);
+            cleanup([cache] () {
+                libtabfs_cache_destroy(cache);
+            });
+
+            for (uintptr_t lba = 1; lba <= 500; lba++) {
+                libtabfs_cache_add(cache, lba, (void*) lba, 0);
+            }
+            for (uintptr_t lba = 1; lba <= 500; lba += 3) {
+                libtabfs_cache_remove(cache, lba);
+            }
+            for (uintptr_t lba = 1; lba <= 500; lba++) {
+                void* expected = ((lba - 1) % 3) == 0 ? nullptr : (void*) lba;
+                expect(libtabfs_cache_find(cache, lba)).to_eq(expected);
+            }
+        });
+        it("should evict the least recently used sections over its budget", _ {
+            static libtabfs_cache_budget_t budget;
+            libtabfs_cache_budget_init(&budget, 300);
+            libtabfs_cache_t* cache = libtabfs_cache_create(my_linkedlist_free, &budget);
+            cleanup([cache] () {
+                libtabfs_cache_destroy(cache);
+            });
+
+            libtabfs_cache_add(cache, 1, (void*) 0x1, 100);
+            libtabfs_cache_add(cache, 2, (void*) 0x2, 100);
+            libtabfs_cache_add(cache, 3, (void*) 0x3, 100);
+            libtabfs_cache_pin(cache, 1);
+            expect(budget.bytes).to_eq(300ul);
+
+            // an call ends; nothing it used is needed anymore
+            libtabfs_cache_enter(&budget);
+            libtabfs_cache_leave(&budget);
+
+            // 1 is pinned, so 2 is the oldest one
+            libtabfs_cache_add(cache, 4, (void*) 0x4, 100);
+            expect(budget.bytes).to_eq(300ul);
+            expect(libtabfs_cache_find(cache, 1)).to_eq((void*) 0x1);
+            expect(libtabfs_cache_find(cache, 2)).to_eq(nullptr);
+            expect(libtabfs_cache_find(cache, 3)).to_eq((void*) 0x3);
+            expect(libtabfs_cache_find(cache, 4)).to_eq((void*) 0x4);
+
+            // everything was used since the last call ended, so the budget is exceeded for now
+            libtabfs_cache_add(cache, 5, (void*) 0x5, 100);
+            expect(budget.bytes).to_eq(400ul);
+
+            // and trimmed once the next call ends
+            libtabfs_cache_enter(&budget);
+            libtabfs_cache_find(cache, 5);
+            libtabfs_cache_leave(&budget);
+            expect(budget.bytes).to_eq(300ul);
+            expect(libtabfs_cache_find(cache, 1)).to_eq((void*) 0x1);
+            expect(libtabfs_cache_find(cache, 3)).to_eq(nullptr);
+            expect(libtabfs_cache_find(cache, 4)).to_eq((void*) 0x4);
+            expect(libtabfs_cache_find(cache, 5)).to_eq((void*) 0x5);
+        });
+    });
+
     explain("libtabfs_new_volume", $ {
         it("should have a magic", _ {
             expect((char*)gVolume->magic).to_eq((char*)"TABFS-28");
@@ -158,9 +234,187 @@ describe(libtabfs, $ {
         it("should work accross bat regions", _ {
             expect(libtabfs_bat_isFree(gVolume, 0xfd0 + 0x2)).to_eq(true);
         });
-        // it("should create new bat regions if the current regions cannot hold the requested lba", _ {
-        //     expect(libtabfs_bat_isFree(gVolume, 0xfd0 + 0x1fd0)).to_eq(true);
-        // });
+    });
+
+    explain("libtabfs_bat_grow", $ {
+        it("should append an new section when allocating past the covered range", _ {
+            uint8_t* disk = example_disk;
+            init_grow_disk();
+            libtabfs_volume_t* volume = NULL;
+            expect(libtabfs_new_volume(gVolume->__dev_data, 0, true, &volume)).to_eq(LIBTABFS_ERR_NONE);
+            cleanup([volume, disk] () {
+                libtabfs_destroy_volume(volume);
+                free(example_disk);
+                example_disk = disk;
+            });
+
+            // the only section covers 0x0 - 0xFCF and has 0xFCC free blocks
+            expect(volume->__bat_root->__next_bat).to_eq(nullptr);
+            expect(libtabfs_bat_allocateChainedBlocks(volume, 0xFC0)).to_eq(0x4);
+
+            // blocks that no section covers yet were never allocated
+            expect(libtabfs_bat_isFree(volume, 0x17FF)).to_eq(true);
+
+            // only 0xC blocks are left in it
+            libtabfs_lba_28_t run = libtabfs_bat_allocateChainedBlocks(volume, 0x100);
+            libtabfs_bat_t* grown = volume->__bat_root->__next_bat;
+            expect(grown).to_neq(nullptr);
+            expect(grown->__lba).to_eq(0xFD0);
+            expect(volume->__bat_root->next_bat).to_eq(0xFD0);
+            expect(run).to_eq(0xFD1);
+
+            // the section is linked on disk too
+            uint32_t next_bat;
+            memcpy(&next_bat, example_disk + (512 * 0x2), 4);
+            expect(next_bat).to_eq(0xFD0u);
+
+            // its own block is used; the rest up to max_LBA is free, everything behind it isnt
+            expect(libtabfs_bat_isFree(volume, 0xFD0)).to_eq(false);
+            expect(libtabfs_bat_isFree(volume, 0xFD1 + 0xFF)).to_eq(false);
+            expect(libtabfs_bat_isFree(volume, 0xFD1 + 0x100)).to_eq(true);
+            expect(libtabfs_bat_isFree(volume, 0x17FF)).to_eq(true);
+            expect(libtabfs_bat_isFree(volume, 0x1800)).to_eq(false);
+            expect(libtabfs_bat_isFree(volume, libtabfs_bat_getstart(grown) + libtabfs_bat_getcount(grown) - 1)).to_eq(false);
+
+            // the free blocks of the old section are still found
+            expect(libtabfs_bat_allocateChainedBlocksAt(volume, 0xC, 0x4)).to_eq(0xFC4);
+        });
+    });
+
+#ifdef LIBTABFS_DISCARD
+    explain("libtabfs_bat_discard_flush", $ {
+        it("should discard freed ranges once, merged and without the ones allocated again", _ {
+            uint8_t* disk = example_disk;
+            init_grow_disk();
+            libtabfs_volume_t* volume = NULL;
+            expect(libtabfs_new_volume(gVolume->__dev_data, 0, true, &volume)).to_eq(LIBTABFS_ERR_NONE);
+            cleanup([volume, disk] () {
+                libtabfs_destroy_volume(volume);
+                free(example_disk);
+                example_disk = disk;
+            });
+            discarded_count = 0;
+
+            // three adjacent runs, freed out of order, are sent as one range
+            expect(libtabfs_bat_allocateChainedBlocks(volume, 4)).to_eq(0x4);
+            expect(libtabfs_bat_allocateChainedBlocks(volume, 4)).to_eq(0x8);
+            expect(libtabfs_bat_allocateChainedBlocks(volume, 4)).to_eq(0xC);
+            libtabfs_bat_freeChainedBlocks(volume, 4, 0x4);
+            libtabfs_bat_freeChainedBlocks(volume, 4, 0xC);
+            libtabfs_bat_freeChainedBlocks(volume, 4, 0x8);
+            expect(discarded_count).to_eq(0);
+            libtabfs_bat_discard_flush(volume);
+            expect(discarded_count).to_eq(1);
+            expect(discarded_ranges[0].lba).to_eq(0x4u);
+            expect(discarded_ranges[0].count).to_eq(12u);
+
+            // nothing is left pending
+            libtabfs_bat_discard_flush(volume);
+            expect(discarded_count).to_eq(1);
+
+            // blocks allocated again before the flush are not discarded
+            discarded_count = 0;
+            expect(libtabfs_bat_allocateChainedBlocks(volume, 8)).to_eq(0x4);
+            libtabfs_bat_freeChainedBlocks(volume, 8, 0x4);
+            expect(libtabfs_bat_allocateChainedBlocks(volume, 3)).to_eq(0x4);
+            libtabfs_bat_discard_flush(volume);
+            expect(discarded_count).to_eq(1);
+            expect(discarded_ranges[0].lba).to_eq(0x7u);
+            expect(discarded_ranges[0].count).to_eq(5u);
+            libtabfs_bat_freeChainedBlocks(volume, 3, 0x4);
+            libtabfs_bat_discard_flush(volume);
+
+            // single blocks with an used one between them stay separate ranges; the 64th one flushes by itself
+            discarded_count = 0;
+            expect(libtabfs_bat_allocateChainedBlocks(volume, 128)).to_eq(0x4);
+            for (int i = 0; i < 63; i++) {
+                libtabfs_bat_freeChainedBlocks(volume, 1, 0x4 + (i * 2));
+            }
+            expect(discarded_count).to_eq(0);
+            libtabfs_bat_freeChainedBlocks(volume, 1, 0x4 + (63 * 2));
+            expect(discarded_count).to_eq(64);
+            for (int i = 0; i < 64; i++) {
+                expect(discarded_ranges[i].lba).to_eq(0x4u + (i * 2));
+                expect(discarded_ranges[i].count).to_eq(1u);
+            }
+
+            // and the BAT on disk was synced before, so every discarded block is free there
+            for (int i = 0; i < 64; i++) {
+                unsigned int lba = discarded_ranges[i].lba;
+                expect(example_disk[(512 * 0x2) + 6 + (lba / 8)] & (0x80 >> (lba % 8))).to_eq(0);
+            }
+        });
+    });
+#endif
+
+    explain("lazy_bat", $ {
+        it("should keep the BAT consistent while its pages get evicted", _ {
+            uint8_t* disk = example_disk;
+            init_lazy_disk();
+            cleanup([disk] () {
+                free(example_disk);
+                example_disk = disk;
+            });
+
+            libtabfs_volume_options_t options = {};
+            options.lazy_bat = true;
+            options.bat_page_budget = 2;
+            libtabfs_volume_t* volume = NULL;
+            expect(libtabfs_new_volume_ex(gVolume->__dev_data, 0, true, &options, &volume)).to_eq(LIBTABFS_ERR_NONE);
+            expect(volume->__bat_lazy).to_eq(true);
+
+            libtabfs_volume_statfs_t stat;
+            expect(libtabfs_volume_statfs(volume, &stat)).to_eq(LIBTABFS_ERR_NONE);
+            expect(stat.total_blocks).to_eq(0x3000ull);
+            expect(volume->__bat_pages_loaded <= 2).to_eq(true);
+            const unsigned long long free_at_mount = stat.free_blocks;
+            expect(free_at_mount).to_eq(0x3000ull - 7);
+
+            // runs that are alive; placed near random goals so every page of every section gets used
+            struct { libtabfs_lba_28_t lba; unsigned short count; } runs[48] = {};
+            unsigned long long used = 0;
+            unsigned int seed = 12345;
+            auto next_rand = [&seed] () { seed = seed * 1103515245 + 12345; return (seed >> 8) & 0xFFFF; };
+
+            for (int round = 0; round < 20000; round++) {
+                auto& run = runs[next_rand() % 48];
+                if (run.count != 0) {
+                    libtabfs_bat_freeChainedBlocks(volume, run.count, run.lba);
+                    used -= run.count;
+                }
+                run.count = 1 + (next_rand() % 32);
+                run.lba = libtabfs_bat_allocateChainedBlocksAt(volume, run.count, (next_rand() * 3) % 0x3000);
+                expect(run.lba).to_neq(LIBTABFS_INVALID_LBA28);
+                used += run.count;
+
+                expect(volume->__bat_pages_loaded <= 2).to_eq(true);
+                if ((round % 1000) == 999) {
+                    expect(libtabfs_volume_statfs(volume, &stat)).to_eq(LIBTABFS_ERR_NONE);
+                    expect(stat.free_blocks).to_eq(free_at_mount - used);
+                    expect(volume->__bat_pages_loaded <= 2).to_eq(true);
+                }
+            }
+
+            // every block of an run is used, and the blocks around the runs are free
+            bool used_map[0x3000] = {};
+            for (auto& run : runs) {
+                for (int i = 0; i < run.count; i++) { used_map[run.lba + i] = true; }
+            }
+            for (libtabfs_lba_28_t lba = 7; lba < 0x3000; lba++) {
+                expect(libtabfs_bat_isFree(volume, lba)).to_eq(!used_map[lba]);
+            }
+            libtabfs_destroy_volume(volume);
+
+            // and so they are on disk; mounted again without lazy_bat
+            volume = NULL;
+            expect(libtabfs_new_volume(gVolume->__dev_data, 0, true, &volume)).to_eq(LIBTABFS_ERR_NONE);
+            for (libtabfs_lba_28_t lba = 0; lba < 0x3000; lba++) {
+                expect(libtabfs_bat_isFree(volume, lba)).to_eq(lba >= 7 && !used_map[lba]);
+            }
+            expect(libtabfs_volume_statfs(volume, &stat)).to_eq(LIBTABFS_ERR_NONE);
+            expect(stat.free_blocks).to_eq(free_at_mount - used);
+            libtabfs_destroy_volume(volume);
+        });
     });
 
     explain("libtabfs_bat_allocateChainedBlocks", $ {
@@ -183,6 +437,39 @@ describe(libtabfs, $ {
         });
     });
 
+    explain("libtabfs_volume_set_alloc_policy", $ {
+        it("should place runs into the smallest fitting hole with best-fit", _ {
+            libtabfs_lba_28_t x = libtabfs_bat_allocateChainedBlocks(gVolume, 4);
+            libtabfs_lba_28_t s = libtabfs_bat_allocateChainedBlocks(gVolume, 1);
+            libtabfs_lba_28_t y = libtabfs_bat_allocateChainedBlocks(gVolume, 1);
+            libtabfs_lba_28_t z = libtabfs_bat_allocateChainedBlocks(gVolume, 1);
+            expect(x).to_eq(0x6);
+            expect(y).to_eq(0xB);
+            libtabfs_bat_freeChainedBlocks(gVolume, 4, x);
+            libtabfs_bat_freeChainedBlocks(gVolume, 1, y);
+
+            libtabfs_volume_set_alloc_policy(gVolume, &libtabfs_alloc_best_fit);
+            libtabfs_lba_28_t hole = libtabfs_bat_allocateChainedBlocks(gVolume, 1);
+            libtabfs_volume_set_alloc_policy(gVolume, NULL);
+            expect(hole).to_eq(0xB);
+
+            libtabfs_bat_freeChainedBlocks(gVolume, 1, hole);
+            libtabfs_bat_freeChainedBlocks(gVolume, 1, s);
+            libtabfs_bat_freeChainedBlocks(gVolume, 1, z);
+        });
+        it("should align power-of-two runs with buddy", _ {
+            libtabfs_volume_set_alloc_policy(gVolume, &libtabfs_alloc_buddy);
+            libtabfs_lba_28_t run = libtabfs_bat_allocateChainedBlocks(gVolume, 4);
+            libtabfs_volume_set_alloc_policy(gVolume, NULL);
+            expect(run % 4).to_eq(0);
+            expect(libtabfs_bat_isFree(gVolume, 0x6)).to_eq(true);
+            libtabfs_bat_freeChainedBlocks(gVolume, 4, run);
+        });
+        it("should use first-fit again after resetting the policy", _ {
+            expect(gVolume->__alloc_policy).to_eq(&libtabfs_alloc_first_fit);
+        });
+    });
+
     explain("libtabfs_create_dir", $ {
         it("should create an directory entry as well as an entrytable on 0x6 - 0x7", _ {
             libtabfs_entrytable_t* myDir_entrytable;
@@ -406,6 +693,106 @@ describe(libtabfs, $ {
         });
     });
 
+    explain("libtabfs_fatfile_preallocate", $ {
+        it("should reserve the blocks of an range as one chained run", _ {
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_error err = libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myFatFile", false,
+                1, 2, &entry, NULL, NULL
+            );
+            expect(err).to_eq(LIBTABFS_ERR_NONE);
+
+            err = libtabfs_fatfile_preallocate(gVolume, entry, 512, 4 * 512);
+            expect(err).to_eq(LIBTABFS_ERR_NONE);
+
+            libtabfs_fat_t* fat = libtabfs_get_fat_section(gVolume, entry->data.lba_and_size.lba, entry->data.lba_and_size.size);
+            libtabfs_fat_entry_t* first = NULL;
+            expect(libtabfs_fat_findlatest(1, fat, &first, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            for (int i = 2; i <= 4; i++) {
+                libtabfs_fat_entry_t* fatentry = NULL;
+                expect(libtabfs_fat_findlatest(i, fat, &fatentry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+                expect(fatentry->lba).to_eq(first->lba + (i - 1));
+            }
+        });
+        it("should not allocate anything when writing into the reserved range", _ {
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_error err = libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myFatFile", false,
+                1, 2, &entry, NULL, NULL
+            );
+            expect(err).to_eq(LIBTABFS_ERR_NONE);
+
+            libtabfs_volume_statfs_t before, after;
+            libtabfs_volume_statfs(gVolume, &before);
+
+            unsigned long int bytes_written = 0;
+            unsigned char buf[512] = {0};
+            err = libtabfs_write_file(gVolume, entry, 1024, 512, buf, &bytes_written);
+            expect(err).to_eq(LIBTABFS_ERR_NONE);
+
+            libtabfs_volume_statfs(gVolume, &after);
+            expect(after.free_blocks).to_eq(before.free_blocks);
+        });
+    });
+
+    explain("libtabfs_defrag_step", $ {
+        it("should move the blocks of interleaved fat files into one run each", _ {
+            libtabfs_fileflags_t flags = {};
+            libtabfs_time_t ts = {};
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+
+            libtabfs_entrytable_entry_t* files[2] = { NULL, NULL };
+            expect(libtabfs_create_fatfile(mydir, (char*) "fragA", flags, ts, 1, 2, &files[0])).to_eq(LIBTABFS_ERR_NONE);
+            expect(libtabfs_create_fatfile(mydir, (char*) "fragB", flags, ts, 1, 2, &files[1])).to_eq(LIBTABFS_ERR_NONE);
+
+            unsigned char buf[512];
+            for (int block = 0; block < 4; block++) {
+                for (int f = 0; f < 2; f++) {
+                    for (int i = 0; i < 512; i++) { buf[i] = (unsigned char) (f * 16 + block + i); }
+                    unsigned long int bytes_written = 0;
+                    expect(libtabfs_write_file(gVolume, files[f], block * 512, 512, buf, &bytes_written)).to_eq(LIBTABFS_ERR_NONE);
+                }
+            }
+
+            libtabfs_volume_statfs_t before, after;
+            libtabfs_volume_statfs(gVolume, &before);
+
+            // an small budget, so the files are moved over multiple steps
+            libtabfs_defrag_t* defrag = libtabfs_defrag_create(gVolume);
+            bool done = false;
+            int steps = 0;
+            while (!done && steps < 1000) {
+                expect(libtabfs_defrag_step(defrag, 3, &done)).to_eq(LIBTABFS_ERR_NONE);
+                steps++;
+            }
+            expect(done).to_eq(true);
+            expect(steps > 1).to_eq(true);
+            libtabfs_defrag_destroy(defrag);
+
+            libtabfs_volume_statfs(gVolume, &after);
+            expect(after.free_blocks).to_eq(before.free_blocks);
+
+            for (int f = 0; f < 2; f++) {
+                libtabfs_fat_t* fat = libtabfs_get_fat_section(gVolume, files[f]->data.lba_and_size.lba, files[f]->data.lba_and_size.size);
+                libtabfs_fat_entry_t* first = NULL;
+                expect(libtabfs_fat_findlatest(0, fat, &first, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+                for (int block = 0; block < 4; block++) {
+                    libtabfs_fat_entry_t* fatentry = NULL;
+                    expect(libtabfs_fat_findlatest(block, fat, &fatentry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+                    expect(fatentry->lba).to_eq(first->lba + block);
+
+                    unsigned long int bytes_read = 0;
+                    expect(libtabfs_read_file(gVolume, files[f], block * 512, 512, buf, &bytes_read)).to_eq(LIBTABFS_ERR_NONE);
+                    expect(buf[7]).to_eq((unsigned char) (f * 16 + block + 7));
+                }
+            }
+        });
+    });
+
     // TODO: add an test to confirm that entry creation automatically creates an new section
 
     explain("libtabfs_entrytab_traversetree", $ {
@@ -498,6 +885,396 @@ describe(libtabfs, $ {
             expect(err).to_eq(LIBTABFS_ERR_NONE);
             expect(entry->flags.type).to_eq(LIBTABFS_ENTRYTYPE_SYMLINK);
         });
+        it("should only read the given length of an const path", _ {
+            // the length ends the last name right in the middle of the buffer
+            const char path[] = "myDir/testChrDevice/../myDir";
+            char before[sizeof(path)];
+            memcpy(before, path, sizeof(path));
+
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_error err = libtabfs_entrytab_traversetree_n(
+                gVolume->__root_table, path, 16, true, 1, 2, &entry, NULL, NULL
+            );
+            expect(err).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry->flags.type).to_eq(LIBTABFS_ENTRYTYPE_DEV_CHR);
+            expect(memcmp(before, path, sizeof(path))).to_eq(0);
+
+            err = libtabfs_entrytab_traversetree_n(
+                gVolume->__root_table, "myDir/./testChrDe", 17, true, 1, 2, &entry, NULL, NULL
+            );
+            expect(err).to_eq(LIBTABFS_ERR_NOT_FOUND);
+
+            err = libtabfs_entrytab_traversetree_n(
+                gVolume->__root_table, "myDir/../myChrDev", 17, true, 1, 2, &entry, NULL, NULL
+            );
+            expect(err).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry->flags.type).to_eq(LIBTABFS_ENTRYTYPE_DEV_CHR);
+        });
+    });
+
+    explain("libtabfs_entrytab_findentry", $ {
+        it("should find entries in all sections of an directory", _ {
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+
+            libtabfs_entrytable_t* big = NULL;
+            expect(libtabfs_create_dir(mydir, (char*) "big", {}, {}, 1, 2, &big)).to_eq(LIBTABFS_ERR_NONE);
+
+            // one section holds 15 entries; the index is build by the first lookup
+            char name[32];
+            for (int i = 0; i < 10; i++) {
+                sprintf(name, "dev%d", i);
+                expect(libtabfs_create_chardevice(big, name, {}, {}, 1, 2, i, 0)).to_eq(LIBTABFS_ERR_NONE);
+            }
+            libtabfs_entrytable_entry_t* entry = NULL;
+            expect(libtabfs_entrytab_findentry(big, (char*) "dev3", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(entry->data.dev.id).to_eq(3u);
+
+            // the rest is added to the index on creation; the last ones and the longname end up in the next section
+            for (int i = 10; i < 20; i++) {
+                sprintf(name, "dev%d", i);
+                expect(libtabfs_create_chardevice(big, name, {}, {}, 1, 2, i, 0)).to_eq(LIBTABFS_ERR_NONE);
+            }
+            expect(libtabfs_create_chardevice(big, (char*) "an_device_with_an_long_name", {}, {}, 1, 2, 42, 0)).to_eq(LIBTABFS_ERR_NONE);
+
+            libtabfs_entrytable_t* section = NULL;
+            int offset = -1;
+            expect(libtabfs_entrytab_findentry(big, (char*) "dev19", &entry, &section, &offset)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(entry->data.dev.id).to_eq(19u);
+            expect(section).to_neq(big);
+            expect(&(section->entries[offset])).to_eq(entry);
+
+            expect(libtabfs_entrytab_findentry(big, (char*) "an_device_with_an_long_name", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(entry->data.dev.id).to_eq(42u);
+
+            expect(libtabfs_entrytab_findentry(big, (char*) "dev20", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_eq(nullptr);
+
+            libtabfs_dirindex_t* index = libtabfs_dirindex_get(big);
+            expect(index->count).to_eq(21u);
+        });
+        it("should forget the entries of an removed section", _ {
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+
+            libtabfs_entrytable_t* split = NULL;
+            expect(libtabfs_create_dir(mydir, (char*) "split", {}, {}, 1, 2, &split)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_entry_t* entry = NULL;
+            expect(libtabfs_entrytab_findentry(split, (char*) "dev0", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+
+            // 15 entries fill the first section, the last two go into an second one
+            char name[32];
+            for (int i = 0; i < 17; i++) {
+                sprintf(name, "dev%d", i);
+                expect(libtabfs_create_chardevice(split, name, {}, {}, 1, 2, i, 0)).to_eq(LIBTABFS_ERR_NONE);
+            }
+            libtabfs_entrytable_t* second = NULL;
+            expect(libtabfs_entrytab_findentry(split, (char*) "dev16", &entry, &second, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(second).to_neq(split);
+            libtabfs_entrytable_release(second);
+
+            // the section is still on disk, so an stale record would find the entry again
+            libtabfs_entrytable_tableinfo_t* tabinfo = (libtabfs_entrytable_tableinfo_t*) &(split->entries[0]);
+            tabinfo->next_lba = 0;
+            tabinfo->next_size = 0;
+            libtabfs_entrytable_sync(split);
+            libtabfs_entrytable_remove(second);
+
+            expect(libtabfs_entrytab_findentry(split, (char*) "dev16", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_eq(nullptr);
+            expect(libtabfs_entrytab_findentry(split, (char*) "dev14", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(libtabfs_dirindex_get(split)->count).to_eq(15u);
+            libtabfs_entrytable_release(split);
+        });
+        it("should only load longnames whose fingerprint matches", _ {
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+
+            char name[] = "an_device_with_an_long_name";
+            libtabfs_entrytable_entry_t* big_entry = NULL;
+            expect(libtabfs_entrytab_findentry(mydir, (char*) "big", &big_entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* big = libtabfs_get_entrytable(gVolume, big_entry->data.dir.lba, big_entry->data.dir.size);
+
+            libtabfs_entrytable_entry_t* entry = NULL;
+            expect(libtabfs_entrytab_findentry(big, name, &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(entry->longname_data.fingerprint_identifier).to_eq(LIBTABFS_LONGNAME_FINGERPRINT);
+            expect(entry->longname_data.fingerprint).to_eq(libtabfs_name_hash(name));
+
+            int namelen = strlen(name);
+            unsigned int hash = libtabfs_name_hash(name);
+            expect(libtabfs_entry_has_name(gVolume, entry, name, namelen, hash)).to_eq(true);
+            expect(libtabfs_entry_has_name(gVolume, entry, name, namelen, hash + 1)).to_eq(false);
+
+            // entries without an fingerprint are still compared by their longname
+            entry->longname_data.fingerprint_identifier = 0;
+            expect(libtabfs_entry_has_name(gVolume, entry, name, namelen, hash + 1)).to_eq(true);
+            unsigned int entry_hash = 0;
+            expect(libtabfs_entry_name_hash(gVolume, entry, &entry_hash)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry_hash).to_eq(hash);
+            entry->longname_data.fingerprint_identifier = LIBTABFS_LONGNAME_FINGERPRINT;
+        });
+    });
+
+    explain("libtabfs_entrytab_findfree", $ {
+        it("should continue in the section with free entries", _ {
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+            libtabfs_entrytable_entry_t* big_entry = NULL;
+            expect(libtabfs_entrytab_findentry(mydir, (char*) "big", &big_entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* big = libtabfs_get_entrytable(gVolume, big_entry->data.dir.lba, big_entry->data.dir.size);
+
+            // the first section is full, so the free entry is in the second one, which is remembered
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_entrytable_t* section = NULL;
+            int offset = -1;
+            expect(libtabfs_entrytab_findfree(big, &entry, &section, &offset)).to_eq(LIBTABFS_ERR_NONE);
+            expect(section).to_eq(libtabfs_entrytable_nextsection(big));
+            expect(big->__free_hint_lba).to_eq(section->__lba);
+            expect(libtabfs_entrytable_first_free(big)).to_eq(-1);
+
+            // an free entry is handed out until its used
+            libtabfs_entrytable_entry_t* again = NULL;
+            expect(libtabfs_entrytab_findfree(big, &again, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(again).to_eq(entry);
+            expect(libtabfs_create_chardevice(big, (char*) "dev_after", {}, {}, 1, 2, 99, 0)).to_eq(LIBTABFS_ERR_NONE);
+            expect(libtabfs_entrytab_findfree(big, &again, NULL, &offset)).to_eq(LIBTABFS_ERR_NONE);
+            expect(again).to_neq(entry);
+            expect(entry->data.dev.id).to_eq(99u);
+        });
+
+        it("should hand out an freed entry again", _ {
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+            libtabfs_entrytable_entry_t* big_entry = NULL;
+            expect(libtabfs_entrytab_findentry(mydir, (char*) "big", &big_entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* big = libtabfs_get_entrytable(gVolume, big_entry->data.dir.lba, big_entry->data.dir.size);
+
+            // the map of the full first section has the bit of dev3 set by now
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_entrytable_t* section = NULL;
+            int offset = -1;
+            expect(libtabfs_entrytab_findentry(big, (char*) "dev3", &entry, &section, &offset)).to_eq(LIBTABFS_ERR_NONE);
+            expect(section).to_eq(big);
+            libtabfs_entrytable_free_entry(section, offset);
+            libtabfs_entrytable_release(section);
+
+            libtabfs_entrytable_entry_t* again = NULL;
+            int again_offset = -1;
+            expect(libtabfs_entrytab_findfree(big, &again, NULL, &again_offset)).to_eq(LIBTABFS_ERR_NONE);
+            expect(again).to_eq(entry);
+            expect(again_offset).to_eq(offset);
+            libtabfs_entrytable_entry_t* gone = NULL;
+            expect(libtabfs_entrytab_findentry(big, (char*) "dev3", &gone, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(gone).to_eq(nullptr);
+
+            // the longname entry of an freed entry is freed with it
+            const char* longname = "a_device_with_an_rather_long_name";
+            expect(libtabfs_create_chardevice(big, (char*) longname, {}, {}, 1, 2, 7, 0)).to_eq(LIBTABFS_ERR_NONE);
+            expect(libtabfs_entrytab_findentry(big, (char*) longname, &entry, &section, &offset)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* lne_section = libtabfs_get_entrytable(
+                gVolume, entry->longname_data.longname_lba, entry->longname_data.longname_lba_size
+            );
+            libtabfs_entrytable_entry_t* lne = &(lne_section->entries[entry->longname_data.longname_offset]);
+            expect(lne->flags.type).to_eq(LIBTABFS_ENTRYTYPE_LONGNAME);
+            libtabfs_entrytable_free_entry(section, offset);
+            libtabfs_entrytable_release(section);
+            expect(entry->flags.type).to_eq(LIBTABFS_ENTRYTYPE_UNKNOWN);
+            expect(lne->flags.type).to_eq(LIBTABFS_ENTRYTYPE_UNKNOWN);
+        });
+    });
+
+    explain("libtabfs_dcache", $ {
+        it("should remember found and missing path components", _ {
+            gVolume->__dcache = libtabfs_dcache_create(64);
+
+            char path[] = "myDir/testChrDev";
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_entrytable_t* section = NULL;
+            int offset = -1;
+            expect(libtabfs_entrytab_traversetree(gVolume->__root_table, path, false, 1, 2, &entry, &section, &offset)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(entry->flags.type).to_eq(LIBTABFS_ENTRYTYPE_DEV_CHR);
+
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_findentry(gVolume->__root_table, (char*) "myDir", &mydir_entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+
+            char name[] = "testChrDev";
+            libtabfs_dentry_t dentry;
+            expect(libtabfs_dcache_lookup(gVolume->__dcache, mydir->__lba, name, strlen(name), libtabfs_name_hash(name), &dentry)).to_eq(true);
+            expect(dentry.lba).to_eq(section->__lba);
+            expect(dentry.offset).to_eq((unsigned int) offset);
+
+            // an missing name is remembered as well, until its created
+            char missing[] = "myDir/dev_later";
+            expect(libtabfs_entrytab_traversetree(gVolume->__root_table, missing, false, 1, 2, &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NOT_FOUND);
+            char later[] = "dev_later";
+            expect(libtabfs_dcache_lookup(gVolume->__dcache, mydir->__lba, later, strlen(later), libtabfs_name_hash(later), &dentry)).to_eq(true);
+            expect(dentry.size).to_eq(0u);
+
+            expect(libtabfs_create_chardevice(mydir, later, {}, {}, 1, 2, 77, 0)).to_eq(LIBTABFS_ERR_NONE);
+            expect(libtabfs_dcache_lookup(gVolume->__dcache, mydir->__lba, later, strlen(later), libtabfs_name_hash(later), &dentry)).to_eq(false);
+            expect(libtabfs_entrytab_traversetree(gVolume->__root_table, missing, false, 1, 2, &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(entry->data.dev.id).to_eq(77u);
+
+            libtabfs_dcache_destroy(gVolume->__dcache);
+            gVolume->__dcache = NULL;
+        });
+    });
+
+    explain("libtabfs_create_hashed_dir", $ {
+        it("should place entries in the sections of their bucket", _ {
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+
+            libtabfs_entrytable_t* hashed = NULL;
+            expect(libtabfs_create_hashed_dir(mydir, (char*) "hashed", {}, {}, 1, 2, 1, &hashed)).to_eq(LIBTABFS_ERR_NONE);
+            expect(libtabfs_hashdir_is_hashed(hashed)).to_eq(true);
+            expect(libtabfs_hashdir_is_hashed(mydir)).to_eq(false);
+
+            char name[32];
+            for (int i = 0; i < 20; i++) {
+                sprintf(name, "dev%d", i);
+                expect(libtabfs_create_chardevice(hashed, name, {}, {}, 1, 2, i, 0)).to_eq(LIBTABFS_ERR_NONE);
+            }
+            expect(libtabfs_create_chardevice(hashed, (char*) "an_device_with_an_long_name", {}, {}, 1, 2, 42, 0)).to_eq(LIBTABFS_ERR_NONE);
+
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_entrytable_t* section = NULL;
+            int offset = -1;
+            for (int i = 0; i < 20; i++) {
+                sprintf(name, "dev%d", i);
+                expect(libtabfs_entrytab_findentry(hashed, name, &entry, &section, &offset)).to_eq(LIBTABFS_ERR_NONE);
+                expect(entry).to_neq(nullptr);
+                expect(entry->data.dev.id).to_eq((unsigned int) i);
+                expect(section).to_neq(hashed);
+                expect(&(section->entries[offset])).to_eq(entry);
+            }
+            expect(libtabfs_entrytab_findentry(hashed, (char*) "an_device_with_an_long_name", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_neq(nullptr);
+            expect(entry->data.dev.id).to_eq(42u);
+
+            expect(libtabfs_entrytab_findentry(hashed, (char*) "dev20", &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry).to_eq(nullptr);
+
+            // the linear chain still reaches every entry
+            expect(libtabfs_entrytable_count_entries(hashed, false)).to_eq(22);
+        });
+        it("should free the bucket table together with the first section", _ {
+            libtabfs_entrytable_entry_t* mydir_entry = NULL;
+            expect(libtabfs_entrytab_traversetree(
+                gVolume->__root_table, "myDir", false, 1, 2, &mydir_entry, NULL, NULL
+            )).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* mydir = libtabfs_get_entrytable(gVolume, mydir_entry->data.dir.lba, mydir_entry->data.dir.size);
+
+            // 128 buckets need two blocks
+            libtabfs_entrytable_t* hashed = NULL;
+            expect(libtabfs_create_hashed_dir(mydir, (char*) "gone", {}, {}, 1, 2, 7, &hashed)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_tableinfo_t* tabinfo = (libtabfs_entrytable_tableinfo_t*) &(hashed->entries[0]);
+            libtabfs_lba_28_t table_lba = tabinfo->bucket_table_lba;
+            libtabfs_lba_28_t dir_lba = hashed->__lba;
+            expect(libtabfs_bat_isFree(gVolume, table_lba)).to_eq(false);
+            expect(libtabfs_bat_isFree(gVolume, table_lba + 1)).to_eq(false);
+
+            // the entry in the parent goes first, since removing dosnt update any links
+            libtabfs_entrytable_entry_t* entry = NULL;
+            libtabfs_entrytable_t* section = NULL;
+            int offset = -1;
+            expect(libtabfs_entrytab_findentry(mydir, (char*) "gone", &entry, &section, &offset)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_free_entry(section, offset);
+            libtabfs_entrytable_sync(section);
+            libtabfs_entrytable_release(section);
+
+            libtabfs_entrytable_release(hashed);
+            libtabfs_entrytable_remove(hashed);
+            expect(libtabfs_bat_isFree(gVolume, dir_lba)).to_eq(true);
+            expect(libtabfs_bat_isFree(gVolume, table_lba)).to_eq(true);
+            expect(libtabfs_bat_isFree(gVolume, table_lba + 1)).to_eq(true);
+            expect(libtabfs_cache_find(gVolume->__bucket_tables, dir_lba)).to_eq(nullptr);
+        });
+    });
+
+    explain("libtabfs_entrytable_release", $ {
+        it("should keep handed out sections loaded until they are released", _ {
+            uint8_t* disk = example_disk;
+            init_lazy_disk();
+            cleanup([disk] () {
+                free(example_disk);
+                example_disk = disk;
+            });
+
+            libtabfs_volume_options_t options = {};
+            options.cache_budget = 4096;
+            libtabfs_volume_t* volume = NULL;
+            expect(libtabfs_new_volume_ex(gVolume->__dev_data, 0, true, &options, &volume)).to_eq(LIBTABFS_ERR_NONE);
+
+            // the root table cant grow, so everything goes into an directory below it
+            libtabfs_fileflags_t flags = { .user = { .exec = true } };
+            libtabfs_entrytable_t* dir = NULL;
+            expect(libtabfs_create_dir(volume->__root_table, (char*) "dir", flags, {}, 1, 2, &dir)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* held = NULL;
+            expect(libtabfs_create_dir(dir, (char*) "held", flags, {}, 1, 2, &held)).to_eq(LIBTABFS_ERR_NONE);
+
+            char name[16];
+            for (int i = 0; i < 8; i++) {
+                libtabfs_entrytable_t* other = NULL;
+                sprintf(name, "other%d", i);
+                expect(libtabfs_create_dir(dir, name, flags, {}, 1, 2, &other)).to_eq(LIBTABFS_ERR_NONE);
+                libtabfs_entrytable_release(other);
+            }
+
+            // more sections were loaded than fit into the budget, but the held ones are still there
+            expect(libtabfs_find_cached_entrytable(volume, held->__lba)).to_eq(held);
+            libtabfs_entrytable_entry_t* entry = NULL;
+            expect(libtabfs_create_chardevice(held, (char*) "dev", {}, {}, 1, 2, 7, 0)).to_eq(LIBTABFS_ERR_NONE);
+            libtabfs_entrytable_t* section = NULL;
+            expect(libtabfs_entrytab_findentry(held, (char*) "dev", &entry, &section, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(section).to_eq(held);
+            expect(entry->data.dev.id).to_eq(7u);
+
+            // once released, they count against the budget like all others
+            libtabfs_lba_28_t held_lba = held->__lba;
+            libtabfs_entrytable_release(section);
+            libtabfs_entrytable_release(held);
+            libtabfs_entrytable_release(dir);
+            for (int i = 0; i < 8; i++) {
+                sprintf(name, "dir/other%d/", i);
+                expect(libtabfs_entrytab_traversetree(volume->__root_table, name, false, 1, 2, &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+                expect(libtabfs_create_chardevice(
+                    libtabfs_get_entrytable(volume, entry->data.dir.lba, entry->data.dir.size), (char*) "dev", {}, {}, 1, 2, i, 0
+                )).to_eq(LIBTABFS_ERR_NONE);
+            }
+            expect(volume->__cache_budget->bytes <= options.cache_budget).to_eq(true);
+            expect(libtabfs_find_cached_entrytable(volume, held_lba)).to_eq(nullptr);
+
+            expect(libtabfs_entrytab_traversetree(volume->__root_table, (char*) "dir/held/dev", false, 1, 2, &entry, NULL, NULL)).to_eq(LIBTABFS_ERR_NONE);
+            expect(entry->data.dev.id).to_eq(7u);
+            libtabfs_destroy_volume(volume);
+        });
     });
 });
 
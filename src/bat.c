@@ -3,42 +3,527 @@
 #include "common.h"
 #include "volume.h"
 #include "bat.h"
+#include "bitmap.h"
+#include "lock.h"
 
-#define LIBTABFS_BAT_DATAOFF   (LIBTABFS_PTR_SIZE * 2) + sizeof(libtabfs_lba_28_t)
+// size of the header (next_bat and block_count) in front of the bitmap inside the first block of an section
+#define LIBTABFS_BAT_HEADERSIZE     6
 
-libtabfs_bat_t* libtabfs_load_bat(libtabfs_volume_t* volume, libtabfs_lba_28_t bat_addr) {
-    int s = volume->blockSize;
+// count of 64bit words in the bitmap of an section (the last one can be partial) and size of the summary of them
+#define LIBTABFS_BAT_WORDCOUNT(bat)     ((libtabfs_bat_getDatabyteCount(bat) + 7) / 8)
+#define LIBTABFS_BAT_SUMMARYSIZE(bat)   ((LIBTABFS_BAT_WORDCOUNT(bat) + 7) / 8)
+
+#ifndef LIBTABFS_DISCARD_MAX_RANGES
+    // pending discard ranges / blocks after which they are sent before the next sync
+    #define LIBTABFS_DISCARD_MAX_RANGES     64
+#endif
+#ifndef LIBTABFS_DISCARD_MAX_BLOCKS
+    #define LIBTABFS_DISCARD_MAX_BLOCKS     0x10000
+#endif
+
+// size of the dirty-block and referenced bitmaps of an section (one bit per block)
+#define LIBTABFS_BAT_DIRTYSIZE(bat)     ((bat->block_count + 7) / 8)
+
+#ifndef LIBTABFS_ALLOC_GROUP_MIN_BLOCKS
+    // sections are put into the same allocation group until it covers at least this many blocks
+    #define LIBTABFS_ALLOC_GROUP_MIN_BLOCKS     4096
+#endif
+
+// entries the region and group index have room for in addition to the sections at mount; libtabfs_bat_grow only appends
+// to them, so lookups dont need a lock. Every new section doubles the covered range, so this is never reached on 28bit lba's
+#define LIBTABFS_BAT_INDEX_HEADROOM     32
+
+// iterates over the sections of an allocation group
+#define LIBTABFS_GROUP_FOREACH(group, bat) \
+    for (libtabfs_bat_t* bat = (group)->first; bat != NULL; bat = (bat == (group)->last) ? NULL : bat->__next_bat)
+
+//--------------------------------------------------------------------------------
+// Pages
+//--------------------------------------------------------------------------------
+
+/**
+ * @brief returns the first bit of the bitmap that is stored inside an page (block) of an section
+ */
+static inline long libtabfs_bat_page_firstbit(libtabfs_bat_t* bat, long page) {
+    if (page == 0) { return 0; }
+    return ((page * bat->__volume->blockSize) - LIBTABFS_BAT_HEADERSIZE) * 8;
+}
+
+/**
+ * @brief returns the page (block) of an section that stores an bit of the bitmap
+ */
+static inline long libtabfs_bat_page_of_bit(libtabfs_bat_t* bat, long bit) {
+    return ((bit / 8) + LIBTABFS_BAT_HEADERSIZE) / bat->__volume->blockSize;
+}
+
+/**
+ * @brief evicts one not recently used page of the volume; pages are visited in an clock-like order,
+ * where an referenced page gets a second chance. Dirty pages are written back before they are dropped
+ */
+static void libtabfs_bat_evict_page(libtabfs_volume_t* volume) {
+    // two rounds: the first one may only clear referenced flags
+    for (long visited = 0; visited < 2 * (long) volume->__bat_pages_loaded + 2; ) {
+        libtabfs_bat_t* bat = volume->__bat_clock_bat;
+        long page = volume->__bat_clock_page;
+        if (bat == NULL || page >= bat->block_count) {
+            // next section; or start over at the root
+            volume->__bat_clock_bat = (bat == NULL || bat->__next_bat == NULL) ? volume->__bat_root : bat->__next_bat;
+            volume->__bat_clock_page = 0;
+            continue;
+        }
+        volume->__bat_clock_page++;
+
+        if (bat->__pages[page] == NULL) { continue; }
+        visited++;
 
-    int bat_size = s + LIBTABFS_BAT_DATAOFF;
-    libtabfs_bat_t* bat = (libtabfs_bat_t*) libtabfs_alloc(bat_size);
+        unsigned char mask = 0x80 >> (page % 8);
+        if (bat->__referenced[page / 8] & mask) {
+            bat->__referenced[page / 8] &= ~mask;
+            continue;
+        }
+        if (bat->__dirty_blocks[page / 8] & mask) {
+            // otherwise the budget would only hold until the next sync
+            libtabfs_bat_flush_part_to_disk(bat, page);
+        }
+
+        libtabfs_free(bat->__pages[page], volume->blockSize);
+        bat->__pages[page] = NULL;
+        volume->__bat_pages_loaded--;
+        return;
+    }
+}
+
+/**
+ * @brief returns the buffer of an page (the raw block) of an section; loads it from disk if its not in memory.
+ * The buffer stays valid until the next page is loaded
+ */
+static unsigned char* libtabfs_bat_page(libtabfs_bat_t* bat, long page) {
+    unsigned char* buf = bat->__pages[page];
+    if (buf == NULL) {
+        libtabfs_volume_t* volume = bat->__volume;
+        if (volume->__bat_page_budget != 0 && volume->__bat_pages_loaded >= volume->__bat_page_budget) {
+            libtabfs_bat_evict_page(volume);
+        }
+
+        buf = (unsigned char*) libtabfs_alloc(volume->blockSize);
+        libtabfs_read_device(
+            volume->__dev_data,
+            bat->__lba + page, volume->flags.absolute_lbas, 0,
+            buf, volume->blockSize
+        );
+        bat->__pages[page] = buf;
+        volume->__bat_pages_loaded++;
+    }
+    bat->__referenced[page / 8] |= (0x80 >> (page % 8));
+    return buf;
+}
+
+/**
+ * @brief returns the bitmap bytes stored inside an page; index 0 is the byte holding libtabfs_bat_page_firstbit
+ */
+static inline unsigned char* libtabfs_bat_page_map(libtabfs_bat_t* bat, long page) {
+    unsigned char* buf = libtabfs_bat_page(bat, page);
+    return page == 0 ? buf + LIBTABFS_BAT_HEADERSIZE : buf;
+}
+
+unsigned char* libtabfs_bat_getdata(libtabfs_bat_t* bat, long byte) {
+    long page = (byte + LIBTABFS_BAT_HEADERSIZE) / bat->__volume->blockSize;
+    return libtabfs_bat_page_map(bat, page) + (byte - (libtabfs_bat_page_firstbit(bat, page) / 8));
+}
+
+/**
+ * @brief searches the first set (or clear) bit of an section in the range [from, to); works page by page
+ *
+ * @return the found bit or to if there is none
+ */
+static long libtabfs_bat_find(libtabfs_bat_t* bat, long from, long to, bool set) {
+    while (from < to) {
+        long page = libtabfs_bat_page_of_bit(bat, from);
+        long base = libtabfs_bat_page_firstbit(bat, page);
+        long page_end = libtabfs_bat_page_firstbit(bat, page + 1);
+        if (page_end > to) { page_end = to; }
+
+        unsigned char* map = libtabfs_bat_page_map(bat, page);
+        long bit = set
+            ? libtabfs_bitmap_find_set(map, from - base, page_end - base)
+            : libtabfs_bitmap_find_clear(map, from - base, page_end - base);
+        if (bit + base < page_end) { return bit + base; }
+        from = page_end;
+    }
+    return to;
+}
+
+/**
+ * @brief counts the set bits of an section in the range [from, to)
+ */
+static long libtabfs_bat_count_set(libtabfs_bat_t* bat, long from, long to) {
+    long count = 0;
+    while (from < to) {
+        long page = libtabfs_bat_page_of_bit(bat, from);
+        long base = libtabfs_bat_page_firstbit(bat, page);
+        long page_end = libtabfs_bat_page_firstbit(bat, page + 1);
+        if (page_end > to) { page_end = to; }
+
+        count += libtabfs_bitmap_count_set(libtabfs_bat_page_map(bat, page), from - base, page_end - base);
+        from = page_end;
+    }
+    return count;
+}
+
+/**
+ * @brief sets (or clears) all bits of an section in the range [from, to)
+ */
+static void libtabfs_bat_fill(libtabfs_bat_t* bat, long from, long to, bool set) {
+    while (from < to) {
+        long page = libtabfs_bat_page_of_bit(bat, from);
+        long base = libtabfs_bat_page_firstbit(bat, page);
+        long page_end = libtabfs_bat_page_firstbit(bat, page + 1);
+        if (page_end > to) { page_end = to; }
+
+        libtabfs_bitmap_fill(libtabfs_bat_page_map(bat, page), from - base, page_end - base, set);
+        from = page_end;
+    }
+}
+
+//--------------------------------------------------------------------------------
+// Loading & indexing
+//--------------------------------------------------------------------------------
+
+/**
+ * @brief creates the in-memory part of an section; no page is loaded yet
+ */
+static libtabfs_bat_t* libtabfs_bat_create(libtabfs_volume_t* volume, libtabfs_lba_28_t bat_addr, unsigned int next_bat, unsigned short block_count) {
+    libtabfs_bat_t* bat = (libtabfs_bat_t*) libtabfs_alloc(sizeof(libtabfs_bat_t));
     bat->__volume = volume;
+    bat->__next_bat = NULL;
     bat->__lba = bat_addr;
+    bat->__start_lba = 0;
+    bat->__indexed = false;
+    libtabfs_extenttree_init(&(bat->__free_extents));
+    bat->__free_count = 0;
+    bat->__full_words = NULL;
+    bat->__group = NULL;
+    bat->next_bat = next_bat;
+    bat->block_count = block_count;
+
+    bat->__pages = (unsigned char**) libtabfs_alloc(sizeof(unsigned char*) * bat->block_count);
+    bat->__dirty_blocks = (unsigned char*) libtabfs_alloc(LIBTABFS_BAT_DIRTYSIZE(bat));
+    bat->__referenced = (unsigned char*) libtabfs_alloc(LIBTABFS_BAT_DIRTYSIZE(bat));
+    for (int i = 0; i < bat->block_count; i++) {
+        bat->__pages[i] = NULL;
+    }
+    for (int i = 0; i < LIBTABFS_BAT_DIRTYSIZE(bat); i++) {
+        bat->__dirty_blocks[i] = 0;
+        bat->__referenced[i] = 0;
+    }
+    return bat;
+}
+
+/**
+ * @brief gives an section the buffers for all of its pages; in eager mode its one buffer for the whole section
+ *
+ * @return the first page; the others follow it in eager mode only
+ */
+static unsigned char* libtabfs_bat_alloc_pages(libtabfs_bat_t* bat) {
+    libtabfs_volume_t* volume = bat->__volume;
+    int s = volume->blockSize;
+    if (volume->__bat_lazy) {
+        for (int i = 0; i < bat->block_count; i++) {
+            bat->__pages[i] = (unsigned char*) libtabfs_alloc(s);
+        }
+    }
+    else {
+        unsigned char* buf = (unsigned char*) libtabfs_alloc(s * bat->block_count);
+        for (int i = 0; i < bat->block_count; i++) {
+            bat->__pages[i] = buf + (s * i);
+        }
+    }
+    volume->__bat_pages_loaded += bat->block_count;
+    return bat->__pages[0];
+}
+
+libtabfs_bat_t* libtabfs_load_bat(libtabfs_volume_t* volume, libtabfs_lba_28_t bat_addr) {
+    int s = volume->blockSize;
 
+    // only the header; the bitmap itself is read in pages
+    unsigned char header[LIBTABFS_BAT_HEADERSIZE];
     libtabfs_read_device(
         volume->__dev_data,
         bat_addr, volume->flags.absolute_lbas, 0,
-        ((void*)bat) + LIBTABFS_BAT_DATAOFF,
-        s
+        header, LIBTABFS_BAT_HEADERSIZE
     );
+    unsigned int next_bat;
+    unsigned short block_count;
+    libtabfs_memcpy(&next_bat, header, 4);
+    libtabfs_memcpy(&block_count, header + 4, 2);
 
-    if (bat->block_count > 1) {
-        bat = (libtabfs_bat_t*) libtabfs_realloc(bat, bat_size, bat_size + s * (bat->block_count - 1));
+    libtabfs_bat_t* bat = libtabfs_bat_create(volume, bat_addr, next_bat, block_count);
+
+    if (!volume->__bat_lazy) {
+        // read the whole section at once into one buffer; the pages are just pointers into it
+        unsigned char* buf = libtabfs_bat_alloc_pages(bat);
         libtabfs_read_device(
             volume->__dev_data,
-            bat_addr + 1, volume->flags.absolute_lbas, 0,
-            ((void*)bat) + LIBTABFS_BAT_DATAOFF + s,
-            s * (bat->block_count - 1)
+            bat_addr, volume->flags.absolute_lbas, 0,
+            buf, s * bat->block_count
         );
+
+        libtabfs_bat_ensure_indexed(bat);
     }
 
     return bat;
 }
 
+/**
+ * @brief re-evaluates the summary bits of all words touching the bit range [from, to)
+ */
+static void libtabfs_bat_update_summary(libtabfs_bat_t* bat, long from, long to) {
+    long bytecount = libtabfs_bat_getDatabyteCount(bat);
+    long w = from / 64;
+    long w_last = (to - 1) / 64;
+    while (w <= w_last) {
+        // words are checked page by page; a word can be split over two pages though
+        long page = libtabfs_bat_page_of_bit(bat, w * 64);
+        long page_first = libtabfs_bat_page_firstbit(bat, page) / 8;
+        long page_end = libtabfs_bat_page_firstbit(bat, page + 1) / 8;
+        if (page_end > bytecount) { page_end = bytecount; }
+        unsigned char* map = libtabfs_bat_page_map(bat, page);
+
+        for (; w <= w_last && (w * 8) < page_end; w++) {
+            long byte_end = (w * 8) + 8;
+            if (byte_end > bytecount) { byte_end = bytecount; }
+
+            bool full = true;
+            for (long byte = w * 8; byte < byte_end && full; byte++) {
+                // the last word of an page can continue in the next one
+                unsigned char b = byte < page_end ? map[byte - page_first] : *libtabfs_bat_getdata(bat, byte);
+                full = (b == 0xFF);
+            }
+
+            if (full) {
+                bat->__full_words[w / 8] |= (0x80 >> (w % 8));
+            } else {
+                bat->__full_words[w / 8] &= ~(0x80 >> (w % 8));
+            }
+
+            if (byte_end > page_end) {
+                // loading the next page could have evicted the one of map
+                w++;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief updates the summary after all bits in [from, to) got set or cleared; words that are completely inside
+ * the range got uniform so their summary bits are filled directly, only the words at the edges are re-evaluated
+ */
+static void libtabfs_bat_fill_summary(libtabfs_bat_t* bat, long from, long to, bool set) {
+    long inner_from = (from + 63) / 64;
+    long inner_to = to / 64;
+    if (inner_from >= inner_to) {
+        libtabfs_bat_update_summary(bat, from, to);
+        return;
+    }
+
+    libtabfs_bitmap_fill(bat->__full_words, inner_from, inner_to, set);
+    if (from < inner_from * 64) {
+        libtabfs_bat_update_summary(bat, from, inner_from * 64);
+    }
+    if (to > inner_to * 64) {
+        libtabfs_bat_update_summary(bat, inner_to * 64, to);
+    }
+}
+
+void libtabfs_bat_build_summary(libtabfs_bat_t* bat) {
+    long end = libtabfs_bat_getcount(bat);
+    if (bat->__full_words == NULL) {
+        bat->__full_words = (unsigned char*) libtabfs_alloc(LIBTABFS_BAT_SUMMARYSIZE(bat));
+    }
+    long free = end - libtabfs_bat_count_set(bat, 0, end);
+    if (bat->__group != NULL) {
+        LIBTABFS_ATOMIC_ADD(bat->__group->free_count, free - bat->__free_count);
+    }
+    bat->__free_count = free;
+    libtabfs_bat_update_summary(bat, 0, end);
+}
+
+long libtabfs_bat_find_free(libtabfs_bat_t* bat, long from) {
+    long end = libtabfs_bat_getcount(bat);
+    long words = LIBTABFS_BAT_WORDCOUNT(bat);
+    if (bat->__free_count == 0) { return end; }
+
+    long w = from / 64;
+    while (w < words) {
+        // next word that has at least one free block
+        w = libtabfs_bitmap_find_clear(bat->__full_words, w, words);
+        if (w >= words) { break; }
+
+        long lo = w * 64;
+        long hi = lo + 64;
+        if (lo < from) { lo = from; }
+        if (hi > end) { hi = end; }
+
+        long bit = libtabfs_bat_find(bat, lo, hi, false);
+        if (bit < hi) { return bit; }
+        w++;
+    }
+    return end;
+}
+
+void libtabfs_bat_build_extents(libtabfs_bat_t* bat) {
+    libtabfs_extenttree_destroy(&(bat->__free_extents));
+
+    long end = libtabfs_bat_getcount(bat);
+    long bit = libtabfs_bat_find_free(bat, 0);
+    while (bit < end) {
+        long run_end = libtabfs_bat_find(bat, bit, end, true);
+        libtabfs_extenttree_add(&(bat->__free_extents), bit, run_end - bit);
+        if (run_end >= end) { break; }
+        bit = libtabfs_bat_find_free(bat, run_end);
+    }
+}
+
+long long libtabfs_bat_largest_free(libtabfs_volume_t* volume) {
+    long long largest = 0;
+    long long carry = 0;    // length of the free run reaching the end of the previous section
+    unsigned int group_count = LIBTABFS_ATOMIC_LOAD(volume->__alloc_group_count);
+    for (unsigned int i = 0; i < group_count; i++) {
+        libtabfs_alloc_group_t* group = &(volume->__alloc_groups[i]);
+        LIBTABFS_LOCK(group->lock);
+        LIBTABFS_GROUP_FOREACH(group, bat) {
+            if (!bat->__indexed) {
+                carry = 0;
+                continue;
+            }
+            libtabfs_extenttree_t* tree = &(bat->__free_extents);
+            long end = libtabfs_bat_getcount(bat);
+
+            libtabfs_extent_t* first = libtabfs_extenttree_next(tree, 0);
+            long head = (first != NULL && first->start == 0) ? first->length : 0;
+            if (carry + head > largest) { largest = carry + head; }
+            if (tree->root != NULL && tree->root->max_length > largest) { largest = tree->root->max_length; }
+
+            if (head == end) {
+                // completely free; the run continues into the next section
+                carry += head;
+                continue;
+            }
+            libtabfs_extent_t* last = libtabfs_extenttree_last(tree);
+            carry = (last != NULL && last->start + last->length == end) ? last->length : 0;
+        }
+        LIBTABFS_UNLOCK(group->lock);
+    }
+    return largest;
+}
+
+void libtabfs_bat_ensure_indexed(libtabfs_bat_t* bat) {
+    if (bat->__indexed) { return; }
+    libtabfs_bat_build_summary(bat);
+    libtabfs_bat_build_extents(bat);
+    bat->__indexed = true;
+}
+
+void libtabfs_bat_build_index(libtabfs_volume_t* volume) {
+    libtabfs_bat_free_index(volume);
+
+    unsigned int count = 0;
+    for (libtabfs_bat_t* bat = volume->__bat_root; bat != NULL; bat = bat->__next_bat) {
+        count++;
+    }
+
+    unsigned int capacity = count + LIBTABFS_BAT_INDEX_HEADROOM;
+    libtabfs_bat_region_t* regions = (libtabfs_bat_region_t*) libtabfs_alloc(sizeof(libtabfs_bat_region_t) * capacity);
+    libtabfs_alloc_group_t* groups = (libtabfs_alloc_group_t*) libtabfs_alloc(sizeof(libtabfs_alloc_group_t) * capacity);
+    unsigned int group_count = 0;
+    long long group_blocks = 0;
+
+    // calculating the lba offset by summing the count of all previous bat's
+    libtabfs_lba_28_t start_lba = volume->bat_start_LBA;
+    libtabfs_bat_t* bat = volume->__bat_root;
+    for (unsigned int i = 0; i < count; i++) {
+        bat->__start_lba = start_lba;
+        regions[i].start_lba = start_lba;
+        regions[i].end_lba = start_lba + libtabfs_bat_getcount(bat);
+        regions[i].bat = bat;
+        start_lba = regions[i].end_lba;
+
+        // adjacent sections share an group until it covers enough blocks
+        if (group_count == 0 || group_blocks >= LIBTABFS_ALLOC_GROUP_MIN_BLOCKS) {
+            libtabfs_alloc_group_t* group = &(groups[group_count]);
+            group->index = group_count++;
+            group->first = bat;
+            group->free_count = 0;
+            group->lock = LIBTABFS_LOCK_CREATE();
+            group_blocks = 0;
+        }
+        libtabfs_alloc_group_t* group = &(groups[group_count - 1]);
+        group->last = bat;
+        group_blocks += libtabfs_bat_getcount(bat);
+        bat->__group = group;
+        if (bat->__indexed) {
+            // sections indexed while loading where not in an group yet
+            group->free_count += bat->__free_count;
+        }
+
+        bat = bat->__next_bat;
+    }
+
+    volume->__bat_regions = regions;
+    volume->__bat_region_count = count;
+    volume->__alloc_groups = groups;
+    volume->__alloc_group_count = group_count;
+    volume->__bat_index_capacity = capacity;
+}
+
+void libtabfs_bat_free_index(libtabfs_volume_t* volume) {
+    unsigned int capacity = volume->__bat_index_capacity;
+    if (volume->__bat_regions != NULL) {
+        libtabfs_free(volume->__bat_regions, sizeof(libtabfs_bat_region_t) * capacity);
+    }
+    if (volume->__alloc_groups != NULL) {
+        for (unsigned int i = 0; i < volume->__alloc_group_count; i++) {
+            LIBTABFS_LOCK_DESTROY(volume->__alloc_groups[i].lock);
+        }
+        libtabfs_free(volume->__alloc_groups, sizeof(libtabfs_alloc_group_t) * capacity);
+    }
+    volume->__bat_regions = NULL;
+    volume->__bat_region_count = 0;
+    volume->__alloc_groups = NULL;
+    volume->__alloc_group_count = 0;
+    volume->__bat_index_capacity = 0;
+}
+
 void libtabfs_bat_destroy(libtabfs_bat_t* bat) {
-    int s = bat->__volume->blockSize;
-    int bat_size = s + LIBTABFS_BAT_DATAOFF;
-    bat_size += s * (bat->block_count - 1);
-    libtabfs_free(bat, bat_size);
+    libtabfs_volume_t* volume = bat->__volume;
+    int s = volume->blockSize;
+
+    libtabfs_extenttree_destroy(&(bat->__free_extents));
+    if (bat->__full_words != NULL) {
+        libtabfs_free(bat->__full_words, LIBTABFS_BAT_SUMMARYSIZE(bat));
+    }
+
+    if (volume->__bat_lazy) {
+        for (int i = 0; i < bat->block_count; i++) {
+            if (bat->__pages[i] != NULL) {
+                libtabfs_free(bat->__pages[i], s);
+                volume->__bat_pages_loaded--;
+            }
+        }
+    }
+    else {
+        libtabfs_free(bat->__pages[0], s * bat->block_count);
+        volume->__bat_pages_loaded -= bat->block_count;
+    }
+    if (volume->__bat_clock_bat == bat) {
+        volume->__bat_clock_bat = NULL;
+    }
+
+    libtabfs_free(bat->__pages, sizeof(unsigned char*) * bat->block_count);
+    libtabfs_free(bat->__dirty_blocks, LIBTABFS_BAT_DIRTYSIZE(bat));
+    libtabfs_free(bat->__referenced, LIBTABFS_BAT_DIRTYSIZE(bat));
+    libtabfs_free(bat, sizeof(libtabfs_bat_t));
 }
 
 long libtabfs_bat_getDatabyteCount(libtabfs_bat_t* bat) {
@@ -53,14 +538,7 @@ long libtabfs_bat_getcount(libtabfs_bat_t* bat) {
 }
 
 libtabfs_lba_28_t libtabfs_bat_getstart(libtabfs_bat_t* bat) {
-    // calculating the lba offset by summing the count of all previous bat's
-    libtabfs_lba_28_t start_lba = bat->__volume->bat_start_LBA;
-    libtabfs_bat_t* current = bat->__volume->__bat_root;
-    while (current != bat) {
-        start_lba += libtabfs_bat_getcount(current);
-        current = current->__next_bat;
-    }
-    return start_lba;
+    return bat->__start_lba;
 }
 
 libtabfs_lba_28_t libtabfs_bat_getlba(libtabfs_bat_t* bat, int bytePos, int bitPos) {
@@ -70,182 +548,716 @@ libtabfs_lba_28_t libtabfs_bat_getlba(libtabfs_bat_t* bat, int bytePos, int bitP
     return lba;
 }
 
+//--------------------------------------------------------------------------------
+// Syncing
+//--------------------------------------------------------------------------------
+
+void libtabfs_bat_mark_dirty(libtabfs_bat_t* bat, long byte_from, long byte_to) {
+    if (byte_from >= byte_to) { return; }
+
+    // data starts after next_bat and block_count, so its bytes are shifted by 6 inside the blocks
+    int s = bat->__volume->blockSize;
+    long block_from = (byte_from + LIBTABFS_BAT_HEADERSIZE) / s;
+    long block_to = (byte_to - 1 + LIBTABFS_BAT_HEADERSIZE) / s;
+    for (long b = block_from; b <= block_to; b++) {
+        bat->__dirty_blocks[b / 8] |= (0x80 >> (b % 8));
+    }
+}
+
+/**
+ * @brief writes the blocks [block_from, block_to) of an section to disk and clears their dirty flags
+ */
+static void libtabfs_bat_write_blocks(libtabfs_bat_t* bat, long block_from, long block_to) {
+    int s = bat->__volume->blockSize;
+
+    if (block_from == 0) {
+        // the header could have been changed in the section only
+        unsigned char* first = libtabfs_bat_page(bat, 0);
+        libtabfs_memcpy(first, &(bat->next_bat), 4);
+        libtabfs_memcpy(first + 4, &(bat->block_count), 2);
+    }
+
+    long block = block_from;
+    while (block < block_to) {
+        // pages that are in memory and lay after each other there are written at once
+        unsigned char* buf = libtabfs_bat_page(bat, block);
+        long end = block + 1;
+        while (end < block_to && bat->__pages[end] == buf + (s * (end - block))) {
+            end++;
+        }
+
+        libtabfs_write_device(
+            bat->__volume->__dev_data,
+            bat->__lba + block, bat->__volume->flags.absolute_lbas, 0,
+            buf, s * (end - block)
+        );
+        for (long b = block; b < end; b++) {
+            bat->__dirty_blocks[b / 8] &= ~(0x80 >> (b % 8));
+        }
+        block = end;
+    }
+}
+
 void libtabfs_bat_flush_to_disk(libtabfs_bat_t* bat) {
-    int blockSize_bytes = bat->__volume->blockSize;
-    libtabfs_write_device(
-        bat->__volume->__dev_data,
-        bat->__lba, bat->__volume->flags.absolute_lbas, 0,
-        ((void*)bat) + LIBTABFS_BAT_DATAOFF,
-        blockSize_bytes * bat->block_count
-    );
+    libtabfs_bat_write_blocks(bat, 0, bat->block_count);
+}
+
+void libtabfs_bat_flush_dirty_to_disk(libtabfs_bat_t* bat) {
+    long count = bat->block_count;
+    long block = libtabfs_bitmap_find_set(bat->__dirty_blocks, 0, count);
+    while (block < count) {
+        long end = libtabfs_bitmap_find_clear(bat->__dirty_blocks, block, count);
+        libtabfs_bat_write_blocks(bat, block, end);
+        block = libtabfs_bitmap_find_set(bat->__dirty_blocks, end, count);
+    }
 }
 
 void libtabfs_bat_sync(libtabfs_bat_t* bat) {
     while (bat != NULL) {
-        libtabfs_bat_flush_to_disk(bat);
-        bat = bat->__next_bat;
+        // the link to the next section is changed under the lock of the group too, when the BAT grows
+        libtabfs_alloc_group_t* group = bat->__group;
+        if (group != NULL) { LIBTABFS_LOCK(group->lock); }
+        libtabfs_bat_flush_dirty_to_disk(bat);
+        libtabfs_bat_t* next = bat->__next_bat;
+        if (group != NULL) { LIBTABFS_UNLOCK(group->lock); }
+        bat = next;
     }
 }
 
 void libtabfs_bat_flush_part_to_disk(libtabfs_bat_t* bat, int block_off) {
-    int blockSize_bytes = bat->__volume->blockSize;
-    libtabfs_write_device(
-        bat->__volume->__dev_data,
-        bat->__lba + block_off, bat->__volume->flags.absolute_lbas, 0,
-        bat + LIBTABFS_BAT_DATAOFF + (blockSize_bytes * block_off),
-        blockSize_bytes
-    );
+    libtabfs_bat_write_blocks(bat, block_off, block_off + 1);
 }
 
-libtabfs_bat_t* libtabfs_bat_getBatRegion(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
-    lba -= volume->bat_start_LBA;
+//--------------------------------------------------------------------------------
+// Discard
+//--------------------------------------------------------------------------------
 
-    libtabfs_bat_t* prev = NULL;
-    libtabfs_bat_t* bat = volume->__bat_root;
-    while (1) {
-        // find out how many LBA's the current section can hold
-        int lba_count = libtabfs_bat_getcount(bat);
-        if (lba >= lba_count) {
-            prev = bat;
-            bat = bat->__next_bat;
-            lba -= lba_count;
-            if (bat == 0) {
-                // no next bat
-                return NULL;
-            }
-            continue;
+void libtabfs_bat_discard_flush(libtabfs_volume_t* volume) {
+    #ifdef LIBTABFS_DISCARD
+        // the ranges are taken out first and the BAT is synced after; so every range sent is free on disk already.
+        // ranges allocated again in the meantime are still removed from them by libtabfs_bat_discard_remove
+        libtabfs_extenttree_t inflight;
+        LIBTABFS_LOCK(volume->__discard_lock);
+        inflight = *(volume->__discard_pending);
+        libtabfs_extenttree_init(volume->__discard_pending);
+        volume->__discard_pending_blocks = 0;
+        volume->__discard_inflight = &inflight;
+        LIBTABFS_UNLOCK(volume->__discard_lock);
+
+        libtabfs_bat_sync(volume->__bat_root);
+
+        LIBTABFS_LOCK(volume->__discard_lock);
+        for (libtabfs_extent_t* ext = libtabfs_extenttree_next(&inflight, 0); ext != NULL; ext = libtabfs_extenttree_next(&inflight, ext->start + ext->length)) {
+            libtabfs_discard_device(volume->__dev_data, ext->start, volume->flags.absolute_lbas, ext->length);
         }
-        else {
-            return bat;
+        libtabfs_extenttree_destroy(&inflight);
+        volume->__discard_inflight = NULL;
+        LIBTABFS_UNLOCK(volume->__discard_lock);
+    #endif
+}
+
+/**
+ * @brief remembers an freed range so its discarded later
+ */
+static void libtabfs_bat_discard_add(libtabfs_volume_t* volume, libtabfs_lba_28_t lba, long count) {
+    #ifdef LIBTABFS_DISCARD
+        LIBTABFS_LOCK(volume->__discard_lock);
+        libtabfs_extenttree_add(volume->__discard_pending, lba, count);
+        volume->__discard_pending_blocks += count;
+        LIBTABFS_UNLOCK(volume->__discard_lock);
+    #endif
+}
+
+/**
+ * @brief sends everything pending once there is to much of it; called without any group lock held
+ */
+static void libtabfs_bat_discard_check(libtabfs_volume_t* volume) {
+    #ifdef LIBTABFS_DISCARD
+        LIBTABFS_LOCK(volume->__discard_lock);
+        bool full = volume->__discard_pending->count >= LIBTABFS_DISCARD_MAX_RANGES || volume->__discard_pending_blocks >= LIBTABFS_DISCARD_MAX_BLOCKS;
+        LIBTABFS_UNLOCK(volume->__discard_lock);
+        if (full) {
+            libtabfs_bat_discard_flush(volume);
+        }
+    #endif
+}
+
+/**
+ * @brief forgets an range that gets allocated again before it was discarded
+ */
+static void libtabfs_bat_discard_remove(libtabfs_volume_t* volume, libtabfs_lba_28_t lba, long count) {
+    #ifdef LIBTABFS_DISCARD
+        LIBTABFS_LOCK(volume->__discard_lock);
+        if (volume->__discard_pending->root != NULL) {
+            volume->__discard_pending_blocks -= libtabfs_extenttree_remove(volume->__discard_pending, lba, count);
+        }
+        if (volume->__discard_inflight != NULL && volume->__discard_inflight->root != NULL) {
+            libtabfs_extenttree_remove(volume->__discard_inflight, lba, count);
         }
+        LIBTABFS_UNLOCK(volume->__discard_lock);
+    #endif
+}
+
+//--------------------------------------------------------------------------------
+// Allocation policies
+//--------------------------------------------------------------------------------
+
+static long libtabfs_alloc_first_fit_find(libtabfs_bat_t* bat, long from, unsigned int count) {
+    return libtabfs_extenttree_first_fit(&(bat->__free_extents), from, count);
+}
+
+static long libtabfs_alloc_best_fit_find(libtabfs_bat_t* bat, long from, unsigned int count) {
+    return libtabfs_extenttree_best_fit(&(bat->__free_extents), from, count);
+}
+
+static long libtabfs_alloc_buddy_find(libtabfs_bat_t* bat, long from, unsigned int count) {
+    if (count < 2 || (count & (count - 1)) != 0) {
+        return libtabfs_extenttree_first_fit(&(bat->__free_extents), from, count);
+    }
+    // aligned on the lba, not on the bit; the sections themself are not aligned
+    long bit = libtabfs_extenttree_aligned_fit(&(bat->__free_extents), from, count, count, bat->__start_lba);
+    if (bit < 0) {
+        // no aligned run left; an unaligned one is still better than growing the BAT
+        bit = libtabfs_extenttree_first_fit(&(bat->__free_extents), from, count);
     }
+    return bit;
 }
 
-libtabfs_error libtabfs_bat_are_blocks_free(libtabfs_bat_t* bat, int bytePos, int bitPos, unsigned int count) {
-    // fist check the remaining range of the start byte
-    for (;bitPos < 8; bitPos++) {
-        if ((bat->data[bytePos] & (0x80 >> bitPos)) == 0) {
-            count--;
-            if (count == 0) { return LIBTABFS_ERR_NONE; }
-            continue;
+const libtabfs_alloc_policy_t libtabfs_alloc_first_fit = { "first-fit", false, libtabfs_alloc_first_fit_find };
+const libtabfs_alloc_policy_t libtabfs_alloc_next_fit = { "next-fit", true, libtabfs_alloc_first_fit_find };
+const libtabfs_alloc_policy_t libtabfs_alloc_best_fit = { "best-fit", false, libtabfs_alloc_best_fit_find };
+const libtabfs_alloc_policy_t libtabfs_alloc_buddy = { "buddy", false, libtabfs_alloc_buddy_find };
+
+//--------------------------------------------------------------------------------
+// Lookup & allocation
+//--------------------------------------------------------------------------------
+
+/**
+ * @brief searches the region index of an volume for the region that covers an lba
+ *
+ * @return index of the region or -1 if the lba is not covered by any section
+ */
+static long libtabfs_bat_region_index(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
+    libtabfs_bat_region_t* regions = volume->__bat_regions;
+
+    // binary search for the last region starting at or before the lba
+    unsigned int lo = 0;
+    unsigned int hi = LIBTABFS_ATOMIC_LOAD(volume->__bat_region_count);
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (regions[mid].start_lba <= lba) {
+            lo = mid + 1;
         }
         else {
-            // found lba in range that is already allocated. fail since we want one continuos group of lba's
-            return LIBTABFS_ERR_RANGE_NOSPACE;
+            hi = mid;
         }
     }
 
-    // count is not depleted yet? begin checking remaining bytes
-    int bytecount = bat->__volume->blockSize - 6 + ((bat->block_count - 1) * bat->__volume->blockSize);
-    bytePos += 1;   // add one to the bytecount since we checked above
-    for (; bytePos < bytecount; bytePos++) {
-        for (int j = 0; j < 8; j++) {
-            if ((bat->data[bytePos] & (0x80 >> j)) == 0) {
-                count--;
-                if (count == 0) { return LIBTABFS_ERR_NONE; }
-                continue;
-            }
-            else {
-                // found lba in range that is already allocated. fail
-                return LIBTABFS_ERR_RANGE_NOSPACE;
-            }
-        }
+    if (lo == 0 || lba >= regions[lo - 1].end_lba) {
+        // lba is before the first or after the last region
+        return -1;
+    }
+    return lo - 1;
+}
+
+libtabfs_bat_t* libtabfs_bat_getBatRegion(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
+    long i = libtabfs_bat_region_index(volume, lba);
+    return i < 0 ? NULL : volume->__bat_regions[i].bat;
+}
+
+/**
+ * @brief count of blocks an section needs to have to hold an bitmap for bits blocks
+ */
+static long libtabfs_bat_blocks_for(libtabfs_volume_t* volume, long long bits) {
+    long blocks = (long) ((((bits + 7) / 8) + LIBTABFS_BAT_HEADERSIZE + volume->blockSize - 1) / volume->blockSize);
+    return blocks > 0 ? blocks : 1;
+}
+
+/**
+ * @brief libtabfs_bat_grow without taking the grow lock; the caller has to hold it
+ */
+static libtabfs_bat_t* libtabfs_bat_grow_locked(libtabfs_volume_t* volume, unsigned int count) {
+    unsigned int region_count = volume->__bat_region_count;
+    if (region_count == 0 || region_count >= volume->__bat_index_capacity) { return NULL; }
+    libtabfs_bat_region_t* last_region = &(volume->__bat_regions[region_count - 1]);
+    libtabfs_bat_t* last = last_region->bat;
+    int s = volume->blockSize;
+
+    unsigned long long start = last_region->end_lba;
+    unsigned long long limit = (unsigned long long) volume->max_LBA + 1;
+    if (start >= limit) { return NULL; }
+    unsigned long long remaining = limit - start;
+
+    // cover as much as the whole BAT covers now, so the covered range doubles with every section
+    unsigned long long target = start - volume->bat_start_LBA;
+    if (target < count) { target = count; }
+    if (target > remaining) { target = remaining; }
+
+    long block_count = libtabfs_bat_blocks_for(volume, target);
+    while (((block_count * s) - LIBTABFS_BAT_HEADERSIZE) * 8 - block_count < (long long) count) {
+        // the section itself takes the first blocks it covers
+        block_count++;
+    }
+    if (block_count > 0xFFFF) { block_count = 0xFFFF; }
+
+    long long bits = ((block_count * (long long) s) - LIBTABFS_BAT_HEADERSIZE) * 8;
+    long long usable = (bits < (long long) remaining ? bits : (long long) remaining) - block_count;
+    if (usable < (long long) count) {
+        #ifdef LIBTABFS_DEBUG_PRINTF
+            printf("[libtabfs_bat_grow] no room for %u more blocks before max_LBA 0x%x\n", count, volume->max_LBA);
+        #endif
+        return NULL;
     }
 
-    // count is STILL not depleted? try to continue with the next bat
-    if (bat->__next_bat != NULL) {
-        return libtabfs_bat_are_blocks_free(bat->__next_bat, 0, 0, count);
+    // the section is placed on the first blocks it covers; these are not covered by any other section, so they cant be in use
+    libtabfs_lba_28_t lba = (libtabfs_lba_28_t) start;
+    libtabfs_bat_t* bat = libtabfs_bat_create(volume, lba, 0, (unsigned short) block_count);
+    bat->__start_lba = lba;
+    libtabfs_bat_alloc_pages(bat);
+    for (int i = 0; i < bat->block_count; i++) {
+        libtabfs_bitmap_fill(bat->__pages[i], 0, s * 8, false);
     }
 
-    // no next bat
-    return LIBTABFS_ERR_DEVICE_NOSPACE;
+    // its own blocks and everything behind max_LBA are never free
+    long end = libtabfs_bat_getcount(bat);
+    libtabfs_bat_fill(bat, 0, block_count, true);
+    if ((long long) remaining < end) {
+        libtabfs_bat_fill(bat, (long) remaining, end, true);
+    }
+    libtabfs_bat_ensure_indexed(bat);
+    libtabfs_bat_write_blocks(bat, 0, bat->block_count);
+
+    // the new section gets an group of its own; the index entries are filled before they are counted,
+    // so lookups running at the same time see either all of them or none
+    unsigned int group_count = volume->__alloc_group_count;
+    libtabfs_alloc_group_t* group = &(volume->__alloc_groups[group_count]);
+    group->index = group_count;
+    group->first = bat;
+    group->last = bat;
+    group->free_count = bat->__free_count;
+    group->lock = LIBTABFS_LOCK_CREATE();
+    bat->__group = group;
+
+    libtabfs_bat_region_t* region = &(volume->__bat_regions[region_count]);
+    region->start_lba = lba;
+    region->end_lba = lba + end;
+    region->bat = bat;
+
+    // only link it after its on disk
+    LIBTABFS_LOCK(last->__group->lock);
+    last->__next_bat = bat;
+    last->next_bat = lba;
+    libtabfs_bat_write_blocks(last, 0, 1);
+    LIBTABFS_UNLOCK(last->__group->lock);
+
+    LIBTABFS_ATOMIC_STORE(volume->__alloc_group_count, group_count + 1);
+    LIBTABFS_ATOMIC_STORE(volume->__bat_region_count, region_count + 1);
+
+    #ifdef LIBTABFS_DEBUG_PRINTF
+        printf("[libtabfs_bat_grow] new section on 0x%x | block_count: %ld | covers 0x%x - 0x%llx\n", lba, block_count, lba, start + end);
+    #endif
+    return bat;
+}
+
+libtabfs_bat_t* libtabfs_bat_grow(libtabfs_volume_t* volume, unsigned int count) {
+    LIBTABFS_LOCK(volume->__bat_grow_lock);
+    libtabfs_bat_t* bat = libtabfs_bat_grow_locked(volume, count);
+    LIBTABFS_UNLOCK(volume->__bat_grow_lock);
+    return bat;
+}
+
+libtabfs_error libtabfs_bat_are_blocks_free(libtabfs_bat_t* bat, int bytePos, int bitPos, unsigned int count) {
+    long bit = (bytePos * 8) + bitPos;
+    while (1) {
+        long end = libtabfs_bat_getcount(bat);
+        long limit = bit + count;
+        if (limit > end) { limit = end; }
+
+        // search for an allocated lba in range; if there is one, fail since we want one continuos group of lba's
+        if (libtabfs_bat_find(bat, bit, limit, true) < limit) {
+            return LIBTABFS_ERR_RANGE_NOSPACE;
+        }
+
+        count -= (limit - bit);
+        if (count == 0) { return LIBTABFS_ERR_NONE; }
+
+        // count is not depleted yet? try to continue with the next bat
+        bat = bat->__next_bat;
+        if (bat == NULL) {
+            // no next bat
+            return LIBTABFS_ERR_DEVICE_NOSPACE;
+        }
+        bit = 0;
+    }
 }
 
 void libtabfs_bat_mark_range(libtabfs_bat_t* bat, int bytePos, int bitPos, unsigned int count) {
-    for (;bitPos < 8; bitPos++) {
-        bat->data[bytePos] |= (0x80 >> bitPos);
-        count--;
-        if (count == 0) { return; }
+    if (count == 0) { return; }
+
+    long bit = (bytePos * 8) + bitPos;
+    long len = libtabfs_bat_getcount(bat) - bit;
+    if (len > count) { len = count; }
+
+    if (bat->__indexed) {
+        long taken = len - libtabfs_bat_count_set(bat, bit, bit + len);
+        bat->__free_count -= taken;
+        if (bat->__group != NULL) { LIBTABFS_ATOMIC_ADD(bat->__group->free_count, -taken); }
+        libtabfs_extenttree_remove(&(bat->__free_extents), bit, len);
     }
 
-    int bytecount = bat->__volume->blockSize - 6 + ((bat->block_count - 1) * bat->__volume->blockSize);
-    bytePos += 1;
-    for (; bytePos < bytecount; bytePos++) {
-        for (int j = 0; j < 8; j++) {
-            bat->data[bytePos] |= (0x80 >> j);
-            count--;
-            if (count == 0) { return; }
-        }
+    libtabfs_bat_discard_remove(bat->__volume, bat->__start_lba + bit, len);
+
+    // dirty first, so the pages already filled are written back if they get evicted when the next one is loaded
+    libtabfs_bat_mark_dirty(bat, bit / 8, ((bit + len - 1) / 8) + 1);
+    libtabfs_bat_fill(bat, bit, bit + len, true);
+    if (bat->__indexed) {
+        libtabfs_bat_fill_summary(bat, bit, bit + len, true);
     }
 
-    if (bat->__next_bat != NULL) {
-        libtabfs_bat_mark_range(bat, 0, 0, count);
+    count -= len;
+    if (count > 0 && bat->__next_bat != NULL) {
+        libtabfs_bat_mark_range(bat->__next_bat, 0, 0, count);
     }
 }
 
 void libtabfs_bat_clear_range(libtabfs_bat_t* bat, int bytePos, int bitPos, unsigned int count) {
-    for (;bitPos < 8; bitPos++) {
-        bat->data[bytePos] &= ~(0x80 >> bitPos);
-        count--;
-        if (count == 0) { return; }
+    if (count == 0) { return; }
+
+    long bit = (bytePos * 8) + bitPos;
+    long len = libtabfs_bat_getcount(bat) - bit;
+    if (len > count) { len = count; }
+
+    if (bat->__indexed) {
+        long freed = libtabfs_bat_count_set(bat, bit, bit + len);
+        bat->__free_count += freed;
+        if (bat->__group != NULL) { LIBTABFS_ATOMIC_ADD(bat->__group->free_count, freed); }
+        libtabfs_extenttree_add(&(bat->__free_extents), bit, len);
     }
 
-    int bytecount = bat->__volume->blockSize - 6 + ((bat->block_count - 1) * bat->__volume->blockSize);
-    bytePos += 1;
-    for (; bytePos < bytecount; bytePos++) {
-        for (int j = 0; j < 8; j++) {
-            bat->data[bytePos] &= ~(0x80 >> j);
-            count--;
-            if (count == 0) { return; }
-        }
+    // dirty first, so the pages already filled are written back if they get evicted when the next one is loaded
+    libtabfs_bat_mark_dirty(bat, bit / 8, ((bit + len - 1) / 8) + 1);
+    libtabfs_bat_fill(bat, bit, bit + len, false);
+    if (bat->__indexed) {
+        libtabfs_bat_fill_summary(bat, bit, bit + len, false);
     }
+    libtabfs_bat_discard_add(bat->__volume, bat->__start_lba + bit, len);
 
-    if (bat->__next_bat != NULL) {
-        libtabfs_bat_mark_range(bat, 0, 0, count);
+    count -= len;
+    if (count > 0 && bat->__next_bat != NULL) {
+        libtabfs_bat_clear_range(bat->__next_bat, 0, 0, count);
     }
 }
 
-// bool libtabfs_bat_allocateLoseBlocks(libtabfs_volume_t* volume, unsigned short count, long long* lba_out);
-// void libtabfs_bat_freeLoseBlocks(libtabfs_volume_t* volume, unsigned short count, long long* lba_in);
+/**
+ * @brief takes up to count free blocks from the bit range [from, to) of an section, lowest first; locks the group of the section
+ *
+ * @return the count of blocks taken; their lba's are written to lba_out
+ */
+static long libtabfs_bat_take_free(libtabfs_bat_t* bat, long from, long to, long count, long long* lba_out) {
+    LIBTABFS_LOCK(bat->__group->lock);
+    libtabfs_bat_ensure_indexed(bat);
+    long taken = 0;
+    while (taken < count && from < to) {
+        libtabfs_extent_t* ext = libtabfs_extenttree_next(&(bat->__free_extents), from);
+        if (ext == NULL || ext->start >= to) { break; }
 
-libtabfs_lba_28_t libtabfs_bat_allocateChainedBlocks(libtabfs_volume_t* volume, unsigned short count) {
-    libtabfs_bat_t* bat = volume->__bat_root;
-    int blockSize_bytes = volume->blockSize;
-    while (1) {
-        int bytecount = blockSize_bytes - 6 + ((bat->block_count - 1) * blockSize_bytes);
-        for (int i = 0; i < bytecount; i++) {
-            if ( bat->data[i] < 0xff ) {
-                for (int j = 0; j < 8; j++) {
-                    if ((bat->data[i] & (0x80 >> j)) == 0) {
-                        // found free block; start check if <count> blocks are free
-                        int r = libtabfs_bat_are_blocks_free(bat, i, j, count);
-                        if (r == LIBTABFS_ERR_NONE) {
-                            libtabfs_bat_mark_range(bat, i, j, count);
-                            return libtabfs_bat_getlba(bat, i, j);
-                        }
-                        else if (r == LIBTABFS_ERR_RANGE_NOSPACE) {
-                            // count cannot be satisfied? try again elsewhere!
-                            continue;
-                        }
-                        else if (r == LIBTABFS_ERR_DEVICE_NOSPACE) {
-                            // no device space anymore... error!
-                            return LIBTABFS_INVALID_LBA28;
-                        }
-                    }
-                }
+        long start = ext->start > from ? ext->start : from;
+        long end = ext->start + ext->length;
+        if (end > to) { end = to; }
+        if (end - start > count - taken) { end = start + (count - taken); }
+
+        libtabfs_lba_28_t lba = libtabfs_bat_getlba(bat, start / 8, start % 8);
+        for (long i = 0; i < end - start; i++) {
+            lba_out[taken++] = lba + i;
+        }
+
+        // this modifies the extent tree, so ext cannot be used afterwards
+        libtabfs_bat_mark_range(bat, start / 8, start % 8, end - start);
+        LIBTABFS_ATOMIC_STORE(bat->__volume->__alloc_cursor, lba + (end - start));
+        from = end;
+    }
+    LIBTABFS_UNLOCK(bat->__group->lock);
+    return taken;
+}
+
+/**
+ * @brief sums up the free blocks of the allocation groups, until at least need are found;
+ * sections that are not indexed yet (lazy mode) are indexed on the way
+ */
+static long long libtabfs_bat_count_free(libtabfs_volume_t* volume, long long need) {
+    long long free = 0;
+    unsigned int group_count = LIBTABFS_ATOMIC_LOAD(volume->__alloc_group_count);
+    for (unsigned int i = 0; i < group_count && free < need; i++) {
+        libtabfs_alloc_group_t* group = &(volume->__alloc_groups[i]);
+        if (volume->__bat_lazy) {
+            LIBTABFS_LOCK(group->lock);
+            LIBTABFS_GROUP_FOREACH(group, bat) {
+                libtabfs_bat_ensure_indexed(bat);
             }
+            LIBTABFS_UNLOCK(group->lock);
         }
+        free += LIBTABFS_ATOMIC_LOAD(group->free_count);
+    }
+    return free;
+}
+
+bool libtabfs_bat_allocateLoseBlocksAt(libtabfs_volume_t* volume, unsigned short count, libtabfs_lba_28_t goal, long long* lba_out) {
+    if (count == 0) { return true; }
+
+    // check up front if there are enough blocks, so nothing needs to be rolled back
+    if (libtabfs_bat_count_free(volume, count) < count) {
+        LIBTABFS_LOCK(volume->__bat_grow_lock);
+        long long free = libtabfs_bat_count_free(volume, count);
+        bool grown = free >= count || libtabfs_bat_grow_locked(volume, count - free) != NULL;
+        LIBTABFS_UNLOCK(volume->__bat_grow_lock);
+        if (!grown) { return false; }
+    }
+
+    if (LIBTABFS_IS_INVALID_LBA28(goal)) {
+        goal = LIBTABFS_ATOMIC_LOAD(volume->__alloc_cursor);
+    }
+    libtabfs_bat_region_t* regions = volume->__bat_regions;
+    unsigned int region_count = LIBTABFS_ATOMIC_LOAD(volume->__bat_region_count);
+    long goal_region = libtabfs_bat_region_index(volume, goal);
+    long goal_bit = 0;
+    if (goal_region < 0) {
+        goal_region = 0;
+    }
+    else {
+        goal_bit = goal - regions[goal_region].start_lba;
+    }
+
+    // first everything from the goal up to the end of the device...
+    long taken = 0;
+    long from = goal_bit;
+    for (unsigned int i = goal_region; i < region_count && taken < count; i++) {
+        libtabfs_bat_t* bat = regions[i].bat;
+        taken += libtabfs_bat_take_free(bat, from, libtabfs_bat_getcount(bat), count - taken, lba_out + taken);
+        from = 0;
+    }
+    if (taken == count) { return true; }
+
+    // ...then wrap around; all free blocks after the goal are taken now, so the rest comes from before it.
+    // these have lower lba's, so they go in front to keep lba_out sorted
+    long head = count - taken;
+    for (long i = taken - 1; i >= 0; i--) {
+        lba_out[head + i] = lba_out[i];
+    }
+
+    long wrapped = 0;
+    for (unsigned int i = 0; i <= goal_region && wrapped < head; i++) {
+        libtabfs_bat_t* bat = regions[i].bat;
+        long to = (i == goal_region) ? goal_bit : libtabfs_bat_getcount(bat);
+        wrapped += libtabfs_bat_take_free(bat, 0, to, head - wrapped, lba_out + wrapped);
+    }
+    if (wrapped < head) {
+        // other threads took some of the blocks counted above in the meantime
+        libtabfs_bat_freeLoseBlocks(volume, wrapped, lba_out);
+        libtabfs_bat_freeLoseBlocks(volume, taken, lba_out + head);
+        return false;
+    }
+    return true;
+}
 
-        if (bat->__next_bat != NULL) {
-            bat = bat->__next_bat;
+bool libtabfs_bat_allocateLoseBlocks(libtabfs_volume_t* volume, unsigned short count, long long* lba_out) {
+    return libtabfs_bat_allocateLoseBlocksAt(volume, count, volume->bat_start_LBA, lba_out);
+}
+
+void libtabfs_bat_freeLoseBlocks(libtabfs_volume_t* volume, unsigned short count, long long* lba_in) {
+    // free runs of adjacent lba's at once
+    int i = 0;
+    while (i < count) {
+        int run = 1;
+        while (i + run < count && lba_in[i + run] == lba_in[i] + run) {
+            run++;
         }
-        else {
+        libtabfs_bat_freeChainedBlocks(volume, run, (libtabfs_lba_28_t) lba_in[i]);
+        i += run;
+    }
+}
+
+/**
+ * @brief locks the allocation groups after an group up to the one covering last_lba, in ascending order
+ *
+ * @return the group of last_lba or NULL if its not covered by any section; nothing is locked then
+ */
+static libtabfs_alloc_group_t* libtabfs_bat_lock_groups_after(libtabfs_volume_t* volume, libtabfs_alloc_group_t* group, libtabfs_lba_28_t last_lba) {
+    libtabfs_bat_t* last = libtabfs_bat_getBatRegion(volume, last_lba);
+    if (last == NULL) { return NULL; }
+    for (unsigned int i = group->index + 1; i <= last->__group->index; i++) {
+        LIBTABFS_LOCK(volume->__alloc_groups[i].lock);
+    }
+    return last->__group;
+}
+
+/**
+ * @brief unlocks the groups locked by libtabfs_bat_lock_groups_after
+ */
+static void libtabfs_bat_unlock_groups_after(libtabfs_volume_t* volume, libtabfs_alloc_group_t* group, libtabfs_alloc_group_t* last) {
+    for (unsigned int i = group->index + 1; i <= last->index; i++) {
+        LIBTABFS_UNLOCK(volume->__alloc_groups[i].lock);
+    }
+}
+
+/**
+ * @brief tries to allocate count chained blocks inside an section, at or after the bit position from;
+ * the run may continue into the following section(s). The group of the section has to be locked by the caller,
+ * the groups the run continues into are locked here
+ *
+ * @return the first lba of the run or LIBTABFS_INVALID_LBA28 if the section cannot satisfy the request
+ */
+static libtabfs_lba_28_t libtabfs_bat_allocate_from(libtabfs_bat_t* bat, long from, unsigned short count) {
+    libtabfs_bat_ensure_indexed(bat);
+    if (bat->__free_count == 0) {
+        // full section; nothing in here and no run can start in it
+        return LIBTABFS_INVALID_LBA28;
+    }
+
+    long bit = bat->__free_count >= count ? bat->__volume->__alloc_policy->find(bat, from, count) : -1;
+    if (bit >= 0) {
+        libtabfs_bat_mark_range(bat, bit / 8, bit % 8, count);
+    }
+    else {
+        // no run inside this bat is big enough; the last one can still be, if it continues in the next bat(s)
+        libtabfs_extent_t* last = libtabfs_extenttree_last(&(bat->__free_extents));
+        long end = libtabfs_bat_getcount(bat);
+        if (last == NULL || last->start + last->length != end) {
+            return LIBTABFS_INVALID_LBA28;
+        }
+
+        bit = last->start > from ? last->start : from;
+        if (bit >= end) {
+            return LIBTABFS_INVALID_LBA28;
+        }
+
+        libtabfs_volume_t* volume = bat->__volume;
+        libtabfs_alloc_group_t* last_group = libtabfs_bat_lock_groups_after(volume, bat->__group, bat->__start_lba + bit + count - 1);
+        if (last_group == NULL) {
+            return LIBTABFS_INVALID_LBA28;
+        }
+        bool free = libtabfs_bat_are_blocks_free(bat, bit / 8, bit % 8, count) == LIBTABFS_ERR_NONE;
+        if (free) {
+            libtabfs_bat_mark_range(bat, bit / 8, bit % 8, count);
+        }
+        libtabfs_bat_unlock_groups_after(volume, bat->__group, last_group);
+        if (!free) {
             return LIBTABFS_INVALID_LBA28;
         }
     }
+
+    libtabfs_lba_28_t lba = libtabfs_bat_getlba(bat, bit / 8, bit % 8);
+    LIBTABFS_ATOMIC_STORE(bat->__volume->__alloc_cursor, lba + count);
+    return lba;
+}
+
+/**
+ * @brief tries to allocate count chained blocks inside an allocation group, starting at the bit position from
+ * of the section start; the group has to be locked by the caller
+ *
+ * @return the first lba of the run or LIBTABFS_INVALID_LBA28 if the group cannot satisfy the request
+ */
+static libtabfs_lba_28_t libtabfs_bat_allocate_in_group(libtabfs_alloc_group_t* group, libtabfs_bat_t* start, long from, unsigned short count) {
+    for (libtabfs_bat_t* bat = start; bat != NULL; bat = (bat == group->last) ? NULL : bat->__next_bat) {
+        libtabfs_lba_28_t lba = libtabfs_bat_allocate_from(bat, from, count);
+        if (!LIBTABFS_IS_INVALID_LBA28(lba)) { return lba; }
+        from = 0;
+    }
     return LIBTABFS_INVALID_LBA28;
 }
 
+/**
+ * @brief allocates count chained blocks after all groups turned out to be too full; grows the BAT by an new section
+ * and retries. Only the last group that was searched can help then, since its free tail continues into the new ones
+ *
+ * @param seen_groups count of groups that where searched before
+ * @return the first lba of the run or LIBTABFS_INVALID_LBA28 if the BAT cannot grow enough
+ */
+static libtabfs_lba_28_t libtabfs_bat_allocate_grown(libtabfs_volume_t* volume, unsigned short count, unsigned int seen_groups) {
+    libtabfs_lba_28_t lba = LIBTABFS_INVALID_LBA28;
+    LIBTABFS_LOCK(volume->__bat_grow_lock);
+
+    // an other thread could have grown the BAT while we waited for the lock; then its new groups are tried first.
+    // an section we grow ourself always has room for count blocks, so this is done at most twice
+    for (int attempt = 0; attempt < 2 && LIBTABFS_IS_INVALID_LBA28(lba); attempt++) {
+        if (volume->__alloc_group_count == seen_groups && libtabfs_bat_grow_locked(volume, count) == NULL) {
+            break;
+        }
+        unsigned int group_count = volume->__alloc_group_count;
+        for (unsigned int i = seen_groups - 1; i < group_count && LIBTABFS_IS_INVALID_LBA28(lba); i++) {
+            libtabfs_alloc_group_t* group = &(volume->__alloc_groups[i]);
+            LIBTABFS_LOCK(group->lock);
+            lba = libtabfs_bat_allocate_in_group(group, group->first, 0, count);
+            LIBTABFS_UNLOCK(group->lock);
+        }
+        seen_groups = group_count;
+    }
+
+    LIBTABFS_UNLOCK(volume->__bat_grow_lock);
+    return lba;
+}
+
+/**
+ * @brief searches the groups in order, from the start of the volume
+ */
+static libtabfs_lba_28_t libtabfs_bat_allocate_from_start(libtabfs_volume_t* volume, unsigned short count) {
+    unsigned int group_count = LIBTABFS_ATOMIC_LOAD(volume->__alloc_group_count);
+    for (unsigned int i = 0; i < group_count; i++) {
+        libtabfs_alloc_group_t* group = &(volume->__alloc_groups[i]);
+        LIBTABFS_LOCK(group->lock);
+        libtabfs_lba_28_t lba = libtabfs_bat_allocate_in_group(group, group->first, 0, count);
+        LIBTABFS_UNLOCK(group->lock);
+        if (!LIBTABFS_IS_INVALID_LBA28(lba)) { return lba; }
+    }
+    return libtabfs_bat_allocate_grown(volume, count, group_count);
+}
+
+libtabfs_lba_28_t libtabfs_bat_allocateChainedBlocks(libtabfs_volume_t* volume, unsigned short count) {
+    if (count == 0) { return LIBTABFS_INVALID_LBA28; }
+    if (volume->__alloc_policy->from_cursor) {
+        return libtabfs_bat_allocateChainedBlocksAt(volume, count, LIBTABFS_INVALID_LBA28);
+    }
+    return libtabfs_bat_allocate_from_start(volume, count);
+}
+
+libtabfs_lba_28_t libtabfs_bat_allocateChainedBlocksAt(libtabfs_volume_t* volume, unsigned short count, libtabfs_lba_28_t goal) {
+    if (count == 0) { return LIBTABFS_INVALID_LBA28; }
+    if (LIBTABFS_IS_INVALID_LBA28(goal)) {
+        goal = LIBTABFS_ATOMIC_LOAD(volume->__alloc_cursor);
+    }
+
+    libtabfs_bat_t* goal_bat = libtabfs_bat_getBatRegion(volume, goal);
+    if (goal_bat == NULL) {
+        // goal is outside of the bat; search from the start
+        return libtabfs_bat_allocate_from_start(volume, count);
+    }
+    unsigned int group_count = LIBTABFS_ATOMIC_LOAD(volume->__alloc_group_count);
+    unsigned int goal_group = goal_bat->__group->index;
+
+    // first everything from the goal up to the end of the device, then wrap around and search from the start up to
+    // (and including) the group of the goal. Groups other threads are allocating from are skipped on the first pass,
+    // so threads with goals in different groups never wait for each other; only if nothing was found they are waited for
+    for (int pass = 0; pass < 2; pass++) {
+        unsigned int skipped = 0;
+        for (unsigned int k = 0; k <= group_count; k++) {
+            // k == 0 is the group of the goal from the goal on, k == group_count the same group again from its start
+            libtabfs_alloc_group_t* group = &(volume->__alloc_groups[(goal_group + k) % group_count]);
+
+            if (pass == 0 && !LIBTABFS_TRYLOCK(group->lock)) {
+                skipped++;
+                continue;
+            }
+            if (pass == 1) { LIBTABFS_LOCK(group->lock); }
+            libtabfs_lba_28_t lba = (k == 0)
+                ? libtabfs_bat_allocate_in_group(group, goal_bat, goal - libtabfs_bat_getstart(goal_bat), count)
+                : libtabfs_bat_allocate_in_group(group, group->first, 0, count);
+            LIBTABFS_UNLOCK(group->lock);
+            if (!LIBTABFS_IS_INVALID_LBA28(lba)) { return lba; }
+        }
+        if (skipped == 0) { break; }
+    }
+    return libtabfs_bat_allocate_grown(volume, count, group_count);
+}
+
 void libtabfs_bat_freeChainedBlocks(libtabfs_volume_t* volume, unsigned short count, libtabfs_lba_28_t lba) {
     if (lba < volume->bat_start_LBA || lba > volume->max_LBA) {
         #ifdef LIBTABFS_DEBUG_PRINTF
@@ -258,13 +1270,24 @@ void libtabfs_bat_freeChainedBlocks(libtabfs_volume_t* volume, unsigned short co
     #endif
 
     libtabfs_bat_t* bat = libtabfs_bat_getBatRegion(volume, lba);
-    if (bat == NULL) { return; }
+    if (bat == NULL || count == 0) { return; }
 
     libtabfs_lba_28_t rlba = lba - libtabfs_bat_getstart(bat);
     int bytepos = rlba / 8;
     int bitpos = rlba % 8;
 
+    // the range can reach into the following groups; an range past the last section only goes up to its end
+    libtabfs_alloc_group_t* group = bat->__group;
+    LIBTABFS_LOCK(group->lock);
+    libtabfs_alloc_group_t* last_group = libtabfs_bat_lock_groups_after(volume, group, lba + count - 1);
+    if (last_group == NULL) {
+        last_group = libtabfs_bat_lock_groups_after(volume, group, volume->__bat_regions[volume->__bat_region_count - 1].end_lba - 1);
+    }
     libtabfs_bat_clear_range(bat, bytepos, bitpos, count);
+    libtabfs_bat_unlock_groups_after(volume, group, last_group);
+    LIBTABFS_UNLOCK(group->lock);
+
+    libtabfs_bat_discard_check(volume);
 }
 
 bool libtabfs_bat_isFree(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
@@ -276,7 +1299,7 @@ bool libtabfs_bat_isFree(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
     }
     libtabfs_bat_t* bat = libtabfs_bat_getBatRegion(volume, lba);
     if (bat == NULL) {
-        return false;   // error while getting bat region; means we are out of memory on the drive!
+        return true;    // not covered by any section yet; nothing was ever allocated there
     }
 
     libtabfs_lba_28_t rlba = lba - libtabfs_bat_getstart(bat);
@@ -288,5 +1311,8 @@ bool libtabfs_bat_isFree(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
             lba, libtabfs_bat_getstart(bat), rlba, bat->__lba, bytepos, bitpos
         );
     #endif
-    return (bat->data[bytepos] & (0x80 >> bitpos)) == 0;
+    LIBTABFS_LOCK(bat->__group->lock);
+    bool free = (*libtabfs_bat_getdata(bat, bytepos) & (0x80 >> bitpos)) == 0;
+    LIBTABFS_UNLOCK(bat->__group->lock);
+    return free;
 }
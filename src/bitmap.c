@@ -0,0 +1,198 @@
+#include "common.h"
+#include "bitmap.h"
+
+#if !defined(LIBTABFS_NO_SIMD) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define LIBTABFS_BITMAP_SIMD_WIDTH  32
+#elif !defined(LIBTABFS_NO_SIMD) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define LIBTABFS_BITMAP_SIMD_WIDTH  16
+#endif
+
+// unaligned 64bit access; the bitmaps live at odd offsets inside their structures
+typedef unsigned long long libtabfs_bitmap_word_t __attribute__((aligned(1), may_alias));
+
+/**
+ * @brief loads 8 bytes of an bitmap so that the first bit of the bitmap ends up as the most significant bit of the word
+ */
+static inline unsigned long long libtabfs_bitmap_load(const unsigned char* p) {
+    unsigned long long w = *((const libtabfs_bitmap_word_t*) p);
+    #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        w = __builtin_bswap64(w);
+    #endif
+    return w;
+}
+
+/**
+ * @brief skips over bytes that are all equal to skip_byte, starting at byte
+ *
+ * @return the first byte that could contain an interesting bit; at most end_byte
+ */
+static inline long libtabfs_bitmap_skip(const unsigned char* map, long byte, long end_byte, unsigned char skip_byte) {
+    #if defined(LIBTABFS_BITMAP_SIMD_WIDTH) && LIBTABFS_BITMAP_SIMD_WIDTH == 32
+        __m256i pattern = _mm256_set1_epi8((char) skip_byte);
+        while (byte + 32 <= end_byte) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (map + byte));
+            if ((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern)) != 0xFFFFFFFFu) {
+                break;
+            }
+            byte += 32;
+        }
+    #elif defined(LIBTABFS_BITMAP_SIMD_WIDTH)
+        __m128i pattern = _mm_set1_epi8((char) skip_byte);
+        while (byte + 16 <= end_byte) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (map + byte));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern)) != 0xFFFF) {
+                break;
+            }
+            byte += 16;
+        }
+    #else
+        unsigned long long pattern = skip_byte ? ~0ULL : 0ULL;
+        while (byte + 32 <= end_byte) {
+            const libtabfs_bitmap_word_t* w = (const libtabfs_bitmap_word_t*) (map + byte);
+            if (((w[0] ^ pattern) | (w[1] ^ pattern) | (w[2] ^ pattern) | (w[3] ^ pattern)) != 0) {
+                break;
+            }
+            byte += 32;
+        }
+    #endif
+    return byte;
+}
+
+/**
+ * @brief shared implementation of find_clear / find_set;
+ * invert is all ones to search for clear bits and zero to search for set bits
+ */
+static long libtabfs_bitmap_find(const unsigned char* map, long from, long to, unsigned long long invert) {
+    if (from >= to) { return to; }
+
+    long byte = from / 8;
+    int bit = from % 8;
+    long end_byte = (to + 7) / 8;
+    unsigned char skip_byte = (unsigned char) invert;
+
+    // whole words
+    while (byte + 8 <= end_byte) {
+        unsigned long long w = libtabfs_bitmap_load(map + byte) ^ invert;
+        w &= ~0ULL >> bit;      // ignore the bits before the start position
+        if (w != 0) {
+            long pos = (byte * 8) + __builtin_clzll(w);
+            return pos < to ? pos : to;
+        }
+        byte = libtabfs_bitmap_skip(map, byte + 8, end_byte, skip_byte);
+        bit = 0;
+    }
+
+    // remaining bytes that dont fill a whole word
+    for (; byte < end_byte; byte++) {
+        unsigned int b = (map[byte] ^ skip_byte) & (0xFFu >> bit);
+        if (b != 0) {
+            long pos = (byte * 8) + (__builtin_clz(b) - ((sizeof(unsigned int) - 1) * 8));
+            return pos < to ? pos : to;
+        }
+        bit = 0;
+    }
+
+    return to;
+}
+
+long libtabfs_bitmap_find_clear(const unsigned char* map, long from, long to) {
+    return libtabfs_bitmap_find(map, from, to, ~0ULL);
+}
+
+long libtabfs_bitmap_find_set(const unsigned char* map, long from, long to) {
+    return libtabfs_bitmap_find(map, from, to, 0ULL);
+}
+
+#if defined(LIBTABFS_BITMAP_SIMD_WIDTH) && LIBTABFS_BITMAP_SIMD_WIDTH == 32
+/**
+ * @brief counts the set bits of 32 bytes at a time; every nibble is looked up in an table of bit counts
+ * and the per-byte counts are summed up by _mm256_sad_epu8
+ *
+ * @return count of set bits in the bytes [byte, end_byte) that where counted; byte is advanced past them
+ */
+static inline long libtabfs_bitmap_popcount_simd(const unsigned char* map, long* byte, long end_byte) {
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+    );
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    __m256i acc = _mm256_setzero_si256();
+    long b = *byte;
+    for (; b + 32 <= end_byte; b += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (map + b));
+        __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+        __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+    *byte = b;
+    return _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1)
+        + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+}
+#endif
+
+long libtabfs_bitmap_count_set(const unsigned char* map, long from, long to) {
+    long count = 0;
+
+    // single bits up to the next byte boundary
+    for (; from < to && (from % 8) != 0; from++) {
+        if (map[from / 8] & (0x80 >> (from % 8))) { count++; }
+    }
+
+    #if defined(LIBTABFS_BITMAP_SIMD_WIDTH) && LIBTABFS_BITMAP_SIMD_WIDTH == 32
+        if ((from % 8) == 0) {
+            long byte = from / 8;
+            count += libtabfs_bitmap_popcount_simd(map, &byte, to / 8);
+            from = byte * 8;
+        }
+    #endif
+
+    for (; from + 64 <= to; from += 64) {
+        count += __builtin_popcountll(*((const libtabfs_bitmap_word_t*) (map + (from / 8))));
+    }
+    for (; from + 8 <= to; from += 8) {
+        count += __builtin_popcount(map[from / 8]);
+    }
+
+    for (; from < to; from++) {
+        if (map[from / 8] & (0x80 >> (from % 8))) { count++; }
+    }
+    return count;
+}
+
+/**
+ * @brief sets or clears the bits of mask inside an byte
+ */
+static inline void libtabfs_bitmap_apply(unsigned char* byte, unsigned char mask, bool set) {
+    if (set) {
+        *byte |= mask;
+    } else {
+        *byte &= ~mask;
+    }
+}
+
+void libtabfs_bitmap_fill(unsigned char* map, long from, long to, bool set) {
+    if (from >= to) { return; }
+
+    long first = from / 8;
+    long last = (to - 1) / 8;
+    unsigned char head = 0xFF >> (from % 8);
+    unsigned char tail = 0xFF << (7 - ((to - 1) % 8));
+    if (first == last) {
+        libtabfs_bitmap_apply(map + first, head & tail, set);
+        return;
+    }
+    libtabfs_bitmap_apply(map + first, head, set);
+    libtabfs_bitmap_apply(map + last, tail, set);
+
+    // whole bytes in between
+    long byte = first + 1;
+    unsigned long long word = set ? ~0ULL : 0ULL;
+    for (; byte + 8 <= last; byte += 8) {
+        *((libtabfs_bitmap_word_t*) (map + byte)) = word;
+    }
+    for (; byte < last; byte++) {
+        map[byte] = (unsigned char) word;
+    }
+}
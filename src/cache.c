@@ -0,0 +1,316 @@
+#include "bridge.h"
+
+#include "common.h"
+#include "cache.h"
+#include "lock.h"
+
+#define LIBTABFS_CACHE_MIN_CAPACITY     64
+
+/**
+ * @brief home slot of an lba; fibonacci hashing (the top bits of lba * 2^32 / phi), so sections that are placed
+ * in an regular stride still spread over the whole table
+ */
+static inline unsigned int libtabfs_cache_home(libtabfs_cache_t* cache, libtabfs_lba_28_t lba) {
+    unsigned int bits = 31 - __builtin_clz(cache->capacity);
+    return (unsigned int) (lba * 2654435769u) >> (32 - bits);
+}
+
+static void libtabfs_cache_alloc_slots(libtabfs_cache_t* cache, unsigned int capacity) {
+    cache->slots = (libtabfs_cache_slot_t*) libtabfs_alloc(sizeof(libtabfs_cache_slot_t) * capacity);
+    libtabfs_memset(cache->slots, 0, sizeof(libtabfs_cache_slot_t) * capacity);
+    cache->capacity = capacity;
+    cache->count = 0;
+}
+
+static void libtabfs_cache_insert(libtabfs_cache_t* cache, libtabfs_cache_node_t* node) {
+    unsigned int mask = cache->capacity - 1;
+    unsigned int i = libtabfs_cache_home(cache, node->lba);
+    while (cache->slots[i].data != NULL) {
+        i = (i + 1) & mask;
+    }
+    cache->slots[i].lba = node->lba;
+    cache->slots[i].data = node->data;
+    cache->slots[i].node = node;
+    cache->count++;
+}
+
+/**
+ * @brief doubles the capacity of an cache and inserts all sections again
+ */
+static void libtabfs_cache_grow(libtabfs_cache_t* cache) {
+    libtabfs_cache_slot_t* old_slots = cache->slots;
+    unsigned int old_capacity = cache->capacity;
+
+    libtabfs_cache_alloc_slots(cache, old_capacity * 2);
+    for (unsigned int i = 0; i < old_capacity; i++) {
+        if (old_slots[i].data != NULL) {
+            libtabfs_cache_insert(cache, old_slots[i].node);
+        }
+    }
+    libtabfs_free(old_slots, sizeof(libtabfs_cache_slot_t) * old_capacity);
+}
+
+static libtabfs_cache_slot_t* libtabfs_cache_find_slot(libtabfs_cache_t* cache, libtabfs_lba_28_t lba) {
+    unsigned int mask = cache->capacity - 1;
+    unsigned int i = libtabfs_cache_home(cache, lba);
+    while (cache->slots[i].data != NULL) {
+        if (cache->slots[i].lba == lba) {
+            return &cache->slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+//--------------------------------------------------------------------------------
+// LRU list
+//--------------------------------------------------------------------------------
+
+static void libtabfs_cache_lru_unlink(libtabfs_cache_t* cache, libtabfs_cache_node_t* node) {
+    if (node->lru_prev != NULL) { node->lru_prev->lru_next = node->lru_next; }
+    else { cache->lru_head = node->lru_next; }
+    if (node->lru_next != NULL) { node->lru_next->lru_prev = node->lru_prev; }
+    else { cache->lru_tail = node->lru_prev; }
+    node->lru_prev = NULL;
+    node->lru_next = NULL;
+}
+
+static void libtabfs_cache_lru_push(libtabfs_cache_t* cache, libtabfs_cache_node_t* node) {
+    node->lru_prev = NULL;
+    node->lru_next = cache->lru_head;
+    if (cache->lru_head != NULL) { cache->lru_head->lru_prev = node; }
+    else { cache->lru_tail = node; }
+    cache->lru_head = node;
+}
+
+/**
+ * @brief marks an section as used right now
+ */
+static void libtabfs_cache_touch(libtabfs_cache_t* cache, libtabfs_cache_node_t* node) {
+    if (cache->budget != NULL) {
+        node->last_use = LIBTABFS_ATOMIC_ADD(cache->budget->clock, 1);
+        node->epoch = LIBTABFS_ATOMIC_LOAD(cache->budget->epoch);
+    }
+    if (node->pins == 0 && cache->lru_head != node) {
+        libtabfs_cache_lru_unlink(cache, node);
+        libtabfs_cache_lru_push(cache, node);
+    }
+}
+
+//--------------------------------------------------------------------------------
+// Cache
+//--------------------------------------------------------------------------------
+
+libtabfs_cache_t* libtabfs_cache_create(libtabfs_free_callback free_callback, libtabfs_cache_budget_t* budget) {
+    libtabfs_cache_t* cache = (libtabfs_cache_t*) libtabfs_alloc(sizeof(libtabfs_cache_t));
+    cache->free_callback = free_callback;
+    cache->budget = budget;
+    libtabfs_cache_alloc_slots(cache, LIBTABFS_CACHE_MIN_CAPACITY);
+    cache->lru_head = NULL;
+    cache->lru_tail = NULL;
+    cache->lock = LIBTABFS_RWLOCK_CREATE();
+
+    if (budget != NULL && budget->cache_count < sizeof(budget->caches) / sizeof(budget->caches[0])) {
+        budget->caches[budget->cache_count++] = cache;
+    }
+    return cache;
+}
+
+void libtabfs_cache_destroy(libtabfs_cache_t* cache) {
+    LIBTABFS_CACHE_FOREACH(cache, slot) {
+        cache->free_callback(slot->data);
+        if (cache->budget != NULL) {
+            cache->budget->bytes -= slot->node->size;
+        }
+        libtabfs_free(slot->node, sizeof(libtabfs_cache_node_t));
+    }
+
+    libtabfs_cache_budget_t* budget = cache->budget;
+    if (budget != NULL) {
+        for (unsigned int i = 0; i < budget->cache_count; i++) {
+            if (budget->caches[i] == cache) {
+                budget->caches[i] = budget->caches[--budget->cache_count];
+                break;
+            }
+        }
+    }
+
+    LIBTABFS_RWLOCK_DESTROY(cache->lock);
+    libtabfs_free(cache->slots, sizeof(libtabfs_cache_slot_t) * cache->capacity);
+    libtabfs_free(cache, sizeof(libtabfs_cache_t));
+}
+
+void* libtabfs_cache_add(libtabfs_cache_t* cache, libtabfs_lba_28_t lba, void* data, unsigned int size) {
+    libtabfs_cache_budget_t* budget = cache->budget;
+    if (budget != NULL && budget->limit != 0 && budget->depth == 0 && budget->bytes + size > budget->limit) {
+        // make room first, so the new section itself is never a candidate
+        unsigned long limit = budget->limit;
+        budget->limit = limit > size ? limit - size : 1;
+        libtabfs_cache_trim(budget);
+        budget->limit = limit;
+    }
+
+    LIBTABFS_LOCK_EXCLUSIVE(cache->lock);
+    libtabfs_cache_slot_t* slot = libtabfs_cache_find_slot(cache, lba);
+    if (slot != NULL) {
+        LIBTABFS_UNLOCK_EXCLUSIVE(cache->lock);
+        return slot->data;
+    }
+
+    // keep the table at most half full, so probe sequences stay short
+    if ((cache->count + 1) * 2 > cache->capacity) {
+        libtabfs_cache_grow(cache);
+    }
+
+    libtabfs_cache_node_t* node = (libtabfs_cache_node_t*) libtabfs_alloc(sizeof(libtabfs_cache_node_t));
+    node->lba = lba;
+    node->data = data;
+    node->size = size;
+    node->pins = 0;
+    node->epoch = 0;
+    node->last_use = 0;
+    libtabfs_cache_insert(cache, node);
+    libtabfs_cache_lru_push(cache, node);
+    libtabfs_cache_touch(cache, node);
+
+    if (budget != NULL) {
+        LIBTABFS_ATOMIC_ADD(budget->bytes, size);
+    }
+    LIBTABFS_UNLOCK_EXCLUSIVE(cache->lock);
+    return data;
+}
+
+void* libtabfs_cache_find(libtabfs_cache_t* cache, libtabfs_lba_28_t lba) {
+    LIBTABFS_LOCK_SHARED(cache->lock);
+    libtabfs_cache_slot_t* slot = libtabfs_cache_find_slot(cache, lba);
+    void* data = slot != NULL ? slot->data : NULL;
+    #ifndef LIBTABFS_THREADSAFE
+        // the lru order only matters for eviction; keeping it would make every lookup an writer
+        if (slot != NULL) {
+            libtabfs_cache_touch(cache, slot->node);
+        }
+    #endif
+    LIBTABFS_UNLOCK_SHARED(cache->lock);
+    return data;
+}
+
+void libtabfs_cache_remove(libtabfs_cache_t* cache, libtabfs_lba_28_t lba) {
+    LIBTABFS_LOCK_EXCLUSIVE(cache->lock);
+    libtabfs_cache_slot_t* slot = libtabfs_cache_find_slot(cache, lba);
+    if (slot == NULL) {
+        LIBTABFS_UNLOCK_EXCLUSIVE(cache->lock);
+        return;
+    }
+
+    libtabfs_cache_node_t* node = slot->node;
+    if (node->pins == 0) {
+        libtabfs_cache_lru_unlink(cache, node);
+    }
+    if (cache->budget != NULL) {
+        LIBTABFS_ATOMIC_ADD(cache->budget->bytes, -(unsigned long) node->size);
+    }
+    libtabfs_free(node, sizeof(libtabfs_cache_node_t));
+
+    // backward shift deletion: move following slots of the same probe sequence into the gap, so no tombstones are needed
+    unsigned int mask = cache->capacity - 1;
+    unsigned int gap = slot - cache->slots;
+    unsigned int j = (gap + 1) & mask;
+    while (cache->slots[j].data != NULL) {
+        unsigned int home = libtabfs_cache_home(cache, cache->slots[j].lba);
+        // the slot can be moved if its home is not inside (gap, j]
+        if (((j - home) & mask) >= ((j - gap) & mask)) {
+            cache->slots[gap] = cache->slots[j];
+            gap = j;
+        }
+        j = (j + 1) & mask;
+    }
+    cache->slots[gap].data = NULL;
+    cache->slots[gap].lba = 0;
+    cache->slots[gap].node = NULL;
+    cache->count--;
+    LIBTABFS_UNLOCK_EXCLUSIVE(cache->lock);
+}
+
+void libtabfs_cache_resize(libtabfs_cache_t* cache, libtabfs_lba_28_t lba, unsigned int size) {
+    LIBTABFS_LOCK_EXCLUSIVE(cache->lock);
+    libtabfs_cache_slot_t* slot = libtabfs_cache_find_slot(cache, lba);
+    if (slot != NULL) {
+        if (cache->budget != NULL) {
+            LIBTABFS_ATOMIC_ADD(cache->budget->bytes, (unsigned long) size - slot->node->size);
+        }
+        slot->node->size = size;
+    }
+    LIBTABFS_UNLOCK_EXCLUSIVE(cache->lock);
+}
+
+void libtabfs_cache_pin(libtabfs_cache_t* cache, libtabfs_lba_28_t lba) {
+    LIBTABFS_LOCK_EXCLUSIVE(cache->lock);
+    libtabfs_cache_slot_t* slot = libtabfs_cache_find_slot(cache, lba);
+    if (slot != NULL && slot->node->pins++ == 0) {
+        libtabfs_cache_lru_unlink(cache, slot->node);
+    }
+    LIBTABFS_UNLOCK_EXCLUSIVE(cache->lock);
+}
+
+void libtabfs_cache_unpin(libtabfs_cache_t* cache, libtabfs_lba_28_t lba) {
+    LIBTABFS_LOCK_EXCLUSIVE(cache->lock);
+    libtabfs_cache_slot_t* slot = libtabfs_cache_find_slot(cache, lba);
+    if (slot != NULL && slot->node->pins != 0 && --slot->node->pins == 0) {
+        libtabfs_cache_lru_push(cache, slot->node);
+        libtabfs_cache_touch(cache, slot->node);
+    }
+    LIBTABFS_UNLOCK_EXCLUSIVE(cache->lock);
+}
+
+//--------------------------------------------------------------------------------
+// Budget
+//--------------------------------------------------------------------------------
+
+void libtabfs_cache_budget_init(libtabfs_cache_budget_t* budget, unsigned long limit) {
+    budget->limit = limit;
+    budget->bytes = 0;
+    budget->clock = 0;
+    budget->epoch = 1;
+    budget->depth = 0;
+    budget->cache_count = 0;
+}
+
+void libtabfs_cache_trim(libtabfs_cache_budget_t* budget) {
+    if (budget == NULL || budget->limit == 0) {
+        return;
+    }
+
+    while (budget->bytes > budget->limit) {
+        // the victim is the oldest lru tail over all caches; sections used in the current epoch are protected,
+        // and since the lists are ordered by use, nothing before such an tail can be evicted either
+        libtabfs_cache_t* victim_cache = NULL;
+        for (unsigned int i = 0; i < budget->cache_count; i++) {
+            libtabfs_cache_node_t* tail = budget->caches[i]->lru_tail;
+            if (tail == NULL || tail->epoch == budget->epoch) {
+                continue;
+            }
+            if (victim_cache == NULL || tail->last_use < victim_cache->lru_tail->last_use) {
+                victim_cache = budget->caches[i];
+            }
+        }
+        if (victim_cache == NULL) {
+            return;
+        }
+
+        void* data = victim_cache->lru_tail->data;
+        libtabfs_cache_remove(victim_cache, victim_cache->lru_tail->lba);
+        victim_cache->free_callback(data);
+    }
+}
+
+void libtabfs_cache_enter(libtabfs_cache_budget_t* budget) {
+    if (budget != NULL && LIBTABFS_ATOMIC_ADD(budget->depth, 1) == 1) {
+        LIBTABFS_ATOMIC_ADD(budget->epoch, 1);
+    }
+}
+
+void libtabfs_cache_leave(libtabfs_cache_budget_t* budget) {
+    if (budget != NULL && LIBTABFS_ATOMIC_ADD(budget->depth, -1) == 0) {
+        libtabfs_cache_trim(budget);
+    }
+}
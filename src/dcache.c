@@ -0,0 +1,106 @@
+#include "bridge.h"
+
+#include "common.h"
+#include "volume.h"
+#include "entrytable.h"
+#include "dirindex.h"
+#include "dcache.h"
+#include "lock.h"
+
+static inline unsigned int libtabfs_dcache_slot_of(libtabfs_dcache_t* dcache, libtabfs_lba_28_t dir_lba, unsigned int hash) {
+    return (hash ^ (dir_lba * 0x9E3779B1u)) & (dcache->capacity - 1);
+}
+
+static bool libtabfs_dcache_matches(libtabfs_dentry_t* dentry, libtabfs_lba_28_t dir_lba, const char* name, int namelen, unsigned int hash) {
+    if (dentry->dir_lba != dir_lba || dentry->hash != hash || dentry->namelen != namelen) {
+        return false;
+    }
+    for (int i = 0; i < namelen; i++) {
+        if (dentry->name[i] != name[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+libtabfs_dcache_t* libtabfs_dcache_create(unsigned int slots) {
+    unsigned int capacity = 1;
+    while (capacity < slots) {
+        capacity *= 2;
+    }
+
+    libtabfs_dcache_t* dcache = (libtabfs_dcache_t*) libtabfs_alloc(sizeof(libtabfs_dcache_t));
+    dcache->slots = (libtabfs_dentry_t*) libtabfs_alloc(sizeof(libtabfs_dentry_t) * capacity);
+    libtabfs_memset(dcache->slots, 0, sizeof(libtabfs_dentry_t) * capacity);
+    dcache->capacity = capacity;
+    dcache->lock = LIBTABFS_RWLOCK_CREATE();
+    return dcache;
+}
+
+void libtabfs_dcache_destroy(libtabfs_dcache_t* dcache) {
+    LIBTABFS_RWLOCK_DESTROY(dcache->lock);
+    libtabfs_free(dcache->slots, sizeof(libtabfs_dentry_t) * dcache->capacity);
+    libtabfs_free(dcache, sizeof(libtabfs_dcache_t));
+}
+
+bool libtabfs_dcache_lookup(
+    libtabfs_dcache_t* dcache, libtabfs_lba_28_t dir_lba, const char* name, int namelen, unsigned int hash,
+    libtabfs_dentry_t* dentry_out
+) {
+    LIBTABFS_LOCK_SHARED(dcache->lock);
+    libtabfs_dentry_t* dentry = &(dcache->slots[libtabfs_dcache_slot_of(dcache, dir_lba, hash)]);
+    bool found = libtabfs_dcache_matches(dentry, dir_lba, name, namelen, hash);
+    if (found) {
+        *dentry_out = *dentry;
+    }
+    LIBTABFS_UNLOCK_SHARED(dcache->lock);
+    return found;
+}
+
+void libtabfs_dcache_insert(
+    libtabfs_dcache_t* dcache, libtabfs_lba_28_t dir_lba, const char* name, int namelen, unsigned int hash,
+    libtabfs_entrytable_t* section, int offset
+) {
+    LIBTABFS_LOCK_EXCLUSIVE(dcache->lock);
+    libtabfs_dentry_t* dentry = &(dcache->slots[libtabfs_dcache_slot_of(dcache, dir_lba, hash)]);
+    dentry->dir_lba = dir_lba;
+    dentry->hash = hash;
+    dentry->lba = section != NULL ? section->__lba : 0;
+    dentry->size = section != NULL ? section->__byteSize : 0;
+    dentry->offset = offset;
+    dentry->namelen = namelen;
+    libtabfs_memcpy(dentry->name, (void*) name, namelen);
+    LIBTABFS_UNLOCK_EXCLUSIVE(dcache->lock);
+}
+
+void libtabfs_dcache_forget(libtabfs_volume_t* volume, libtabfs_lba_28_t dir_lba, char* name) {
+    libtabfs_dcache_t* dcache = volume->__dcache;
+    if (dcache == NULL) {
+        return;
+    }
+
+    unsigned int hash = libtabfs_name_hash(name);
+    LIBTABFS_LOCK_EXCLUSIVE(dcache->lock);
+    libtabfs_dentry_t* dentry = &(dcache->slots[libtabfs_dcache_slot_of(dcache, dir_lba, hash)]);
+    if (libtabfs_dcache_matches(dentry, dir_lba, name, libtabfs_strlen(name), hash)) {
+        dentry->dir_lba = 0;
+    }
+    LIBTABFS_UNLOCK_EXCLUSIVE(dcache->lock);
+}
+
+void libtabfs_dcache_forget_section(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
+    libtabfs_dcache_t* dcache = volume->__dcache;
+    if (dcache == NULL) {
+        return;
+    }
+
+    // removing sections is rare, so its fine to look at every slot
+    LIBTABFS_LOCK_EXCLUSIVE(dcache->lock);
+    for (unsigned int i = 0; i < dcache->capacity; i++) {
+        libtabfs_dentry_t* dentry = &(dcache->slots[i]);
+        if (dentry->dir_lba == lba || (dentry->size != 0 && dentry->lba == lba)) {
+            dentry->dir_lba = 0;
+        }
+    }
+    LIBTABFS_UNLOCK_EXCLUSIVE(dcache->lock);
+}
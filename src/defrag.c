@@ -0,0 +1,375 @@
+#include "bridge.h"
+
+#include "common.h"
+#include "volume.h"
+#include "bat.h"
+#include "entrytable.h"
+#include "fatfile.h"
+#include "defrag.h"
+#ifdef LIBTABFS_DEBUG_PRINTF
+    #include <stdio.h>
+#endif
+
+#define LIBTABFS_DEFRAG_COPY_BLOCKS     16      // blocks copied with one read / write when moving continuous files
+
+//--------------------------------------------------------------------------------
+// Helper
+//--------------------------------------------------------------------------------
+
+static void libtabfs_defrag_push_dir(libtabfs_defrag_t* defrag, libtabfs_lba_28_t lba, unsigned int size) {
+    if (defrag->__dir_count == defrag->__dir_capacity) {
+        unsigned int capacity = defrag->__dir_capacity == 0 ? 16 : defrag->__dir_capacity * 2;
+        libtabfs_defrag_dir_t* dirs = (libtabfs_defrag_dir_t*) libtabfs_alloc(sizeof(libtabfs_defrag_dir_t) * capacity);
+        if (defrag->__dirs != NULL) {
+            libtabfs_memcpy(dirs, defrag->__dirs, sizeof(libtabfs_defrag_dir_t) * defrag->__dir_count);
+            libtabfs_free(defrag->__dirs, sizeof(libtabfs_defrag_dir_t) * defrag->__dir_capacity);
+        }
+        defrag->__dirs = dirs;
+        defrag->__dir_capacity = capacity;
+    }
+    defrag->__dirs[defrag->__dir_count].lba = lba;
+    defrag->__dirs[defrag->__dir_count].size = size;
+    defrag->__dir_count++;
+}
+
+/**
+ * @brief gives back the part of the run that the file in progress didnt got moved into yet
+ */
+static void libtabfs_defrag_release_run(libtabfs_defrag_t* defrag) {
+    if (defrag->__run_count > defrag->__run_done) {
+        libtabfs_bat_freeChainedBlocks(
+            defrag->__volume, defrag->__run_count - defrag->__run_done, defrag->__run_lba + defrag->__run_done
+        );
+    }
+    defrag->__run_count = 0;
+    defrag->__run_done = 0;
+}
+
+static libtabfs_fat_t* libtabfs_defrag_next_fat(libtabfs_fat_t* fat) {
+    if (fat->next_size == 0 || LIBTABFS_IS_INVALID_LBA28(fat->next_section)) {
+        return NULL;
+    }
+    return libtabfs_get_fat_section(fat->__volume, fat->next_section, fat->next_size);
+}
+
+/**
+ * @brief collects the latest entry of every block of an FAT file (the one libtabfs_fat_findlatest would return)
+ *
+ * @param fat the first section of the fat
+ * @param map_out pointer which will be set to an array with one entry per block; only set if the result isnt 0
+ * @param budget every section of the fat costs one unit
+ * @return count of blocks of the file; 0 if it has none, if an index in between is missing (sparse file)
+ *      or if its to big to be moved into one chained run
+ */
+static unsigned int libtabfs_defrag_fat_map(libtabfs_fat_t* fat, libtabfs_fat_entry_t*** map_out, unsigned int* budget) {
+    unsigned int max_index = 0;
+    bool empty = true;
+    for (libtabfs_fat_t* section = fat; section != NULL; section = libtabfs_defrag_next_fat(section)) {
+        if (*budget > 0) { (*budget)--; }
+        int entryCount = (section->__byteSize / 16) - 1;
+        for (int i = 0; i < entryCount; i++) {
+            libtabfs_fat_entry_t* entry = &(section->entries[i]);
+            if (entry->modify_date.i64_data == 0) { continue; }
+            if (empty || entry->index > max_index) { max_index = entry->index; }
+            empty = false;
+        }
+    }
+    if (empty || max_index >= 0xFFFF) {
+        return 0;
+    }
+
+    unsigned int count = max_index + 1;
+    libtabfs_fat_entry_t** map = (libtabfs_fat_entry_t**) libtabfs_alloc(sizeof(libtabfs_fat_entry_t*) * count);
+    libtabfs_memset(map, 0, sizeof(libtabfs_fat_entry_t*) * count);
+    for (libtabfs_fat_t* section = fat; section != NULL; section = libtabfs_defrag_next_fat(section)) {
+        int entryCount = (section->__byteSize / 16) - 1;
+        for (int i = 0; i < entryCount; i++) {
+            libtabfs_fat_entry_t* entry = &(section->entries[i]);
+            if (entry->modify_date.i64_data == 0) { continue; }
+            libtabfs_fat_entry_t* latest = map[entry->index];
+            if (latest == NULL || entry->modify_date.i64_data > latest->modify_date.i64_data) {
+                map[entry->index] = entry;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (map[i] == NULL) {
+            libtabfs_free(map, sizeof(libtabfs_fat_entry_t*) * count);
+            return 0;
+        }
+    }
+    *map_out = map;
+    return count;
+}
+
+//--------------------------------------------------------------------------------
+// Moving files
+//--------------------------------------------------------------------------------
+
+/**
+ * @brief moves the blocks of an FAT file into one chained run; the run is allocated on the first call for an file
+ * and filled over as many steps as needed
+ *
+ * @return true if the file is done with, false if the budget ran out before all blocks where moved
+ */
+static bool libtabfs_defrag_fatfile(
+    libtabfs_defrag_t* defrag, libtabfs_entrytable_entry_t* entry, unsigned int* budget, unsigned char* buffer
+) {
+    libtabfs_volume_t* volume = defrag->__volume;
+    libtabfs_fat_t* fat = libtabfs_get_fat_section(volume, entry->data.lba_and_size.lba, entry->data.lba_and_size.size);
+
+    // the entry was changed since the last step; the blocks moved so far belong to the file anyway
+    if (defrag->__run_count != 0 && defrag->__run_fat_lba != fat->__lba) {
+        libtabfs_defrag_release_run(defrag);
+    }
+
+    libtabfs_fat_entry_t** map = NULL;
+    unsigned int count = libtabfs_defrag_fat_map(fat, &map, budget);
+    if (count == 0) {
+        libtabfs_defrag_release_run(defrag);
+        return true;
+    }
+
+    if (defrag->__run_count == 0) {
+        bool fragmented = false;
+        for (unsigned int i = 1; i < count && !fragmented; i++) {
+            fragmented = map[i]->lba != map[i - 1]->lba + 1;
+        }
+        if (!fragmented) {
+            libtabfs_free(map, sizeof(libtabfs_fat_entry_t*) * count);
+            return true;
+        }
+
+        // same place libtabfs_fat_goal would choose for the first block
+        libtabfs_lba_28_t goal = fat->__lba + (fat->__byteSize / volume->blockSize);
+        libtabfs_lba_28_t run = libtabfs_bat_allocateChainedBlocksAt(volume, count, goal);
+        if (LIBTABFS_IS_INVALID_LBA28(run)) {
+            defrag->files_skipped++;
+            libtabfs_free(map, sizeof(libtabfs_fat_entry_t*) * count);
+            return true;
+        }
+
+        #ifdef LIBTABFS_DEBUG_PRINTF
+            printf("[libtabfs_defrag] moving %u blocks of the fat at 0x%x to 0x%x\n", count, fat->__lba, run);
+        #endif
+
+        defrag->__run_fat_lba = fat->__lba;
+        defrag->__run_lba = run;
+        defrag->__run_count = count;
+        defrag->__run_done = 0;
+    }
+
+    // blocks written after the run was taken stay where they are
+    unsigned int end = count < defrag->__run_count ? count : defrag->__run_count;
+    unsigned int moving = end > defrag->__run_done ? end - defrag->__run_done : 0;
+    if (moving > *budget) {
+        // at least one block per step, even if looking at the fat used up the budget
+        moving = *budget > 0 ? *budget : 1;
+    }
+
+    long long* old_lbas = (long long*) libtabfs_alloc(sizeof(long long) * (moving > 0 ? moving : 1));
+    unsigned int old_count = 0;
+    for (unsigned int i = 0; i < moving; i++) {
+        libtabfs_fat_entry_t* fatentry = map[defrag->__run_done];
+        libtabfs_lba_28_t target = defrag->__run_lba + defrag->__run_done;
+
+        libtabfs_read_device(volume->__dev_data, fatentry->lba, volume->flags.absolute_lbas, 0, buffer, volume->blockSize);
+        libtabfs_write_device(volume->__dev_data, target, volume->flags.absolute_lbas, 0, buffer, volume->blockSize);
+
+        old_lbas[old_count++] = fatentry->lba;
+        fatentry->lba = target;
+        defrag->__run_done++;
+        defrag->blocks_moved++;
+        if (*budget > 0) { (*budget)--; }
+    }
+
+    // the old blocks can only be reused once no fat on disk points to them anymore
+    if (old_count > 0) {
+        for (libtabfs_fat_t* section = fat; section != NULL; section = libtabfs_defrag_next_fat(section)) {
+            libtabfs_fat_sync(section);
+        }
+        libtabfs_bat_freeLoseBlocks(volume, old_count, old_lbas);
+    }
+    libtabfs_free(old_lbas, sizeof(long long) * (moving > 0 ? moving : 1));
+    libtabfs_free(map, sizeof(libtabfs_fat_entry_t*) * count);
+
+    if (defrag->__run_done < end) {
+        return false;
+    }
+    libtabfs_defrag_release_run(defrag);
+    defrag->files_moved++;
+    return true;
+}
+
+/**
+ * @brief moves an continuous file into the first hole before it that can hold it
+ *
+ * @return true if the file is done with, false if it needs to wait for the next step with an fresh budget
+ */
+static bool libtabfs_defrag_continuousfile(
+    libtabfs_defrag_t* defrag, libtabfs_entrytable_t* section, libtabfs_entrytable_entry_t* entry,
+    unsigned int* budget, unsigned int step_budget, unsigned char* buffer
+) {
+    libtabfs_volume_t* volume = defrag->__volume;
+    unsigned long int blocks = entry->data.lba_and_size.size / volume->blockSize;
+    if ((entry->data.lba_and_size.size % volume->blockSize) != 0) {
+        blocks += 1;
+    }
+    if (blocks == 0 || blocks > 0xFFFF || blocks > step_budget) {
+        return true;
+    }
+    if (blocks > *budget) {
+        return false;
+    }
+
+    libtabfs_lba_28_t old_lba = entry->data.lba_and_size.lba;
+    libtabfs_lba_28_t lba = libtabfs_bat_allocateChainedBlocksAt(volume, blocks, volume->min_LBA);
+    if (LIBTABFS_IS_INVALID_LBA28(lba)) {
+        return true;
+    }
+    if (lba >= old_lba) {
+        // no hole before the file
+        libtabfs_bat_freeChainedBlocks(volume, blocks, lba);
+        return true;
+    }
+
+    #ifdef LIBTABFS_DEBUG_PRINTF
+        printf("[libtabfs_defrag] moving continuous file with %lu blocks from 0x%x to 0x%x\n", blocks, old_lba, lba);
+    #endif
+
+    for (unsigned long int i = 0; i < blocks; i += LIBTABFS_DEFRAG_COPY_BLOCKS) {
+        unsigned long int n = blocks - i < LIBTABFS_DEFRAG_COPY_BLOCKS ? blocks - i : LIBTABFS_DEFRAG_COPY_BLOCKS;
+        libtabfs_read_device(volume->__dev_data, old_lba + i, volume->flags.absolute_lbas, 0, buffer, n * volume->blockSize);
+        libtabfs_write_device(volume->__dev_data, lba + i, volume->flags.absolute_lbas, 0, buffer, n * volume->blockSize);
+    }
+
+    entry->data.lba_and_size.lba = lba;
+    libtabfs_entrytable_sync(section);
+    libtabfs_bat_freeChainedBlocks(volume, blocks, old_lba);
+
+    defrag->files_moved++;
+    defrag->blocks_moved += blocks;
+    *budget -= blocks;
+    return true;
+}
+
+//--------------------------------------------------------------------------------
+// Defragmentation passes
+//--------------------------------------------------------------------------------
+
+libtabfs_defrag_t* libtabfs_defrag_create(libtabfs_volume_t* volume) {
+    libtabfs_defrag_t* defrag = (libtabfs_defrag_t*) libtabfs_alloc(sizeof(libtabfs_defrag_t));
+    defrag->__volume = volume;
+    defrag->__dirs = NULL;
+    defrag->__dir_count = 0;
+    defrag->__dir_capacity = 0;
+    defrag->__section_lba = volume->__root_table->__lba;
+    defrag->__section_size = volume->__root_table->__byteSize;
+    defrag->__offset = 1;
+    defrag->__run_fat_lba = 0;
+    defrag->__run_lba = 0;
+    defrag->__run_count = 0;
+    defrag->__run_done = 0;
+    defrag->done = false;
+    defrag->files_moved = 0;
+    defrag->files_skipped = 0;
+    defrag->blocks_moved = 0;
+    return defrag;
+}
+
+libtabfs_error libtabfs_defrag_step(libtabfs_defrag_t* defrag, unsigned int budget, bool* done_out) {
+    if (defrag == NULL) { return LIBTABFS_ERR_ARGS; }
+
+    libtabfs_volume_t* volume = defrag->__volume;
+    int buffer_size = LIBTABFS_DEFRAG_COPY_BLOCKS * volume->blockSize;
+    unsigned char* buffer = (unsigned char*) libtabfs_alloc(buffer_size);
+
+    // sections loaded by this step stay cached until its end
+    libtabfs_cache_enter(volume->__cache_budget);
+
+    unsigned int left = budget;
+    while (!defrag->done && left > 0) {
+        if (defrag->__section_size == 0) {
+            if (defrag->__dir_count == 0) {
+                defrag->done = true;
+                break;
+            }
+            defrag->__dir_count--;
+            defrag->__section_lba = defrag->__dirs[defrag->__dir_count].lba;
+            defrag->__section_size = defrag->__dirs[defrag->__dir_count].size;
+            defrag->__offset = 1;
+            left--;
+        }
+
+        libtabfs_entrytable_t* section = libtabfs_get_entrytable(volume, defrag->__section_lba, defrag->__section_size);
+
+        int entryCount = section->__byteSize / 64;
+        while (defrag->__offset < entryCount && left > 0) {
+            libtabfs_entrytable_entry_t* entry = &(section->entries[defrag->__offset]);
+
+            // entries can be created in the directory while its not locked
+            void* dir_lock = libtabfs_entrytable_lock(section, false);
+            libtabfs_entrytable_entry_t current = *entry;
+            libtabfs_entrytable_unlock(dir_lock, false);
+
+            bool finished = true;
+            switch (current.flags.type) {
+                case LIBTABFS_ENTRYTYPE_DIR:
+                    if (current.data.dir.size != 0) {
+                        libtabfs_defrag_push_dir(defrag, current.data.dir.lba, current.data.dir.size);
+                    }
+                    break;
+                case LIBTABFS_ENTRYTYPE_FILE_FAT: {
+                    void* file_lock = libtabfs_fatfile_lock(volume, entry, true);
+                    finished = libtabfs_defrag_fatfile(defrag, entry, &left, buffer);
+                    libtabfs_fatfile_unlock(file_lock, true);
+                    break;
+                }
+                case LIBTABFS_ENTRYTYPE_FILE_CONTINUOUS: {
+                    // the entry is changed and its section synced, and reads of the file need to wait for the move
+                    dir_lock = libtabfs_entrytable_lock(section, true);
+                    void* file_lock = libtabfs_continuousfile_lock(volume, entry, dir_lock, true);
+                    finished = libtabfs_defrag_continuousfile(defrag, section, entry, &left, budget, buffer);
+                    libtabfs_continuousfile_unlock(file_lock, true);
+                    libtabfs_entrytable_unlock(dir_lock, true);
+                    break;
+                }
+            }
+            if (!finished) { break; }
+            defrag->__offset++;
+        }
+        if (defrag->__offset < entryCount) {
+            // out of budget
+            break;
+        }
+
+        // continue with the next section of the same directory
+        void* dir_lock = libtabfs_entrytable_lock(section, false);
+        libtabfs_entrytable_t* next_section = libtabfs_entrytable_nextsection(section);
+        libtabfs_entrytable_unlock(dir_lock, false);
+        if (next_section != NULL) {
+            defrag->__section_lba = next_section->__lba;
+            defrag->__section_size = next_section->__byteSize;
+            if (left > 0) { left--; }
+        }
+        else {
+            defrag->__section_size = 0;
+        }
+        defrag->__offset = 1;
+    }
+
+    libtabfs_cache_leave(volume->__cache_budget);
+    libtabfs_free(buffer, buffer_size);
+    if (done_out != NULL) { *done_out = defrag->done; }
+    return LIBTABFS_ERR_NONE;
+}
+
+void libtabfs_defrag_destroy(libtabfs_defrag_t* defrag) {
+    if (defrag == NULL) { return; }
+    libtabfs_defrag_release_run(defrag);
+    if (defrag->__dirs != NULL) {
+        libtabfs_free(defrag->__dirs, sizeof(libtabfs_defrag_dir_t) * defrag->__dir_capacity);
+    }
+    libtabfs_free(defrag, sizeof(libtabfs_defrag_t));
+}
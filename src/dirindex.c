@@ -0,0 +1,225 @@
+#include "bridge.h"
+
+#include "common.h"
+#include "volume.h"
+#include "entrytable.h"
+#include "dirindex.h"
+#include "lock.h"
+
+#define LIBTABFS_DIRINDEX_MIN_CAPACITY  16
+
+#define LIBTABFS_DIRINDEX_BYTES(index)  (sizeof(libtabfs_dirindex_t) + sizeof(libtabfs_dirindex_slot_t) * (index)->capacity)
+
+unsigned int libtabfs_name_hash(char* name) {
+    return libtabfs_name_hash_n(name, libtabfs_strlen(name));
+}
+
+unsigned int libtabfs_name_hash_n(const char* name, int namelen) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < namelen; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void libtabfs_dirindex_alloc_slots(libtabfs_dirindex_t* index, unsigned int capacity) {
+    index->slots = (libtabfs_dirindex_slot_t*) libtabfs_alloc(sizeof(libtabfs_dirindex_slot_t) * capacity);
+    libtabfs_memset(index->slots, 0, sizeof(libtabfs_dirindex_slot_t) * capacity);
+    index->capacity = capacity;
+    index->count = 0;
+}
+
+static void libtabfs_dirindex_insert(libtabfs_dirindex_t* index, libtabfs_dirindex_slot_t* record) {
+    unsigned int mask = index->capacity - 1;
+    unsigned int i = record->hash & mask;
+    while (index->slots[i].size != 0) {
+        i = (i + 1) & mask;
+    }
+    index->slots[i] = *record;
+    index->count++;
+}
+
+static void libtabfs_dirindex_put(libtabfs_dirindex_t* index, unsigned int hash, libtabfs_entrytable_t* section, int offset) {
+    // keep the table at most half full, so probe sequences stay short
+    if ((index->count + 1) * 2 > index->capacity) {
+        libtabfs_dirindex_slot_t* old_slots = index->slots;
+        unsigned int old_capacity = index->capacity;
+
+        libtabfs_dirindex_alloc_slots(index, old_capacity * 2);
+        for (unsigned int i = 0; i < old_capacity; i++) {
+            if (old_slots[i].size != 0) {
+                libtabfs_dirindex_insert(index, &old_slots[i]);
+            }
+        }
+        libtabfs_free(old_slots, sizeof(libtabfs_dirindex_slot_t) * old_capacity);
+    }
+
+    libtabfs_dirindex_slot_t record = { .hash = hash, .lba = section->__lba, .size = section->__byteSize, .offset = offset };
+    libtabfs_dirindex_insert(index, &record);
+}
+
+libtabfs_dirindex_t* libtabfs_dirindex_get(libtabfs_entrytable_t* first_section) {
+    libtabfs_volume_t* volume = first_section->__volume;
+    libtabfs_dirindex_t* index = (libtabfs_dirindex_t*) libtabfs_cache_find(volume->__dir_indexes, first_section->__lba);
+    if (index != NULL) {
+        return index;
+    }
+
+    index = (libtabfs_dirindex_t*) libtabfs_alloc(sizeof(libtabfs_dirindex_t));
+    index->lba = first_section->__lba;
+    libtabfs_dirindex_alloc_slots(index, LIBTABFS_DIRINDEX_MIN_CAPACITY);
+
+    libtabfs_entrytable_t* section = first_section;
+    while (section != NULL) {
+        int entryCount = section->__byteSize / 64;
+        for (int i = 1; i < entryCount; i++) {
+            libtabfs_entrytable_entry_t* entry = &(section->entries[i]);
+            if (
+                entry->flags.type == LIBTABFS_ENTRYTYPE_UNKNOWN ||
+                entry->flags.type == LIBTABFS_ENTRYTYPE_LONGNAME ||
+                entry->flags.type == LIBTABFS_ENTRYTYPE_TABLEINFO
+            ) {
+                continue;
+            }
+
+            unsigned int hash = 0;
+            if (libtabfs_entry_name_hash(volume, entry, &hash) != LIBTABFS_ERR_NONE) {
+                continue;
+            }
+            libtabfs_dirindex_put(index, hash, section, i);
+        }
+        section = libtabfs_entrytable_nextsection(section);
+    }
+
+    // readers build the index under the shared lock of the directory; so an other thread might have been faster
+    libtabfs_dirindex_t* cached = (libtabfs_dirindex_t*) libtabfs_cache_add(
+        volume->__dir_indexes, index->lba, index, LIBTABFS_DIRINDEX_BYTES(index)
+    );
+    if (cached != index) {
+        libtabfs_dirindex_destroy(index);
+    }
+    return cached;
+}
+
+libtabfs_error libtabfs_dirindex_lookup(
+    libtabfs_entrytable_t* first_section, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    if (entry_out == NULL) { return LIBTABFS_ERR_ARGS; }
+    *entry_out = NULL;
+
+    libtabfs_volume_t* volume = first_section->__volume;
+    libtabfs_dirindex_t* index = libtabfs_dirindex_get(first_section);
+
+    unsigned int hash = libtabfs_name_hash_n(name, namelen);
+    unsigned int mask = index->capacity - 1;
+    for (unsigned int i = hash & mask; index->slots[i].size != 0; i = (i + 1) & mask) {
+        libtabfs_dirindex_slot_t* slot = &(index->slots[i]);
+        if (slot->hash != hash) {
+            continue;
+        }
+
+        libtabfs_entrytable_t* section = libtabfs_get_entrytable(volume, slot->lba, slot->size);
+        libtabfs_entrytable_entry_t* entry = &(section->entries[slot->offset]);
+        if (libtabfs_entry_has_name(volume, entry, name, namelen, hash)) {
+            *entry_out = entry;
+            if (entrytable_out != NULL) { *entrytable_out = section; }
+            if (offset_out != NULL) { *offset_out = slot->offset; }
+            return LIBTABFS_ERR_NONE;
+        }
+    }
+
+    return LIBTABFS_ERR_NONE;
+}
+
+void libtabfs_dirindex_add(libtabfs_entrytable_t* first_section, char* name, libtabfs_entrytable_t* section, int offset) {
+    libtabfs_volume_t* volume = first_section->__volume;
+    libtabfs_dirindex_t* index = (libtabfs_dirindex_t*) libtabfs_cache_find(volume->__dir_indexes, first_section->__lba);
+    if (index == NULL) {
+        return;
+    }
+    unsigned int capacity = index->capacity;
+    libtabfs_dirindex_put(index, libtabfs_name_hash(name), section, offset);
+    if (index->capacity != capacity) {
+        libtabfs_cache_resize(volume->__dir_indexes, index->lba, LIBTABFS_DIRINDEX_BYTES(index));
+    }
+}
+
+void libtabfs_dirindex_remove(libtabfs_entrytable_t* first_section, char* name, libtabfs_entrytable_t* section, int offset) {
+    libtabfs_volume_t* volume = first_section->__volume;
+    libtabfs_dirindex_t* index = (libtabfs_dirindex_t*) libtabfs_cache_find(volume->__dir_indexes, first_section->__lba);
+    if (index == NULL) {
+        return;
+    }
+
+    unsigned int hash = libtabfs_name_hash(name);
+    unsigned int mask = index->capacity - 1;
+    unsigned int i = hash & mask;
+    while (index->slots[i].size != 0) {
+        libtabfs_dirindex_slot_t* slot = &(index->slots[i]);
+        if (slot->hash == hash && slot->lba == section->__lba && slot->offset == (unsigned int) offset) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    if (index->slots[i].size == 0) {
+        return;
+    }
+
+    // backward shift deletion; same as in the cache
+    unsigned int gap = i;
+    unsigned int j = (i + 1) & mask;
+    while (index->slots[j].size != 0) {
+        unsigned int home = index->slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - gap) & mask)) {
+            index->slots[gap] = index->slots[j];
+            gap = j;
+        }
+        j = (j + 1) & mask;
+    }
+    index->slots[gap].size = 0;
+    index->count--;
+}
+
+void libtabfs_dirindex_drop(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
+    libtabfs_dirindex_t* index = (libtabfs_dirindex_t*) libtabfs_cache_find(volume->__dir_indexes, lba);
+    if (index != NULL) {
+        libtabfs_cache_remove(volume->__dir_indexes, lba);
+        libtabfs_dirindex_destroy(index);
+    }
+}
+
+void libtabfs_dirindex_forget_section(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
+    // removing sections is rare, so its fine to look at every record of every index
+    LIBTABFS_LOCK_EXCLUSIVE(volume->__dir_indexes->lock);
+    LIBTABFS_CACHE_FOREACH(volume->__dir_indexes, cached) {
+        libtabfs_dirindex_t* index = (libtabfs_dirindex_t*) cached->data;
+        bool stale = false;
+        for (unsigned int i = 0; i < index->capacity && !stale; i++) {
+            stale = index->slots[i].size != 0 && index->slots[i].lba == lba;
+        }
+        if (!stale) {
+            continue;
+        }
+
+        // build the table again without them; simpler than an backward shift for every record
+        libtabfs_dirindex_slot_t* old_slots = index->slots;
+        unsigned int old_capacity = index->capacity;
+        libtabfs_dirindex_alloc_slots(index, old_capacity);
+        for (unsigned int i = 0; i < old_capacity; i++) {
+            if (old_slots[i].size != 0 && old_slots[i].lba != lba) {
+                libtabfs_dirindex_insert(index, &old_slots[i]);
+            }
+        }
+        libtabfs_free(old_slots, sizeof(libtabfs_dirindex_slot_t) * old_capacity);
+    }
+    LIBTABFS_UNLOCK_EXCLUSIVE(volume->__dir_indexes->lock);
+}
+
+void libtabfs_dirindex_destroy(libtabfs_dirindex_t* index) {
+    libtabfs_free(index->slots, sizeof(libtabfs_dirindex_slot_t) * index->capacity);
+    libtabfs_free(index, sizeof(libtabfs_dirindex_t));
+}
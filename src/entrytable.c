@@ -3,7 +3,12 @@
 #include "common.h"
 #include "volume.h"
 #include "bat.h"
+#include "bitmap.h"
 #include "entrytable.h"
+#include "dirindex.h"
+#include "hashdir.h"
+#include "dcache.h"
+#include "lock.h"
 #ifdef LIBTABFS_DEBUG_PRINTF
     #include <stdio.h>
 #endif
@@ -12,7 +17,10 @@
 // Entrytable creation, sync & destroying
 //--------------------------------------------------------------------------------
 
-#define LIBTABFS_ENTRYTABLE_DATAOFFSET  (LIBTABFS_PTR_SIZE) + sizeof(unsigned int) + sizeof(libtabfs_lba_28_t)
+#define LIBTABFS_ENTRYTABLE_DATAOFFSET  (LIBTABFS_PTR_SIZE) + sizeof(unsigned int) + sizeof(libtabfs_lba_28_t) \
+    + (LIBTABFS_PTR_SIZE) + sizeof(libtabfs_lba_28_t) + sizeof(unsigned int)
+
+#define LIBTABFS_ENTRYTABLE_USEDMAPSIZE(table)  ((((table)->__byteSize / 64) + 7) / 8)
 
 #define LIBTABFS_GET_TABLEINFO(table)   ((libtabfs_entrytable_tableinfo_t*) &( (table)->entries[0] ))
 
@@ -29,11 +37,19 @@ libtabfs_entrytable_t* libtabfs_read_entrytable(libtabfs_volume_t* volume, libta
     entrytable->__volume = volume;
     entrytable->__lba = lba;
     entrytable->__byteSize = size;
+    entrytable->__used_map = NULL;
+    entrytable->__free_hint_lba = 0;
+    entrytable->__free_hint_size = 0;
 
-    // add the table to our cache!
-    libtabfs_linkedlist_add(volume->__table_cache, entrytable);
+    // add the table to our cache! if an other thread read it at the same time, its copy wins
+    libtabfs_entrytable_t* cached = (libtabfs_entrytable_t*) libtabfs_cache_add(
+        volume->__table_cache, lba, entrytable, LIBTABFS_ENTRYTABLE_DATAOFFSET + size
+    );
+    if (cached != entrytable) {
+        libtabfs_free(entrytable, LIBTABFS_ENTRYTABLE_DATAOFFSET + size);
+    }
 
-    return entrytable;
+    return cached;
 }
 
 libtabfs_entrytable_t* libtabfs_get_entrytable(libtabfs_volume_t* volume, libtabfs_lba_28_t lba, unsigned int size) {
@@ -54,9 +70,13 @@ libtabfs_entrytable_t* libtabfs_create_entrytable(
     entrytable->__volume = volume;
     entrytable->__lba = lba;
     entrytable->__byteSize = size;
+    entrytable->__used_map = NULL;
+    entrytable->__free_hint_lba = 0;
+    entrytable->__free_hint_size = 0;
 
-    // configure tabinfo entry
+    // configure tabinfo entry; cleared first, so the links and the format are never left over from the allocation
     libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(entrytable);
+    libtabfs_memset(tabinfo, 0, sizeof(libtabfs_entrytable_tableinfo_t));
     tabinfo->flags.type = LIBTABFS_ENTRYTYPE_TABLEINFO;
 
     // set the parent information
@@ -64,15 +84,22 @@ libtabfs_entrytable_t* libtabfs_create_entrytable(
     tabinfo->parent_size = parent_table->__byteSize;
 
     // add the table to our cache!
-    libtabfs_linkedlist_add(volume->__table_cache, entrytable);
+    libtabfs_cache_add(volume->__table_cache, lba, entrytable, LIBTABFS_ENTRYTABLE_DATAOFFSET + size);
 
     // TODO: clear and flush to disk to ensure we have an empty entrytable created!
     return entrytable;
 }
 
+static void libtabfs_entrytable_free(libtabfs_entrytable_t* entrytable) {
+    if (entrytable->__used_map != NULL) {
+        libtabfs_free(entrytable->__used_map, LIBTABFS_ENTRYTABLE_USEDMAPSIZE(entrytable));
+    }
+    libtabfs_free(entrytable, LIBTABFS_ENTRYTABLE_DATAOFFSET + entrytable->__byteSize);
+}
+
 void libtabfs_entrytable_cachefree_callback(libtabfs_entrytable_t* entrytable) {
     libtabfs_entrytable_sync(entrytable);
-    libtabfs_free(entrytable, LIBTABFS_ENTRYTABLE_DATAOFFSET + entrytable->__byteSize);
+    libtabfs_entrytable_free(entrytable);
 }
 
 void libtabfs_entrytable_destroy(libtabfs_entrytable_t* entrytable) {
@@ -80,19 +107,25 @@ void libtabfs_entrytable_destroy(libtabfs_entrytable_t* entrytable) {
     libtabfs_entrytable_sync(entrytable);
 
     // removes the entry from the tablecache
-    libtabfs_linkedlist_remove_data(entrytable->__volume->__table_cache, entrytable);
+    libtabfs_cache_remove(entrytable->__volume->__table_cache, entrytable->__lba);
 
-    libtabfs_free(entrytable, LIBTABFS_ENTRYTABLE_DATAOFFSET + entrytable->__byteSize);
+    libtabfs_entrytable_free(entrytable);
 }
 
 void libtabfs_entrytable_remove(libtabfs_entrytable_t* entrytable) {
+    // if this is the first section of an directory, its index, bucket table and dentries are gone with it;
+    // otherwise the index of its directory still has records pointing into it
+    libtabfs_dirindex_drop(entrytable->__volume, entrytable->__lba);
+    libtabfs_dirindex_forget_section(entrytable->__volume, entrytable->__lba);
+    libtabfs_hashdir_remove(entrytable);
+    libtabfs_dcache_forget_section(entrytable->__volume, entrytable->__lba);
     libtabfs_bat_freeChainedBlocks(
         entrytable->__volume,
         entrytable->__byteSize / entrytable->__volume->blockSize,
         entrytable->__lba
     );
-    libtabfs_linkedlist_remove_data(entrytable->__volume->__table_cache, entrytable);
-    libtabfs_free(entrytable, LIBTABFS_ENTRYTABLE_DATAOFFSET + entrytable->__byteSize);
+    libtabfs_cache_remove(entrytable->__volume->__table_cache, entrytable->__lba);
+    libtabfs_entrytable_free(entrytable);
 }
 
 void libtabfs_entrytable_sync(libtabfs_entrytable_t* entrytable) {
@@ -147,17 +180,43 @@ void libtabfs_entry_touch(libtabfs_entrytable_entry_t* entry, libtabfs_time_t m_
 }
 
 libtabfs_entrytable_t* libtabfs_find_cached_entrytable(libtabfs_volume_t* volume, libtabfs_lba_28_t entrytable_lba) {
-    libtabfs_linkedlist_entry_t* entry = volume->__table_cache->head;
-    while (entry != NULL) {
-        libtabfs_entrytable_t* tab = (libtabfs_entrytable_t*) entry->data;
-        if (tab->__lba == entrytable_lba) {
-            return tab;
-        }
-        else {
-            entry = entry->next;
-        }
+    return (libtabfs_entrytable_t*) libtabfs_cache_find(volume->__table_cache, entrytable_lba);
+}
+
+void libtabfs_entrytable_pin(libtabfs_entrytable_t* entrytable) {
+    libtabfs_cache_pin(entrytable->__volume->__table_cache, entrytable->__lba);
+}
+
+void libtabfs_entrytable_unpin(libtabfs_entrytable_t* entrytable) {
+    libtabfs_cache_unpin(entrytable->__volume->__table_cache, entrytable->__lba);
+}
+
+void libtabfs_entrytable_release(libtabfs_entrytable_t* entrytable) {
+    if (entrytable != NULL) {
+        libtabfs_entrytable_unpin(entrytable);
     }
-    return NULL;
+}
+
+/**
+ * @brief pins the section of an entry an call hands out, before the call ends and the cache is trimmed;
+ * the caller releases it with libtabfs_entrytable_release
+ */
+static inline libtabfs_error libtabfs_entrytable_hand_out(
+    libtabfs_error err, libtabfs_entrytable_entry_t** entry_out, libtabfs_entrytable_t** entrytable_out
+) {
+    if (err == LIBTABFS_ERR_NONE && entry_out != NULL && *entry_out != NULL && entrytable_out != NULL) {
+        libtabfs_entrytable_pin(*entrytable_out);
+    }
+    return err;
+}
+
+/**
+ * @brief starts an call that works on an entrytable section; the section counts as used by the call,
+ * so it stays in the tablecache until the end of the next one
+ */
+static inline void libtabfs_entrytable_call_enter(libtabfs_entrytable_t* entrytable) {
+    libtabfs_cache_enter(entrytable->__volume->__cache_budget);
+    libtabfs_cache_find(entrytable->__volume->__table_cache, entrytable->__lba);
 }
 
 libtabfs_entrytable_t* libtabfs_entrytable_get_first_section(libtabfs_entrytable_t* section) {
@@ -173,6 +232,44 @@ libtabfs_entrytable_t* libtabfs_entrytable_get_first_section(libtabfs_entrytable
     return section;
 }
 
+void* libtabfs_entrytable_lock(libtabfs_entrytable_t* section, bool exclusive) {
+    #ifdef LIBTABFS_THREADSAFE
+        // the prev-links only change under the lock, but they always lead to the same first section
+        libtabfs_entrytable_t* first_section = libtabfs_entrytable_get_first_section(section);
+        void* lock = libtabfs_volume_object_lock(section->__volume, first_section->__lba);
+        if (exclusive) { LIBTABFS_LOCK_EXCLUSIVE(lock); }
+        else { LIBTABFS_LOCK_SHARED(lock); }
+        return lock;
+    #else
+        return NULL;
+    #endif
+}
+
+void libtabfs_entrytable_unlock(void* lock, bool exclusive) {
+    if (exclusive) { LIBTABFS_UNLOCK_EXCLUSIVE(lock); }
+    else { LIBTABFS_UNLOCK_SHARED(lock); }
+}
+
+void* libtabfs_continuousfile_lock(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, void* held, bool exclusive) {
+    // entries stay at the same place as long as locks are used, since nothing is evicted then
+    void* lock = libtabfs_volume_object_lock(
+        volume, (libtabfs_lba_28_t) ((unsigned long) entry / sizeof(libtabfs_entrytable_entry_t))
+    );
+    if (lock == NULL || lock == held) {
+        return NULL;
+    }
+    if (exclusive) { LIBTABFS_LOCK_EXCLUSIVE(lock); }
+    else { LIBTABFS_LOCK_SHARED(lock); }
+    return lock;
+}
+
+void libtabfs_continuousfile_unlock(void* lock, bool exclusive) {
+    if (lock != NULL) {
+        if (exclusive) { LIBTABFS_UNLOCK_EXCLUSIVE(lock); }
+        else { LIBTABFS_UNLOCK_SHARED(lock); }
+    }
+}
+
 libtabfs_entrytable_t* libtabfs_entrytable_get_parent(libtabfs_entrytable_t* section) {
     libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(section);
     if (tabinfo->parent_size != 0 && !LIBTABFS_IS_INVALID_LBA28(tabinfo->parent_lba)) {
@@ -193,7 +290,76 @@ libtabfs_entrytable_t* libtabfs_entrytable_nextsection(libtabfs_entrytable_t* se
     }
 }
 
-libtabfs_error libtabfs_entrytab_findfree(
+int libtabfs_entrytable_first_free(libtabfs_entrytable_t* section) {
+    int entryCount = section->__byteSize / 64;
+    unsigned char* map = section->__used_map;
+    if (map == NULL) {
+        // entry 0 is the tableinfo
+        map = (unsigned char*) libtabfs_alloc(LIBTABFS_ENTRYTABLE_USEDMAPSIZE(section));
+        libtabfs_memset(map, 0, LIBTABFS_ENTRYTABLE_USEDMAPSIZE(section));
+        map[0] = 0x80;
+        for (int i = 1; i < entryCount; i++) {
+            if (section->entries[i].flags.type != LIBTABFS_ENTRYTYPE_UNKNOWN) {
+                map[i / 8] |= (0x80 >> (i % 8));
+            }
+        }
+        section->__used_map = map;
+    }
+
+    long i = 0;
+    while ((i = libtabfs_bitmap_find_clear(map, i, entryCount)) < entryCount) {
+        if (section->entries[i].flags.type == LIBTABFS_ENTRYTYPE_UNKNOWN) {
+            return i;
+        }
+        // the entry was handed out before and is filled by now
+        map[i / 8] |= (0x80 >> (i % 8));
+        i++;
+    }
+    return -1;
+}
+
+static libtabfs_error libtabfs_entry_get_name_impl(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, char** name_out);
+
+static void libtabfs_entrytable_free_entry_impl(libtabfs_entrytable_t* section, int offset) {
+    libtabfs_entrytable_entry_t* entry = &(section->entries[offset]);
+    if (entry->flags.type != LIBTABFS_ENTRYTYPE_UNKNOWN && entry->flags.type != LIBTABFS_ENTRYTYPE_LONGNAME) {
+        // the name is gone after the entry is cleared, so the lookups forget it first
+        libtabfs_entrytable_t* first_section = libtabfs_entrytable_get_first_section(section);
+        char* name = NULL;
+        if (libtabfs_entry_get_name_impl(section->__volume, entry, &name) == LIBTABFS_ERR_NONE) {
+            libtabfs_dirindex_remove(first_section, name, section, offset);
+            libtabfs_dcache_forget(section->__volume, first_section->__lba, name);
+        }
+
+        if (entry->longname_data.longname_identifier == 0xFF) {
+            libtabfs_entrytable_t* lne_section = libtabfs_get_entrytable(
+                section->__volume, entry->longname_data.longname_lba, entry->longname_data.longname_lba_size
+            );
+            libtabfs_entrytable_free_entry_impl(lne_section, entry->longname_data.longname_offset);
+        }
+    }
+
+    libtabfs_memset(entry, 0, sizeof(libtabfs_entrytable_entry_t));
+    if (section->__used_map != NULL) {
+        section->__used_map[offset / 8] &= ~(0x80 >> (offset % 8));
+    }
+
+    // searches starting in an earlier section would skip this one because of their hint
+    libtabfs_entrytable_t* cur = libtabfs_entrytable_get_first_section(section);
+    while (cur != NULL && cur != section) {
+        cur->__free_hint_lba = 0;
+        cur->__free_hint_size = 0;
+        cur = libtabfs_entrytable_nextsection(cur);
+    }
+}
+
+void libtabfs_entrytable_free_entry(libtabfs_entrytable_t* section, int offset) {
+    libtabfs_entrytable_call_enter(section);
+    libtabfs_entrytable_free_entry_impl(section, offset);
+    libtabfs_cache_leave(section->__volume->__cache_budget);
+}
+
+static libtabfs_error libtabfs_entrytab_findfree_impl(
     libtabfs_entrytable_t* entrytable,
     libtabfs_entrytable_entry_t** entry_out,
     libtabfs_entrytable_t** entrytable_out,
@@ -202,56 +368,79 @@ libtabfs_error libtabfs_entrytab_findfree(
     if (entry_out == NULL) { return LIBTABFS_ERR_ARGS; }
     *entry_out = NULL;
 
-    int entryCount = entrytable->__byteSize / 64;
-    for (int i = 1; i < entryCount; i++) {
-        libtabfs_entrytable_entry_t* entry = &(entrytable->entries[i]);
-        if (entry->flags.type == LIBTABFS_ENTRYTYPE_UNKNOWN) {
-            *entry_out = entry;
-            if (entrytable_out != NULL) { *entrytable_out = entrytable; }
-            if (offset_out != NULL) { *offset_out = i; }
+    // sections before the hint are known to be full, so the search continues there
+    libtabfs_entrytable_t* start = entrytable;
+    libtabfs_entrytable_t* section = entrytable;
+    if (libtabfs_entrytable_first_free(start) < 0 && start->__free_hint_size != 0) {
+        section = libtabfs_get_entrytable(start->__volume, start->__free_hint_lba, start->__free_hint_size);
+    }
+
+    while (1) {
+        int offset = libtabfs_entrytable_first_free(section);
+        if (offset >= 0) {
+            if (section != start) {
+                start->__free_hint_lba = section->__lba;
+                start->__free_hint_size = section->__byteSize;
+            }
+            *entry_out = &(section->entries[offset]);
+            if (entrytable_out != NULL) { *entrytable_out = section; }
+            if (offset_out != NULL) { *offset_out = offset; }
             return LIBTABFS_ERR_NONE;
         }
+
+        libtabfs_entrytable_t* next_section = libtabfs_entrytable_nextsection(section);
+        if (next_section == NULL) {
+            break;
+        }
+        section = next_section;
     }
 
-    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(entrytable);
+    // no next section configured; create a new section!
 
-    if (tabinfo->next_size != 0 && !LIBTABFS_IS_INVALID_LBA28(tabinfo->next_lba)) {
-        // try to find in next section
-        libtabfs_entrytable_t* next_section = libtabfs_get_entrytable(entrytable->__volume, tabinfo->next_lba, tabinfo->next_size);
-        return libtabfs_entrytab_findfree(next_section, entry_out, entrytable_out, offset_out);
+    libtabfs_lba_28_t next_section_lba = libtabfs_bat_allocateChainedBlocksAt(section->__volume, 2, section->__lba);
+    if (LIBTABFS_IS_INVALID_LBA28(next_section_lba)) {
+        return LIBTABFS_ERR_DEVICE_NOSPACE;
     }
-    else {
-        // no next section configured; create a new section!
 
-        libtabfs_lba_28_t next_section_lba = libtabfs_bat_allocateChainedBlocks(entrytable->__volume, 2);
-        if (LIBTABFS_IS_INVALID_LBA28(next_section_lba)) {
-            return LIBTABFS_ERR_DEVICE_NOSPACE;
-        }
+    int next_section_size = 2 * section->__volume->blockSize;
 
-        int next_section_size = 2 * entrytable->__volume->blockSize;
+    libtabfs_entrytable_t* next_section = libtabfs_create_entrytable(
+        section->__volume, next_section_lba, next_section_size,
+        libtabfs_entrytable_get_parent(section)
+    );
 
-        libtabfs_entrytable_t* next_section = libtabfs_create_entrytable(
-            entrytable->__volume, next_section_lba, next_section_size,
-            libtabfs_entrytable_get_parent(entrytable)
-        );
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(section);
+    tabinfo->next_lba = next_section_lba;
+    tabinfo->next_size = next_section_size;
 
-        tabinfo->next_lba = next_section_lba;
-        tabinfo->next_size = next_section_size;
+    libtabfs_entrytable_tableinfo_t* nextsection_tabinfo = LIBTABFS_GET_TABLEINFO(next_section);
+    nextsection_tabinfo->prev_lba = section->__lba;
+    nextsection_tabinfo->prev_size = section->__byteSize;
 
-        libtabfs_entrytable_tableinfo_t* nextsection_tabinfo = LIBTABFS_GET_TABLEINFO(next_section);
-        nextsection_tabinfo->prev_lba = entrytable->__lba;
-        nextsection_tabinfo->prev_size = entrytable->__byteSize;
+    start->__free_hint_lba = next_section_lba;
+    start->__free_hint_size = next_section_size;
 
-        *entry_out = &(next_section->entries[1]);
-        if (entrytable_out != NULL) { *entrytable_out = next_section; }
-        if (offset_out != NULL) { *offset_out = 1; }
+    *entry_out = &(next_section->entries[1]);
+    if (entrytable_out != NULL) { *entrytable_out = next_section; }
+    if (offset_out != NULL) { *offset_out = 1; }
 
-        return LIBTABFS_ERR_NONE;
-    }
-    return LIBTABFS_ERR_DIR_FULL;
+    return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_entrytable_count_entries(libtabfs_entrytable_t* entrytable, bool skip_longnames) {
+libtabfs_error libtabfs_entrytab_findfree(
+    libtabfs_entrytable_t* entrytable,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    libtabfs_error err = libtabfs_entrytab_findfree_impl(entrytable, entry_out, entrytable_out, offset_out);
+    libtabfs_entrytable_hand_out(err, entry_out, entrytable_out);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_entrytable_count_entries_impl(libtabfs_entrytable_t* entrytable, bool skip_longnames) {
     int count = 0;
 
     int entryCount = entrytable->__byteSize / 64;
@@ -274,7 +463,16 @@ libtabfs_error libtabfs_entrytable_count_entries(libtabfs_entrytable_t* entrytab
     return count;
 }
 
-libtabfs_error libtabfs_entry_get_name(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, char** name_out) {
+libtabfs_error libtabfs_entrytable_count_entries(libtabfs_entrytable_t* entrytable, bool skip_longnames) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, false);
+    libtabfs_error err = libtabfs_entrytable_count_entries_impl(entrytable, skip_longnames);
+    libtabfs_entrytable_unlock(lock, false);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_entry_get_name_impl(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, char** name_out) {
     if (name_out == NULL) { return LIBTABFS_ERR_ARGS; }
 
     if (entry->longname_data.longname_identifier == 0x00) {
@@ -292,17 +490,84 @@ libtabfs_error libtabfs_entry_get_name(libtabfs_volume_t* volume, libtabfs_entry
     return LIBTABFS_ERR_NONE;
 }
 
+libtabfs_error libtabfs_entry_get_name(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, char** name_out) {
+    libtabfs_cache_enter(volume->__cache_budget);
+    libtabfs_error err = libtabfs_entry_get_name_impl(volume, entry, name_out);
+    libtabfs_cache_leave(volume->__cache_budget);
+    return err;
+}
+
+/**
+ * @brief compares an stored, terminated name with an name that is only delimited by its length
+ */
+static bool libtabfs_name_equals(char* stored, const char* name, int namelen) {
+    for (int i = 0; i < namelen; i++) {
+        if (stored[i] != name[i]) {
+            return false;
+        }
+    }
+    return stored[namelen] == '\0';
+}
+
+bool libtabfs_entry_has_name(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, const char* name, int namelen, unsigned int hash) {
+    if (
+        entry->flags.type == LIBTABFS_ENTRYTYPE_UNKNOWN ||
+        entry->flags.type == LIBTABFS_ENTRYTYPE_LONGNAME ||
+        entry->flags.type == LIBTABFS_ENTRYTYPE_TABLEINFO
+    ) {
+        return false;
+    }
+
+    if (namelen >= 22) {
+        if (entry->longname_data.longname_identifier == 0x00) {
+            return false;
+        }
+        // entries written before fingerprints existed always need the longname loaded
+        if (
+            entry->longname_data.fingerprint_identifier == LIBTABFS_LONGNAME_FINGERPRINT &&
+            entry->longname_data.fingerprint != hash
+        ) {
+            return false;
+        }
+        char* entry_name = NULL;
+        if (libtabfs_entry_get_name(volume, entry, &entry_name) != LIBTABFS_ERR_NONE) {
+            return false;
+        }
+        return libtabfs_name_equals(entry_name, name, namelen);
+    }
+    return entry->longname_data.longname_identifier == 0x00 && libtabfs_name_equals(entry->name, name, namelen);
+}
+
+libtabfs_error libtabfs_entry_name_hash(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, unsigned int* hash_out) {
+    if (hash_out == NULL) { return LIBTABFS_ERR_ARGS; }
+
+    if (
+        entry->longname_data.longname_identifier != 0x00 &&
+        entry->longname_data.fingerprint_identifier == LIBTABFS_LONGNAME_FINGERPRINT
+    ) {
+        *hash_out = entry->longname_data.fingerprint;
+        return LIBTABFS_ERR_NONE;
+    }
+
+    char* name = NULL;
+    libtabfs_error err = libtabfs_entry_get_name(volume, entry, &name);
+    if (err != LIBTABFS_ERR_NONE) {
+        return err;
+    }
+    *hash_out = libtabfs_name_hash(name);
+    return LIBTABFS_ERR_NONE;
+}
+
 //--------------------------------------------------------------------------------
 // Find entrys inside an entrytable
 //--------------------------------------------------------------------------------
 
-libtabfs_error libtabfs_entrytab_findentry(
-    libtabfs_entrytable_t* entrytable, char* name,
+static libtabfs_error libtabfs_entrytab_findentry_impl(
+    libtabfs_entrytable_t* entrytable, const char* name, int namelen,
     libtabfs_entrytable_entry_t** entry_out,
     libtabfs_entrytable_t** entrytable_out,
     int* offset_out
 ) {
-    int namelen = libtabfs_strlen(name);
     if (namelen > 62) {
         return LIBTABFS_ERR_NAME_TOLONG;
     }
@@ -310,59 +575,57 @@ libtabfs_error libtabfs_entrytab_findentry(
         return LIBTABFS_ERR_ARGS;
     }
 
-    int entryCount = entrytable->__byteSize / 64;
-    if (namelen >= 22) {
-        // search after an entry with lne!
-        for (int i = 1; i < entryCount; i++) {
-            libtabfs_entrytable_entry_t* entry = &(entrytable->entries[i]);
-            if (
-                entry->flags.type != LIBTABFS_ENTRYTYPE_UNKNOWN &&
-                entry->longname_data.longname_identifier != 0x00
-            ) {
-                libtabfs_entrytable_t* lne_entrytable = libtabfs_get_entrytable(
-                    entrytable->__volume, entry->longname_data.longname_lba, entry->longname_data.longname_lba_size
-                );
-                libtabfs_entrytable_longname_t* lne = (libtabfs_entrytable_longname_t*) &( lne_entrytable->entries[ entry->longname_data.longname_offset ] );
-                if (lne->flags.type != LIBTABFS_ENTRYTYPE_LONGNAME) {
-                    return LIBTABFS_ERR_GENERIC;
-                }
-                if (libtabfs_strcmp(lne->name, name) == 0) {
-                    *entry_out = entry;
-                    if (entrytable_out != NULL) { *entrytable_out = entrytable; }
-                    if (offset_out != NULL) { *offset_out = i; }
-                    return LIBTABFS_ERR_NONE;
-                }
-            }
-        }
-    }
-    else {
-        // search in-entry name
-        for (int i = 1; i < entryCount; i++) {
-            libtabfs_entrytable_entry_t* entry = &(entrytable->entries[i]);
-            if (
-                entry->flags.type != LIBTABFS_ENTRYTYPE_UNKNOWN &&
-                entry->longname_data.longname_identifier == 0x00 &&
-                libtabfs_strcmp(entry->name, name) == 0
-            ) {
-                *entry_out = entry;
-                if (entrytable_out != NULL) { *entrytable_out = entrytable; }
-                if (offset_out != NULL) { *offset_out = i; }
-                return LIBTABFS_ERR_NONE;
-            }
-        }
+    // both the hashed layout and the index cover all sections of the directory, not only the given one
+    libtabfs_entrytable_t* first_section = libtabfs_entrytable_get_first_section(entrytable);
+    if (libtabfs_hashdir_is_hashed(first_section)) {
+        return libtabfs_hashdir_lookup_impl(first_section, name, namelen, entry_out, entrytable_out, offset_out);
     }
+    return libtabfs_dirindex_lookup(first_section, name, namelen, entry_out, entrytable_out, offset_out);
+}
 
-    *entry_out = NULL;
-    return LIBTABFS_ERR_NONE;
+libtabfs_error libtabfs_entrytab_findentry(
+    libtabfs_entrytable_t* entrytable, char* name,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    return libtabfs_entrytab_findentry_n(entrytable, name, libtabfs_strlen(name), entry_out, entrytable_out, offset_out);
 }
 
-libtabfs_error libtabfs_entrytab_getsymlinktarget(
+libtabfs_error libtabfs_entrytab_findentry_n(
+    libtabfs_entrytable_t* entrytable, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, false);
+    libtabfs_error err = libtabfs_entrytab_findentry_impl(entrytable, name, namelen, entry_out, entrytable_out, offset_out);
+    libtabfs_entrytable_unlock(lock, false);
+    libtabfs_entrytable_hand_out(err, entry_out, entrytable_out);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_entrytab_traversetree_impl(
+    libtabfs_entrytable_t* entrytable, const char* relative_path, int pathlen, bool follow_symlink,
+    unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+);
+
+static libtabfs_error libtabfs_entrytab_getsymlinktarget_impl(
     libtabfs_entrytable_t* entrytable, libtabfs_entrytable_entry_t* symlink_entry,
     unsigned int userid, unsigned int groupid,
     libtabfs_entrytable_entry_t** entry_out,
     libtabfs_entrytable_t** entrytable_out,
     int* offset_out
 ) {
+    // the path is copied out, so the directory of the link isnt locked anymore while its traversed
+    char path[63];
+    void* lock = libtabfs_entrytable_lock(entrytable, false);
+
     libtabfs_entrytable_t* lne_entrytable = entrytable;
     int offset = symlink_entry->data.link.offset;
     while (true) {
@@ -378,31 +641,102 @@ libtabfs_error libtabfs_entrytab_getsymlinktarget(
     }
     libtabfs_entrytable_longname_t* lne_path = (libtabfs_entrytable_longname_t*) &( lne_entrytable->entries[ offset ] );
 
-    libtabfs_entrytable_t* tab = NULL;
+    int pathlen = libtabfs_strlen(lne_path->name);
+    libtabfs_memcpy(path, lne_path->name, pathlen);
+    libtabfs_entrytable_t* tab = libtabfs_entrytable_get_first_section(lne_entrytable);
+    libtabfs_entrytable_unlock(lock, false);
+
     // if the path starts with an '/', its an absolute path!
-    char* path = lne_path->name;
-    if (*path == '/') {
-        path += 1;
+    char* start = path;
+    if (pathlen > 0 && *start == '/') {
+        start += 1;
+        pathlen -= 1;
         tab = entrytable->__volume->__root_table;
     }
-    else {
-        tab = libtabfs_entrytable_get_first_section(lne_entrytable);
-    }
 
     // get the target of the link
-    return libtabfs_entrytab_traversetree(tab, path, true, userid, groupid, entry_out, entrytable_out, offset_out);
+    return libtabfs_entrytab_traversetree_impl(
+        tab, start, pathlen, true, userid, groupid, entry_out, entrytable_out, offset_out
+    );
 }
 
-libtabfs_error libtabfs_entrytab_traversetree(
-    libtabfs_entrytable_t* entrytable, char* relative_path, bool follow_symlink,
+libtabfs_error libtabfs_entrytab_getsymlinktarget(
+    libtabfs_entrytable_t* entrytable, libtabfs_entrytable_entry_t* symlink_entry,
+    unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    libtabfs_error err = libtabfs_entrytab_getsymlinktarget_impl(entrytable, symlink_entry, userid, groupid, entry_out, entrytable_out, offset_out);
+    libtabfs_entrytable_hand_out(err, entry_out, entrytable_out);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+/**
+ * @brief searches an path component; asks the dentry cache of the volume first and remembers the result there.
+ * The caller holds the lock of the directory shared
+ */
+static libtabfs_error libtabfs_entrytab_findcomponent(
+    libtabfs_entrytable_t* entrytable, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    libtabfs_volume_t* volume = entrytable->__volume;
+    if (volume->__dcache == NULL || namelen > 62 || entry_out == NULL) {
+        return libtabfs_entrytab_findentry_impl(entrytable, name, namelen, entry_out, entrytable_out, offset_out);
+    }
+
+    libtabfs_entrytable_t* first_section = libtabfs_entrytable_get_first_section(entrytable);
+    unsigned int hash = libtabfs_name_hash_n(name, namelen);
+    libtabfs_dentry_t dentry;
+    if (libtabfs_dcache_lookup(volume->__dcache, first_section->__lba, name, namelen, hash, &dentry)) {
+        if (dentry.size == 0) {
+            *entry_out = NULL;
+            return LIBTABFS_ERR_NONE;
+        }
+
+        libtabfs_entrytable_t* section = libtabfs_get_entrytable(volume, dentry.lba, dentry.size);
+        libtabfs_entrytable_entry_t* entry = &(section->entries[dentry.offset]);
+        if (libtabfs_entry_has_name(volume, entry, name, namelen, hash)) {
+            *entry_out = entry;
+            if (entrytable_out != NULL) { *entrytable_out = section; }
+            if (offset_out != NULL) { *offset_out = dentry.offset; }
+            return LIBTABFS_ERR_NONE;
+        }
+        // the entry was freed or reused without forgetting its dentry; search it again
+    }
+
+    libtabfs_entrytable_t* section = NULL;
+    int offset = -1;
+    libtabfs_error err = libtabfs_entrytab_findentry_impl(first_section, name, namelen, entry_out, &section, &offset);
+    if (err != LIBTABFS_ERR_NONE) {
+        return err;
+    }
+
+    libtabfs_dcache_insert(volume->__dcache, first_section->__lba, name, namelen, hash, *entry_out != NULL ? section : NULL, offset);
+    if (*entry_out != NULL) {
+        if (entrytable_out != NULL) { *entrytable_out = section; }
+        if (offset_out != NULL) { *offset_out = offset; }
+    }
+    return LIBTABFS_ERR_NONE;
+}
+
+static libtabfs_error libtabfs_entrytab_traversetree_impl(
+    libtabfs_entrytable_t* entrytable, const char* relative_path, int pathlen, bool follow_symlink,
     unsigned int userid, unsigned int groupid,
     libtabfs_entrytable_entry_t** entry_out,
     libtabfs_entrytable_t** entrytable_out,
     int* offset_out
 ) {
-    while (*relative_path != '\0') {
+    // the path is only read up to pathlen and never written to, so it can be const or an part of an larger buffer
+    const char* end = relative_path + pathlen;
+    while (relative_path < end) {
+        int left = end - relative_path;
         if (relative_path[0] == '.') {
-            if (relative_path[1] == '.' && relative_path[2] == '/') {
+            if (left >= 3 && relative_path[1] == '.' && relative_path[2] == '/') {
                 // was '../' which means the parent directory;
                 relative_path += 3;
 
@@ -416,79 +750,94 @@ libtabfs_error libtabfs_entrytab_traversetree(
                         entrytable->__volume, tabinf->parent_lba, tabinf->parent_size
                     );
                 }
+                continue;
             }
-            else if (relative_path[1] == '/') {
+            else if (left >= 2 && relative_path[1] == '/') {
                 // was './', which means the current directory; skip the two chars and continue on
                 relative_path += 2;
                 continue;
             }
         }
 
-        char* delim = libtabfs_strchr(relative_path, '/');      // TODO: make this delimiter changeable
-        if (delim == NULL) {
-            // no more traversel; just find the entry!
-            libtabfs_error err = libtabfs_entrytab_findentry(entrytable, relative_path, entry_out, entrytable_out, offset_out);
-            if (err != LIBTABFS_ERR_NONE) {
-                return err;
-            }
-
-            if (*entry_out == NULL) {
-                return LIBTABFS_ERR_NOT_FOUND;
-            }
-
-            if (follow_symlink && (*entry_out)->flags.type == LIBTABFS_ENTRYTYPE_SYMLINK) {
-                err = libtabfs_entrytab_getsymlinktarget(entrytable, *entry_out, userid, groupid, entry_out, entrytable_out, offset_out);
-            }
+        int namelen = 0;
+        while (namelen < left && relative_path[namelen] != '/') {      // TODO: make this delimiter changeable
+            namelen++;
+        }
 
+        // the directory is only locked while searching in it; entries of other threads can show up right after
+        void* lock = libtabfs_entrytable_lock(entrytable, false);
+        libtabfs_error err = libtabfs_entrytab_findcomponent(entrytable, relative_path, namelen, entry_out, entrytable_out, offset_out);
+        libtabfs_entrytable_unlock(lock, false);
+        if (err != LIBTABFS_ERR_NONE) {
             return err;
         }
-        else {
-            *delim = '\0';  // temporarily set an end so libtabfs_strcmp can work!
-            // TODO: rework this since temprarily modifing the path is not good; const char* cannot be used as argument then!
-            libtabfs_error err = libtabfs_entrytab_findentry(entrytable, relative_path, entry_out, entrytable_out, offset_out);
-            *delim = '/';   // restore the delimiter
 
-            if (err != LIBTABFS_ERR_NONE) {
-                return err;
-            }
-
-            if (*entry_out == NULL) {
-                return LIBTABFS_ERR_NOT_FOUND;
-            }
+        if (*entry_out == NULL) {
+            return LIBTABFS_ERR_NOT_FOUND;
+        }
 
-            if (follow_symlink && (*entry_out)->flags.type == LIBTABFS_ENTRYTYPE_SYMLINK) {
-                err = libtabfs_entrytab_getsymlinktarget(entrytable, *entry_out, userid, groupid, entry_out, entrytable_out, offset_out);
-            }
+        if (follow_symlink && (*entry_out)->flags.type == LIBTABFS_ENTRYTYPE_SYMLINK) {
+            err = libtabfs_entrytab_getsymlinktarget_impl(entrytable, *entry_out, userid, groupid, entry_out, entrytable_out, offset_out);
+        }
 
-            if ((*entry_out)->flags.type != LIBTABFS_ENTRYTYPE_DIR) {
-                *entry_out = NULL;
-                return LIBTABFS_ERR_IS_NO_DIR;
-            }
+        if (namelen == left) {
+            // no more traversel; this was the entry!
+            return err;
+        }
 
-            // check execute bit to determine if we are allowed to enter!
-            if (!libtabfs_check_perm(*entry_out, userid, groupid, 0b001)) {
-                *entry_out = NULL;
-                return LIBTABFS_ERR_NO_PERM;
-            }
+        if ((*entry_out)->flags.type != LIBTABFS_ENTRYTYPE_DIR) {
+            *entry_out = NULL;
+            return LIBTABFS_ERR_IS_NO_DIR;
+        }
 
-            // move to new entrytable
-            entrytable = libtabfs_get_entrytable(
-                entrytable->__volume, (*entry_out)->data.dir.lba, (*entry_out)->data.dir.size
-            );
+        // check execute bit to determine if we are allowed to enter!
+        if (!libtabfs_check_perm(*entry_out, userid, groupid, 0b001)) {
+            *entry_out = NULL;
+            return LIBTABFS_ERR_NO_PERM;
+        }
 
-            // move the relative_path to the new one
-            relative_path = delim + 1;
+        // move to new entrytable
+        entrytable = libtabfs_get_entrytable(
+            entrytable->__volume, (*entry_out)->data.dir.lba, (*entry_out)->data.dir.size
+        );
 
-            if (*relative_path == '\0') {
-                return LIBTABFS_ERR_NONE;
-            }
+        // move the relative_path behind the delimiter
+        relative_path += namelen + 1;
 
-            continue;
+        if (relative_path == end) {
+            return LIBTABFS_ERR_NONE;
         }
     }
     return LIBTABFS_ERR_GENERIC;
 }
 
+libtabfs_error libtabfs_entrytab_traversetree(
+    libtabfs_entrytable_t* entrytable, char* relative_path, bool follow_symlink,
+    unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    return libtabfs_entrytab_traversetree_n(
+        entrytable, relative_path, libtabfs_strlen(relative_path), follow_symlink,
+        userid, groupid, entry_out, entrytable_out, offset_out
+    );
+}
+
+libtabfs_error libtabfs_entrytab_traversetree_n(
+    libtabfs_entrytable_t* entrytable, const char* relative_path, int pathlen, bool follow_symlink,
+    unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    libtabfs_error err = libtabfs_entrytab_traversetree_impl(entrytable, relative_path, pathlen, follow_symlink, userid, groupid, entry_out, entrytable_out, offset_out);
+    libtabfs_entrytable_hand_out(err, entry_out, entrytable_out);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
 //--------------------------------------------------------------------------------
 // Entry creation
 //--------------------------------------------------------------------------------
@@ -496,14 +845,26 @@ libtabfs_error libtabfs_entrytab_traversetree(
 #define NAME_CHECK \
     int namelen = libtabfs_strlen(name); if (namelen > 62) { return LIBTABFS_ERR_NAME_TOLONG; }
 
-libtabfs_error libtabfs_create_entry(
-    libtabfs_entrytable_t* entrytable, char* name, libtabfs_entrytable_entry_t** entry_out
+/**
+ * @brief creates an entry; entrytable_out and offset_out are optional and tell where it was placed
+ */
+static libtabfs_error libtabfs_create_entry_impl(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out, int* offset_out
 ) {
     NAME_CHECK
     if (entry_out == NULL) { return LIBTABFS_ERR_ARGS; }
 
+    // in hashed directories, the entry and its longname go into the bucket of the name
+    libtabfs_entrytable_t* first_section = libtabfs_entrytable_get_first_section(entrytable);
+    bool hashed = libtabfs_hashdir_is_hashed(first_section);
+
     libtabfs_entrytable_entry_t* entry = NULL;
-    libtabfs_error err = libtabfs_entrytab_findfree(entrytable, &entry, NULL, NULL);
+    libtabfs_entrytable_t* entrytable_of_entry = NULL;
+    int offset_of_entry = -1;
+    libtabfs_error err = hashed
+        ? libtabfs_hashdir_findfree_impl(first_section, name, &entry, &entrytable_of_entry, &offset_of_entry)
+        : libtabfs_entrytab_findfree_impl(entrytable, &entry, &entrytable_of_entry, &offset_of_entry);
     if (err != LIBTABFS_ERR_NONE) {
         return err;
     }
@@ -516,8 +877,11 @@ libtabfs_error libtabfs_create_entry(
         libtabfs_entrytable_t* entrytable_of_lne = NULL;
         int offset_of_lne = -1;
 
-        libtabfs_error err = libtabfs_entrytab_findfree(entrytable, &longname_entry, &entrytable_of_lne, &offset_of_lne);
+        libtabfs_error err = hashed
+            ? libtabfs_hashdir_findfree_impl(first_section, name, &longname_entry, &entrytable_of_lne, &offset_of_lne)
+            : libtabfs_entrytab_findfree_impl(entrytable, &longname_entry, &entrytable_of_lne, &offset_of_lne);
         if (err != LIBTABFS_ERR_NONE) {
+            libtabfs_entrytable_free_entry_impl(entrytable_of_entry, offset_of_entry);
             return err;
         }
 
@@ -533,18 +897,37 @@ libtabfs_error libtabfs_create_entry(
 
         entry->longname_data.longname_identifier = 0xFF;
         entry->longname_data.longname_lba = entrytable_of_lne->__lba;
+        entry->longname_data.longname_lba_size = entrytable_of_lne->__byteSize;
         entry->longname_data.longname_offset = offset_of_lne;
+        entry->longname_data.fingerprint_identifier = LIBTABFS_LONGNAME_FINGERPRINT;
+        entry->longname_data.fingerprint = libtabfs_name_hash(name);
     }
     else {
         libtabfs_memcpy(entry->name, name, namelen);
         entry->name[namelen] = '\0';
     }
 
+    if (!hashed) {
+        libtabfs_dirindex_add(first_section, name, entrytable_of_entry, offset_of_entry);
+    }
+    libtabfs_dcache_forget(entrytable->__volume, first_section->__lba, name);
+
     *entry_out = entry;
+    if (entrytable_out != NULL) { *entrytable_out = entrytable_of_entry; }
+    if (offset_out != NULL) { *offset_out = offset_of_entry; }
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_create_dir(
+libtabfs_error libtabfs_create_entry(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_entrytable_entry_t** entry_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    libtabfs_error err = libtabfs_create_entry_impl(entrytable, name, entry_out, NULL, NULL);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_create_dir_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     libtabfs_entrytable_t** entrytable_newdir_out
@@ -554,8 +937,8 @@ libtabfs_error libtabfs_create_dir(
         return LIBTABFS_ERR_ARGS;
     }
 
-    // allocate an new entrytable
-    libtabfs_lba_28_t entrytable_lba = libtabfs_bat_allocateChainedBlocks(entrytable->__volume, 2);
+    // allocate an new entrytable; near its parent
+    libtabfs_lba_28_t entrytable_lba = libtabfs_bat_allocateChainedBlocksAt(entrytable->__volume, 2, entrytable->__lba);
     if (LIBTABFS_IS_INVALID_LBA28(entrytable_lba)) {
         return LIBTABFS_ERR_DEVICE_NOSPACE;
     }
@@ -595,7 +978,37 @@ libtabfs_error libtabfs_create_dir(
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_create_chardevice(
+libtabfs_error libtabfs_create_dir(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_t** entrytable_newdir_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_dir_impl(entrytable, name, fileflags, create_ts, userid, groupid, entrytable_newdir_out);
+    if (err == LIBTABFS_ERR_NONE) {
+        libtabfs_entrytable_pin(*entrytable_newdir_out);
+    }
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+libtabfs_error libtabfs_create_dir_locked(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_t** entrytable_newdir_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    libtabfs_error err = libtabfs_create_dir_impl(entrytable, name, fileflags, create_ts, userid, groupid, entrytable_newdir_out);
+    if (err == LIBTABFS_ERR_NONE) {
+        libtabfs_entrytable_pin(*entrytable_newdir_out);
+    }
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_create_chardevice_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     unsigned int dev_id, unsigned int dev_flags
@@ -624,7 +1037,20 @@ libtabfs_error libtabfs_create_chardevice(
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_create_blockdevice(
+libtabfs_error libtabfs_create_chardevice(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    unsigned int dev_id, unsigned int dev_flags
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_chardevice_impl(entrytable, name, fileflags, create_ts, userid, groupid, dev_id, dev_flags);
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_create_blockdevice_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     unsigned int dev_id, unsigned int dev_flags
@@ -653,7 +1079,20 @@ libtabfs_error libtabfs_create_blockdevice(
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_create_fifo(
+libtabfs_error libtabfs_create_blockdevice(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    unsigned int dev_id, unsigned int dev_flags
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_blockdevice_impl(entrytable, name, fileflags, create_ts, userid, groupid, dev_id, dev_flags);
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_create_fifo_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     unsigned int bufferSize
@@ -682,7 +1121,20 @@ libtabfs_error libtabfs_create_fifo(
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_create_symlink(
+libtabfs_error libtabfs_create_fifo(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    unsigned int bufferSize
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_fifo_impl(entrytable, name, fileflags, create_ts, userid, groupid, bufferSize);
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_create_symlink_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     char* path
@@ -693,7 +1145,9 @@ libtabfs_error libtabfs_create_symlink(
     if (pathlen > 62) { return LIBTABFS_ERR_ARGS; }
 
     libtabfs_entrytable_entry_t* entry = NULL;
-    libtabfs_error err = libtabfs_create_entry( entrytable, name, &entry );
+    libtabfs_entrytable_t* entry_sec = NULL;
+    int entry_off = -1;
+    libtabfs_error err = libtabfs_create_entry_impl( entrytable, name, &entry, &entry_sec, &entry_off );
     if (err != LIBTABFS_ERR_NONE) {
         return err;
     }
@@ -705,9 +1159,9 @@ libtabfs_error libtabfs_create_symlink(
     libtabfs_entrytable_t* lne_path_sec;
     int lne_path_off = -1;
 
-    err = libtabfs_entrytab_findfree(entrytable, &lne_path, &lne_path_sec, &lne_path_off);
+    err = libtabfs_entrytab_findfree_impl(entrytable, &lne_path, &lne_path_sec, &lne_path_off);
     if (err != LIBTABFS_ERR_NONE) {
-        entry->rawflags = 0;
+        libtabfs_entrytable_free_entry_impl(entry_sec, entry_off);
         return err;
     }
 
@@ -737,7 +1191,20 @@ libtabfs_error libtabfs_create_symlink(
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_create_socket(
+libtabfs_error libtabfs_create_symlink(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    char* path
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_symlink_impl(entrytable, name, fileflags, create_ts, userid, groupid, path);
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_create_socket_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     unsigned int ipv4_or_serialnum
@@ -766,7 +1233,20 @@ libtabfs_error libtabfs_create_socket(
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_create_continuousfile(
+libtabfs_error libtabfs_create_socket(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    unsigned int ipv4_or_serialnum
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_socket_impl(entrytable, name, fileflags, create_ts, userid, groupid, ipv4_or_serialnum);
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_create_continuousfile_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     bool iskernel, size_t size, libtabfs_entrytable_entry_t** entry_out
@@ -780,7 +1260,7 @@ libtabfs_error libtabfs_create_continuousfile(
         blocks += 1;
     }
 
-    libtabfs_lba_28_t fileContent_lba = libtabfs_bat_allocateChainedBlocks(entrytable->__volume, blocks);
+    libtabfs_lba_28_t fileContent_lba = libtabfs_bat_allocateChainedBlocksAt(entrytable->__volume, blocks, entrytable->__lba);
     if (LIBTABFS_IS_INVALID_LBA28(fileContent_lba)) {
         return LIBTABFS_ERR_DEVICE_NOSPACE;
     }
@@ -820,13 +1300,26 @@ libtabfs_error libtabfs_create_continuousfile(
     return LIBTABFS_ERR_NONE;
 }
 
+libtabfs_error libtabfs_create_continuousfile(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    bool iskernel, size_t size, libtabfs_entrytable_entry_t** entry_out
+) {
+    libtabfs_entrytable_call_enter(entrytable);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_continuousfile_impl(entrytable, name, fileflags, create_ts, userid, groupid, iskernel, size, entry_out);
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
 //--------------------------------------------------------------------------------
 // Entry read / write (file only)
 //--------------------------------------------------------------------------------
 
 #include "./fatfile.h"
 
-libtabfs_error libtabfs_read_file(
+static libtabfs_error libtabfs_read_file_impl(
     libtabfs_volume_t* volume,
     libtabfs_entrytable_entry_t* entry, unsigned long int offset, unsigned long int len, unsigned char* buffer,
     unsigned long int* bytesRead
@@ -840,9 +1333,11 @@ libtabfs_error libtabfs_read_file(
         case LIBTABFS_ENTRYTYPE_KERNEL: {
             // read from continuous file
 
+            void* lock = libtabfs_continuousfile_lock(volume, entry, NULL, false);
             libtabfs_lba_28_t fileContent_lba = entry->data.lba_and_size.lba;
             unsigned int fileContent_size = entry->data.lba_and_size.size;
             if (offset >= fileContent_size) {
+                libtabfs_continuousfile_unlock(lock, false);
                 *bytesRead = 0;
                 return LIBTABFS_ERR_OFFSET_AFTER_FILE_END;
             }
@@ -859,6 +1354,7 @@ libtabfs_error libtabfs_read_file(
                 fileContent_lba, volume->flags.absolute_lbas,
                 offset, buffer, real_len
             );
+            libtabfs_continuousfile_unlock(lock, false);
 
             *bytesRead = real_len;
             return LIBTABFS_ERR_NONE;
@@ -876,7 +1372,18 @@ libtabfs_error libtabfs_read_file(
 
 }
 
-libtabfs_error libtabfs_write_file(
+libtabfs_error libtabfs_read_file(
+    libtabfs_volume_t* volume,
+    libtabfs_entrytable_entry_t* entry, unsigned long int offset, unsigned long int len, unsigned char* buffer,
+    unsigned long int* bytesRead
+) {
+    libtabfs_cache_enter(volume->__cache_budget);
+    libtabfs_error err = libtabfs_read_file_impl(volume, entry, offset, len, buffer, bytesRead);
+    libtabfs_cache_leave(volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_write_file_impl(
     libtabfs_volume_t* volume,
     libtabfs_entrytable_entry_t* entry, unsigned long int offset, unsigned long int len, unsigned char* buffer,
     unsigned long int* bytesWritten
@@ -890,9 +1397,11 @@ libtabfs_error libtabfs_write_file(
         case LIBTABFS_ENTRYTYPE_KERNEL: {
             // write to continuous file
 
+            void* lock = libtabfs_continuousfile_lock(volume, entry, NULL, true);
             libtabfs_lba_28_t fileContent_lba = entry->data.lba_and_size.lba;
             unsigned int fileContent_size = entry->data.lba_and_size.size;
             if (offset >= fileContent_size) {
+                libtabfs_continuousfile_unlock(lock, true);
                 *bytesWritten = 0;
                 return LIBTABFS_ERR_OFFSET_AFTER_FILE_END;
             }
@@ -909,6 +1418,7 @@ libtabfs_error libtabfs_write_file(
                 fileContent_lba, volume->flags.absolute_lbas,
                 offset, buffer, real_len
             );
+            libtabfs_continuousfile_unlock(lock, true);
 
             *bytesWritten = real_len;
             return LIBTABFS_ERR_NONE;
@@ -923,4 +1433,15 @@ libtabfs_error libtabfs_write_file(
         default:
             return LIBTABFS_ERR_ARGS;
     }
+}
+
+libtabfs_error libtabfs_write_file(
+    libtabfs_volume_t* volume,
+    libtabfs_entrytable_entry_t* entry, unsigned long int offset, unsigned long int len, unsigned char* buffer,
+    unsigned long int* bytesWritten
+) {
+    libtabfs_cache_enter(volume->__cache_budget);
+    libtabfs_error err = libtabfs_write_file_impl(volume, entry, offset, len, buffer, bytesWritten);
+    libtabfs_cache_leave(volume->__cache_budget);
+    return err;
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "bridge.h"
+
+#include "common.h"
+#include "extent.h"
+
+static void libtabfs_extent_update(libtabfs_extent_t* node) {
+    long max = node->length;
+    if (node->left != NULL && node->left->max_length > max) { max = node->left->max_length; }
+    if (node->right != NULL && node->right->max_length > max) { max = node->right->max_length; }
+    node->max_length = max;
+}
+
+static libtabfs_extent_t* libtabfs_extent_create(libtabfs_extenttree_t* tree, long start, long length) {
+    libtabfs_extent_t* node = (libtabfs_extent_t*) libtabfs_alloc(sizeof(libtabfs_extent_t));
+    node->left = NULL;
+    node->right = NULL;
+    node->start = start;
+    node->length = length;
+    node->max_length = length;
+
+    // xorshift; any sequence works as long as its well distributed
+    unsigned int x = tree->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tree->seed = x;
+    node->priority = x;
+
+    tree->count++;
+    return node;
+}
+
+static void libtabfs_extent_free(libtabfs_extenttree_t* tree, libtabfs_extent_t* node) {
+    if (node == NULL) { return; }
+    libtabfs_extent_free(tree, node->left);
+    libtabfs_extent_free(tree, node->right);
+    libtabfs_free(node, sizeof(libtabfs_extent_t));
+    tree->count--;
+}
+
+/**
+ * @brief sums the lengths of all extents in an subtree
+ */
+static long libtabfs_extent_sum(libtabfs_extent_t* node) {
+    if (node == NULL) { return 0; }
+    return node->length + libtabfs_extent_sum(node->left) + libtabfs_extent_sum(node->right);
+}
+
+/**
+ * @brief splits an subtree into all extents starting before key (left_out) and the rest (right_out)
+ */
+static void libtabfs_extent_split(libtabfs_extent_t* node, long key, libtabfs_extent_t** left_out, libtabfs_extent_t** right_out) {
+    if (node == NULL) {
+        *left_out = NULL;
+        *right_out = NULL;
+        return;
+    }
+    if (node->start < key) {
+        libtabfs_extent_split(node->right, key, &(node->right), right_out);
+        *left_out = node;
+    }
+    else {
+        libtabfs_extent_split(node->left, key, left_out, &(node->left));
+        *right_out = node;
+    }
+    libtabfs_extent_update(node);
+}
+
+/**
+ * @brief merges two subtrees; all extents of left must start before the ones of right
+ */
+static libtabfs_extent_t* libtabfs_extent_merge(libtabfs_extent_t* left, libtabfs_extent_t* right) {
+    if (left == NULL) { return right; }
+    if (right == NULL) { return left; }
+    if (left->priority > right->priority) {
+        left->right = libtabfs_extent_merge(left->right, right);
+        libtabfs_extent_update(left);
+        return left;
+    }
+    else {
+        right->left = libtabfs_extent_merge(left, right->left);
+        libtabfs_extent_update(right);
+        return right;
+    }
+}
+
+static libtabfs_extent_t* libtabfs_extent_rightmost(libtabfs_extent_t* node) {
+    if (node == NULL) { return NULL; }
+    while (node->right != NULL) { node = node->right; }
+    return node;
+}
+
+void libtabfs_extenttree_init(libtabfs_extenttree_t* tree) {
+    tree->root = NULL;
+    tree->count = 0;
+    tree->seed = 0x9E3779B9;
+}
+
+void libtabfs_extenttree_destroy(libtabfs_extenttree_t* tree) {
+    libtabfs_extent_free(tree, tree->root);
+    tree->root = NULL;
+}
+
+void libtabfs_extenttree_add(libtabfs_extenttree_t* tree, long start, long length) {
+    if (length <= 0) { return; }
+    long end = start + length;
+
+    libtabfs_extent_t *left, *middle, *right;
+    libtabfs_extent_split(tree->root, start, &left, &right);
+
+    // the last extent before the range can overlap or touch it; pull it out so it gets merged
+    libtabfs_extent_t* prev = libtabfs_extent_rightmost(left);
+    if (prev != NULL && prev->start + prev->length >= start) {
+        libtabfs_extent_split(left, prev->start, &left, &middle);
+        start = prev->start;
+        if (prev->start + prev->length > end) { end = prev->start + prev->length; }
+        libtabfs_extent_free(tree, middle);
+    }
+
+    // all extents starting inside the range or directly at its end get merged too
+    libtabfs_extent_split(right, end + 1, &middle, &right);
+    libtabfs_extent_t* last = libtabfs_extent_rightmost(middle);
+    if (last != NULL && last->start + last->length > end) { end = last->start + last->length; }
+    libtabfs_extent_free(tree, middle);
+
+    libtabfs_extent_t* node = libtabfs_extent_create(tree, start, end - start);
+    tree->root = libtabfs_extent_merge(libtabfs_extent_merge(left, node), right);
+}
+
+long libtabfs_extenttree_remove(libtabfs_extenttree_t* tree, long start, long length) {
+    if (length <= 0) { return 0; }
+    long end = start + length;
+
+    libtabfs_extent_t *left, *middle, *right;
+    libtabfs_extent_split(tree->root, start, &left, &right);
+
+    // an extent starting before the range can reach into (or even over) it
+    libtabfs_extent_t* tail = NULL;
+    long removed = 0;
+    libtabfs_extent_t* prev = libtabfs_extent_rightmost(left);
+    if (prev != NULL && prev->start + prev->length > start) {
+        long prev_end = prev->start + prev->length;
+        removed += (prev_end > end ? end : prev_end) - start;
+        libtabfs_extent_split(left, prev->start, &left, &middle);
+        middle->length = start - middle->start;
+        libtabfs_extent_update(middle);
+        left = libtabfs_extent_merge(left, middle);
+        if (prev_end > end) {
+            tail = libtabfs_extent_create(tree, end, prev_end - end);
+        }
+    }
+
+    // extents starting inside the range are dropped; only the part after the range survives
+    libtabfs_extent_split(right, end, &middle, &right);
+    removed += libtabfs_extent_sum(middle);
+    libtabfs_extent_t* last = libtabfs_extent_rightmost(middle);
+    if (last != NULL && last->start + last->length > end) {
+        removed -= last->start + last->length - end;
+        tail = libtabfs_extent_create(tree, end, last->start + last->length - end);
+    }
+    libtabfs_extent_free(tree, middle);
+
+    tree->root = libtabfs_extent_merge(left, libtabfs_extent_merge(tail, right));
+    return removed;
+}
+
+static long libtabfs_extent_first_fit(libtabfs_extent_t* node, long from, long count) {
+    while (node != NULL && node->max_length >= count) {
+        if (node->start > from) {
+            // extents to the left also start after from (or contain it), so they come first
+            long pos = libtabfs_extent_first_fit(node->left, from, count);
+            if (pos >= 0) { return pos; }
+            if (node->length >= count) { return node->start; }
+        }
+        else {
+            // everything to the left ends before this node, so before from
+            long usable = node->start + node->length - from;
+            if (usable >= count) { return from; }
+        }
+        node = node->right;
+    }
+    return -1;
+}
+
+long libtabfs_extenttree_first_fit(libtabfs_extenttree_t* tree, long from, long count) {
+    return libtabfs_extent_first_fit(tree->root, from, count);
+}
+
+static void libtabfs_extent_best_fit(libtabfs_extent_t* node, long from, long count, long* best_pos, long* best_len) {
+    while (node != NULL && node->max_length >= count && *best_len != count) {
+        if (node->start > from) {
+            // extents to the left can still end after from
+            libtabfs_extent_best_fit(node->left, from, count, best_pos, best_len);
+        }
+
+        long start = node->start > from ? node->start : from;
+        long usable = node->start + node->length - start;
+        if (usable >= count && (*best_len < 0 || usable < *best_len)) {
+            *best_pos = start;
+            *best_len = usable;
+        }
+        node = node->right;
+    }
+}
+
+long libtabfs_extenttree_best_fit(libtabfs_extenttree_t* tree, long from, long count) {
+    long pos = -1;
+    long len = -1;
+    libtabfs_extent_best_fit(tree->root, from, count, &pos, &len);
+    return pos;
+}
+
+static long libtabfs_extent_aligned_fit(libtabfs_extent_t* node, long from, long count, long align, long base) {
+    while (node != NULL && node->max_length >= count) {
+        if (node->start > from) {
+            long pos = libtabfs_extent_aligned_fit(node->left, from, count, align, base);
+            if (pos >= 0) { return pos; }
+        }
+
+        long start = node->start > from ? node->start : from;
+        long misalign = (base + start) % align;
+        if (misalign != 0) { start += align - misalign; }
+        if (start + count <= node->start + node->length) { return start; }
+        node = node->right;
+    }
+    return -1;
+}
+
+long libtabfs_extenttree_aligned_fit(libtabfs_extenttree_t* tree, long from, long count, long align, long base) {
+    return libtabfs_extent_aligned_fit(tree->root, from, count, align, base);
+}
+
+libtabfs_extent_t* libtabfs_extenttree_next(libtabfs_extenttree_t* tree, long pos) {
+    // extents dont overlap, so they are sorted by their end too
+    libtabfs_extent_t* found = NULL;
+    libtabfs_extent_t* node = tree->root;
+    while (node != NULL) {
+        if (node->start + node->length > pos) {
+            found = node;
+            node = node->left;
+        }
+        else {
+            node = node->right;
+        }
+    }
+    return found;
+}
+
+libtabfs_extent_t* libtabfs_extenttree_last(libtabfs_extenttree_t* tree) {
+    return libtabfs_extent_rightmost(tree->root);
+}
\ No newline at end of file
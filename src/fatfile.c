@@ -3,9 +3,16 @@
 #include "common.h"
 #include "volume.h"
 #include "bat.h"
+#include "bitmap.h"
 #include "fatfile.h"
+#include "lock.h"
 
-#define LIBTABFS_FAT_DATAOFFSET  (LIBTABFS_PTR_SIZE) + sizeof(unsigned int) + sizeof(libtabfs_lba_28_t)
+#define LIBTABFS_FAT_DATAOFFSET  (LIBTABFS_PTR_SIZE) + sizeof(unsigned int) + sizeof(libtabfs_lba_28_t) \
+    + (LIBTABFS_PTR_SIZE) + sizeof(libtabfs_lba_28_t) + sizeof(unsigned int)
+
+// the first 16 bytes of an section are its header, so there is one entry less than 16 byte slots
+#define LIBTABFS_FAT_ENTRYCOUNT(fat)    (((fat)->__byteSize / 16) - 1)
+#define LIBTABFS_FAT_USEDMAPSIZE(fat)   ((LIBTABFS_FAT_ENTRYCOUNT(fat) + 7) / 8)
 
 //--------------------------------------------------------------------------------
 // FAT creation, sync & destroying
@@ -24,25 +31,44 @@ libtabfs_fat_t* libtabfs_read_fat(libtabfs_volume_t* volume, libtabfs_lba_28_t l
     fat->__volume = volume;
     fat->__lba = lba;
     fat->__byteSize = size;
+    fat->__used_map = NULL;
+    fat->__free_hint_lba = 0;
+    fat->__free_hint_size = 0;
+
+    // add the fat to our cache! if an other thread read it at the same time, its copy wins
+    libtabfs_fat_t* cached = (libtabfs_fat_t*) libtabfs_cache_add(volume->__fat_cache, lba, fat, LIBTABFS_FAT_DATAOFFSET + size);
+    if (cached != fat) {
+        libtabfs_free(fat, LIBTABFS_FAT_DATAOFFSET + size);
+    }
 
-    // add the fat to our cache!
-    libtabfs_linkedlist_add(volume->__fat_cache, fat);
-
-    return fat;
+    return cached;
 }
 
 libtabfs_fat_t* libtabfs_find_cached_fat(libtabfs_volume_t* volume, libtabfs_lba_28_t fat_lba) {
-    libtabfs_linkedlist_entry_t* entry = volume->__fat_cache->head;
-    while (entry != NULL) {
-        libtabfs_fat_t* fat = (libtabfs_fat_t*) entry->data;
-        if (fat->__lba == fat_lba) {
-            return fat;
-        }
-        else {
-            entry = entry->next;
-        }
+    return (libtabfs_fat_t*) libtabfs_cache_find(volume->__fat_cache, fat_lba);
+}
+
+void libtabfs_fat_pin(libtabfs_fat_t* fat) {
+    libtabfs_cache_pin(fat->__volume->__fat_cache, fat->__lba);
+}
+
+void libtabfs_fat_unpin(libtabfs_fat_t* fat) {
+    libtabfs_cache_unpin(fat->__volume->__fat_cache, fat->__lba);
+}
+
+void libtabfs_fat_release(libtabfs_fat_t* fat) {
+    if (fat != NULL) {
+        libtabfs_fat_unpin(fat);
     }
-    return NULL;
+}
+
+/**
+ * @brief starts an call that works on an fat section; the section counts as used by the call,
+ * so it stays in the fatcache until the end of the next one
+ */
+static inline void libtabfs_fat_call_enter(libtabfs_fat_t* fat) {
+    libtabfs_cache_enter(fat->__volume->__cache_budget);
+    libtabfs_cache_find(fat->__volume->__fat_cache, fat->__lba);
 }
 
 libtabfs_fat_t* libtabfs_get_fat_section(libtabfs_volume_t* volume, libtabfs_lba_28_t lba, unsigned int size) {
@@ -71,9 +97,18 @@ libtabfs_fat_t* libtabfs_create_fat_section(
     fat->__volume = volume;
     fat->__lba = lba;
     fat->__byteSize = size;
+    fat->__used_map = NULL;
+    fat->__free_hint_lba = 0;
+    fat->__free_hint_size = 0;
 
     // add the table to our cache!
-    libtabfs_linkedlist_add(volume->__fat_cache, fat);
+    libtabfs_cache_add(volume->__fat_cache, lba, fat, LIBTABFS_FAT_DATAOFFSET + size);
+
+    // the section in memory needs to be empty too, its written over the zeroed blocks below
+    unsigned char* data = (unsigned char*) fat + LIBTABFS_FAT_DATAOFFSET;
+    for (unsigned int i = 0; i < size; i++) {
+        data[i] = 0;
+    }
 
     // initialize the table (by zeroing it)
     int blocks = size / fat->__volume->blockSize;
@@ -93,6 +128,9 @@ libtabfs_fat_t* libtabfs_create_fat_section(
 
 void libtabfs_fat_cachefree_callback(libtabfs_fat_t* fat) {
     libtabfs_fat_sync(fat);
+    if (fat->__used_map != NULL) {
+        libtabfs_free(fat->__used_map, LIBTABFS_FAT_USEDMAPSIZE(fat));
+    }
     libtabfs_free(fat, LIBTABFS_FAT_DATAOFFSET + fat->__byteSize);
 }
 
@@ -100,8 +138,49 @@ void libtabfs_fat_cachefree_callback(libtabfs_fat_t* fat) {
 // FAT traversal
 //--------------------------------------------------------------------------------
 
-libtabfs_error libtabfs_fat_findfree(
-    libtabfs_fat_t* fat,
+static inline bool libtabfs_fat_entry_is_free(libtabfs_fat_entry_t* entry) {
+    return entry->index == 0 && entry->lba == 0;
+}
+
+/**
+ * @brief searches the first free entry at or after an offset of an single fat section with the map of used
+ * entries of the section, which is build on first use; entries that got used since then are marked on the way
+ * 
+ * @return offset of the free entry or -1 if there is none
+ */
+static int libtabfs_fat_first_free(libtabfs_fat_t* fat, int from) {
+    int entryCount = LIBTABFS_FAT_ENTRYCOUNT(fat);
+    unsigned char* map = fat->__used_map;
+    if (map == NULL) {
+        // entry 0 is covered by the header
+        map = (unsigned char*) libtabfs_alloc(LIBTABFS_FAT_USEDMAPSIZE(fat));
+        libtabfs_memset(map, 0, LIBTABFS_FAT_USEDMAPSIZE(fat));
+        map[0] = 0x80;
+        for (int i = 1; i < entryCount; i++) {
+            if (!libtabfs_fat_entry_is_free(&(fat->entries[i]))) {
+                map[i / 8] |= (0x80 >> (i % 8));
+            }
+        }
+        fat->__used_map = map;
+    }
+
+    long i = from;
+    while ((i = libtabfs_bitmap_find_clear(map, i, entryCount)) < entryCount) {
+        if (libtabfs_fat_entry_is_free(&(fat->entries[i]))) {
+            return i;
+        }
+        map[i / 8] |= (0x80 >> (i % 8));
+        i++;
+    }
+    return -1;
+}
+
+/**
+ * @brief like libtabfs_fat_findfree, but starts searching at an given entry of the section;
+ * callers that fill many entries use it to continue where the last search ended
+ */
+static libtabfs_error libtabfs_fat_findfree_from(
+    libtabfs_fat_t* fat, int from,
     libtabfs_fat_entry_t** entry_out,
     libtabfs_fat_t** fat_out,
     int* offset_out
@@ -109,49 +188,97 @@ libtabfs_error libtabfs_fat_findfree(
     if (entry_out == NULL) { return LIBTABFS_ERR_ARGS; }
     *entry_out = NULL;
 
-    int entryCount = fat->__byteSize / 16;
-    for (int i = 1; i < entryCount; i++) {
-        libtabfs_fat_entry_t* entry = &(fat->entries[i]);
-        if (entry->index == 0 && entry->lba == 0) {
-            *entry_out = entry;
+    // sections before the hint are known to be full, so the search continues there
+    libtabfs_fat_t* start = fat;
+    if (libtabfs_fat_first_free(start, from) < 0 && start->__free_hint_size != 0) {
+        fat = libtabfs_get_fat_section(start->__volume, start->__free_hint_lba, start->__free_hint_size);
+        from = 1;
+    }
+
+    while (1) {
+        int offset = libtabfs_fat_first_free(fat, from);
+        if (offset >= 0) {
+            if (fat != start) {
+                start->__free_hint_lba = fat->__lba;
+                start->__free_hint_size = fat->__byteSize;
+            }
+            *entry_out = &(fat->entries[offset]);
             if (fat_out != NULL) { *fat_out = fat; }
-            if (offset_out != NULL) { *offset_out = i; }
+            if (offset_out != NULL) { *offset_out = offset; }
             return LIBTABFS_ERR_NONE;
         }
-    }
 
-    if (fat->next_size != 0 && !LIBTABFS_IS_INVALID_LBA28(fat->next_section)) {
+        if (fat->next_size == 0 || LIBTABFS_IS_INVALID_LBA28(fat->next_section)) {
+            break;
+        }
+
         // try to find in next section
-        libtabfs_fat_t* next_section = libtabfs_get_fat_section(fat->__volume, fat->next_section, fat->next_size);
-        return libtabfs_fat_findfree(next_section, entry_out, fat_out, offset_out);
+        fat = libtabfs_get_fat_section(fat->__volume, fat->next_section, fat->next_size);
+        from = 1;
     }
-    else {
-        // no next section configured; create a new section!
 
-        libtabfs_lba_28_t next_section_lba = libtabfs_bat_allocateChainedBlocks(fat->__volume, 2);
-        if (LIBTABFS_IS_INVALID_LBA28(next_section_lba)) {
-            return LIBTABFS_ERR_DEVICE_NOSPACE;
-        }
+    // no next section configured; create a new section!
 
-        int next_section_size = 2 * fat->__volume->blockSize;
+    libtabfs_lba_28_t next_section_lba = libtabfs_bat_allocateChainedBlocksAt(fat->__volume, 2, fat->__lba);
+    if (LIBTABFS_IS_INVALID_LBA28(next_section_lba)) {
+        return LIBTABFS_ERR_DEVICE_NOSPACE;
+    }
 
-        libtabfs_fat_t* next_section = libtabfs_create_fat_section(
-            fat->__volume, next_section_lba, next_section_size
-        );
+    int next_section_size = 2 * fat->__volume->blockSize;
+
+    libtabfs_fat_t* next_section = libtabfs_create_fat_section(
+        fat->__volume, next_section_lba, next_section_size
+    );
+
+    fat->next_section = next_section_lba;
+    fat->next_size = next_section_size;
 
-        fat->next_section = next_section_lba;
-        fat->next_size = next_section_size;
+    start->__free_hint_lba = next_section_lba;
+    start->__free_hint_size = next_section_size;
 
-        *entry_out = &(next_section->entries[1]);
-        if (fat_out != NULL) { *fat_out = next_section; }
-        if (offset_out != NULL) { *offset_out = 1; }
+    *entry_out = &(next_section->entries[1]);
+    if (fat_out != NULL) { *fat_out = next_section; }
+    if (offset_out != NULL) { *offset_out = 1; }
 
-        return LIBTABFS_ERR_NONE;
+    return LIBTABFS_ERR_NONE;
+}
+
+libtabfs_error libtabfs_fat_findfree(
+    libtabfs_fat_t* fat,
+    libtabfs_fat_entry_t** entry_out,
+    libtabfs_fat_t** fat_out,
+    int* offset_out
+) {
+    libtabfs_fat_call_enter(fat);
+    libtabfs_error err = libtabfs_fat_findfree_from(fat, 1, entry_out, fat_out, offset_out);
+    if (err == LIBTABFS_ERR_NONE && fat_out != NULL) {
+        libtabfs_fat_pin(*fat_out);
     }
-    return LIBTABFS_ERR_FAT_FULL;
+    libtabfs_cache_leave(fat->__volume->__cache_budget);
+    return err;
 }
 
-libtabfs_error libtabfs_fat_findlatest(
+void libtabfs_fat_free_entry(libtabfs_fat_t* fat, libtabfs_fat_t* section, int offset) {
+    libtabfs_fat_call_enter(fat);
+    libtabfs_memset(&(section->entries[offset]), 0, sizeof(libtabfs_fat_entry_t));
+    if (section->__used_map != NULL) {
+        section->__used_map[offset / 8] &= ~(0x80 >> (offset % 8));
+    }
+
+    // searches starting in an earlier section would skip this one because of their hint
+    libtabfs_fat_t* cur = fat;
+    while (cur != NULL && cur != section) {
+        cur->__free_hint_lba = 0;
+        cur->__free_hint_size = 0;
+        if (cur->next_size == 0 || LIBTABFS_IS_INVALID_LBA28(cur->next_section)) {
+            break;
+        }
+        cur = libtabfs_get_fat_section(cur->__volume, cur->next_section, cur->next_size);
+    }
+    libtabfs_cache_leave(fat->__volume->__cache_budget);
+}
+
+static libtabfs_error libtabfs_fat_findlatest_impl(
     int index,
     libtabfs_fat_t* fat,
     libtabfs_fat_entry_t** entry_out,
@@ -162,15 +289,23 @@ libtabfs_error libtabfs_fat_findlatest(
     *entry_out = NULL;
 
     libtabfs_time_t currentTime = { .i64_data = 0 };
-    int entryCount = (fat->__byteSize / 16) - 1;
-    for (int i = 0; i < entryCount; i++) {
-        libtabfs_fat_entry_t* entry = &(fat->entries[i]);
-        if (entry->index == index && entry->modify_date.i64_data > currentTime.i64_data) {
-            *entry_out = entry;
-            if (fat_out != NULL) { *fat_out = fat; }
-            if (offset_out != NULL) { *offset_out = i; }
-            currentTime = entry->modify_date;
+    while (fat != NULL) {
+        int entryCount = (fat->__byteSize / 16) - 1;
+        for (int i = 0; i < entryCount; i++) {
+            libtabfs_fat_entry_t* entry = &(fat->entries[i]);
+            if (entry->index == index && entry->modify_date.i64_data > currentTime.i64_data) {
+                *entry_out = entry;
+                if (fat_out != NULL) { *fat_out = fat; }
+                if (offset_out != NULL) { *offset_out = i; }
+                currentTime = entry->modify_date;
+            }
         }
+
+        // entries of an file can be spread over all its sections
+        if (fat->next_size == 0 || LIBTABFS_IS_INVALID_LBA28(fat->next_section)) {
+            break;
+        }
+        fat = libtabfs_get_fat_section(fat->__volume, fat->next_section, fat->next_size);
     }
 
     if (currentTime.i64_data == 0) {
@@ -179,6 +314,22 @@ libtabfs_error libtabfs_fat_findlatest(
     return LIBTABFS_ERR_NONE;
 }
 
+libtabfs_error libtabfs_fat_findlatest(
+    int index,
+    libtabfs_fat_t* fat,
+    libtabfs_fat_entry_t** entry_out,
+    libtabfs_fat_t** fat_out,
+    int* offset_out
+) {
+    libtabfs_fat_call_enter(fat);
+    libtabfs_error err = libtabfs_fat_findlatest_impl(index, fat, entry_out, fat_out, offset_out);
+    if (err == LIBTABFS_ERR_NONE && fat_out != NULL) {
+        libtabfs_fat_pin(*fat_out);
+    }
+    libtabfs_cache_leave(fat->__volume->__cache_budget);
+    return err;
+}
+
 // libtabfs_error libtabfs_fat_find(
 //     int index, libtabfs_time_t timestamp,
 //     libtabfs_fat_t* fat,
@@ -195,7 +346,7 @@ libtabfs_error libtabfs_fat_findlatest(
 #define NAME_CHECK \
     int namelen = libtabfs_strlen(name); if (namelen > 62) { return LIBTABFS_ERR_NAME_TOLONG; }
 
-libtabfs_error libtabfs_create_fatfile(
+static libtabfs_error libtabfs_create_fatfile_impl(
     libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
     libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
     libtabfs_entrytable_entry_t** entry_out
@@ -203,7 +354,7 @@ libtabfs_error libtabfs_create_fatfile(
     NAME_CHECK
     if (entry_out == NULL) { return LIBTABFS_ERR_ARGS; }
 
-    libtabfs_lba_28_t fatTable_lba = libtabfs_bat_allocateChainedBlocks(entrytable->__volume, 2);
+    libtabfs_lba_28_t fatTable_lba = libtabfs_bat_allocateChainedBlocksAt(entrytable->__volume, 2, entrytable->__lba);
     if (LIBTABFS_IS_INVALID_LBA28(fatTable_lba)) {
         return LIBTABFS_ERR_DEVICE_NOSPACE;
     }
@@ -240,7 +391,156 @@ libtabfs_error libtabfs_create_fatfile(
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_fatfile_read(
+libtabfs_error libtabfs_create_fatfile(
+    libtabfs_entrytable_t* entrytable, char* name, libtabfs_fileflags_t fileflags,
+    libtabfs_time_t create_ts, unsigned int userid, unsigned int groupid,
+    libtabfs_entrytable_entry_t** entry_out
+) {
+    libtabfs_cache_enter(entrytable->__volume->__cache_budget);
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_error err = libtabfs_create_fatfile_impl(entrytable, name, fileflags, create_ts, userid, groupid, entry_out);
+    libtabfs_entrytable_unlock(lock, true);
+    libtabfs_cache_leave(entrytable->__volume->__cache_budget);
+    return err;
+}
+
+/**
+ * @brief collects the latest entry of every block with an index in [first, first + count) in one pass over all
+ * sections of the fat, instead of one libtabfs_fat_findlatest per block
+ * 
+ * @return array of count entries, NULL for blocks that dont exist; free it with libtabfs_fat_unmap_range
+ */
+static libtabfs_fat_entry_t** libtabfs_fat_map_range(libtabfs_fat_t* fat, int first, int count) {
+    libtabfs_fat_entry_t** map = (libtabfs_fat_entry_t**) libtabfs_alloc(sizeof(libtabfs_fat_entry_t*) * count);
+    for (int i = 0; i < count; i++) {
+        map[i] = NULL;
+    }
+
+    while (fat != NULL) {
+        int entryCount = (fat->__byteSize / 16) - 1;
+        for (int i = 0; i < entryCount; i++) {
+            libtabfs_fat_entry_t* entry = &(fat->entries[i]);
+            long slot = (long) entry->index - first;
+            if (slot < 0 || slot >= count || entry->modify_date.i64_data == 0) {
+                continue;
+            }
+            if (map[slot] == NULL || entry->modify_date.i64_data > map[slot]->modify_date.i64_data) {
+                map[slot] = entry;
+            }
+        }
+
+        if (fat->next_size == 0 || LIBTABFS_IS_INVALID_LBA28(fat->next_section)) {
+            break;
+        }
+        fat = libtabfs_get_fat_section(fat->__volume, fat->next_section, fat->next_size);
+    }
+    return map;
+}
+
+static void libtabfs_fat_unmap_range(libtabfs_fat_entry_t** map, int count) {
+    libtabfs_free(map, sizeof(libtabfs_fat_entry_t*) * count);
+}
+
+/**
+ * @brief calculates where a new block of an fatfile should be placed: right after the block before it,
+ * or right after the fat itself if there is none
+ */
+static libtabfs_lba_28_t libtabfs_fat_goal(libtabfs_fat_t* fat, libtabfs_fat_entry_t* prev) {
+    if (prev != NULL) {
+        return prev->lba + 1;
+    }
+    return fat->__lba + (fat->__byteSize / fat->__volume->blockSize);
+}
+
+/**
+ * @brief makes sure all blocks with an index in [startBlockIndex, startBlockIndex + count) exist in the fat;
+ * the missing ones are allocated together in one pass over the bat. With contiguous set, each run of missing blocks
+ * is taken as one chained run if the bat has one; otherwise they are collected from wherever blocks are free
+ * 
+ * @param map result of libtabfs_fat_map_range for startBlockIndex - 1 and count + 1 blocks; the created entries are
+ * filled into it, so afterwards map[i + 1] is the entry of block startBlockIndex + i
+ */
+static libtabfs_error libtabfs_fat_allocate_missing(
+    libtabfs_fat_t* fat, libtabfs_fat_entry_t** map, int startBlockIndex, int count, bool contiguous
+) {
+    libtabfs_volume_t* volume = fat->__volume;
+    libtabfs_fat_entry_t* fatentry = NULL;
+
+    // free entries are searched from where the last one was found
+    libtabfs_fat_t* free_fat = fat;
+    int free_offset = 1;
+
+    int i = 0;
+    while (i < count) {
+        // skip over blocks that already exist
+        if (map[i + 1] != NULL) {
+            i++;
+            continue;
+        }
+
+        // collect the following missing blocks; at most as many as an allocation can hand out
+        int missing = 0;
+        while (i + missing < count && missing < 0xFFFF && map[i + missing + 1] == NULL) {
+            missing++;
+        }
+
+        long long* lbas = (long long*) libtabfs_alloc(sizeof(long long) * missing);
+        libtabfs_lba_28_t goal = libtabfs_fat_goal(fat, startBlockIndex + i > 0 ? map[i] : NULL);
+        libtabfs_lba_28_t run = contiguous ? libtabfs_bat_allocateChainedBlocksAt(volume, missing, goal) : LIBTABFS_INVALID_LBA28;
+        if (!LIBTABFS_IS_INVALID_LBA28(run)) {
+            for (int j = 0; j < missing; j++) {
+                lbas[j] = run + j;
+            }
+        }
+        else if (!libtabfs_bat_allocateLoseBlocksAt(volume, missing, goal, lbas)) {
+            libtabfs_free(lbas, sizeof(long long) * missing);
+            return LIBTABFS_ERR_DEVICE_NOSPACE;
+        }
+
+        for (int j = 0; j < missing; j++) {
+            libtabfs_error err = libtabfs_fat_findfree_from(free_fat, free_offset, &fatentry, &free_fat, &free_offset);
+            if (err != LIBTABFS_ERR_NONE) {
+                // give back all blocks that didnt got an entry
+                libtabfs_bat_freeLoseBlocks(volume, missing - j, lbas + j);
+                libtabfs_free(lbas, sizeof(long long) * missing);
+                return err;
+            }
+            free_offset++;
+
+            fatentry->index = startBlockIndex + i + j;
+            fatentry->lba = lbas[j];
+            libtabfs_get_current_time(&(fatentry->modify_date));
+            map[i + j + 1] = fatentry;
+
+            #ifdef LIBTABFS_DEBUG_PRINTF
+                printf("-> creating new block for index %d with lba 0x%x\n", fatentry->index, fatentry->lba);
+            #endif
+        }
+
+        libtabfs_free(lbas, sizeof(long long) * missing);
+        i += missing;
+    }
+
+    return LIBTABFS_ERR_NONE;
+}
+
+void* libtabfs_fatfile_lock(libtabfs_volume_t* volume, libtabfs_entrytable_entry_t* entry, bool exclusive) {
+    void* lock = entry != NULL ? libtabfs_volume_object_lock(volume, entry->data.lba_and_size.lba) : NULL;
+    if (lock != NULL) {
+        if (exclusive) { LIBTABFS_LOCK_EXCLUSIVE(lock); }
+        else { LIBTABFS_LOCK_SHARED(lock); }
+    }
+    return lock;
+}
+
+void libtabfs_fatfile_unlock(void* lock, bool exclusive) {
+    if (lock != NULL) {
+        if (exclusive) { LIBTABFS_UNLOCK_EXCLUSIVE(lock); }
+        else { LIBTABFS_UNLOCK_SHARED(lock); }
+    }
+}
+
+static libtabfs_error libtabfs_fatfile_read_impl(
     libtabfs_volume_t* volume,
     libtabfs_entrytable_entry_t* entry,
     unsigned long int offset, unsigned long int len, unsigned char* buffer,
@@ -267,35 +567,13 @@ libtabfs_error libtabfs_fatfile_read(
             offset, len, lenInclBlockOffset, blocksToTouch, startBlockIndex);
     #endif
 
+    // reads dont create blocks; only writes make the file bigger
+    libtabfs_fat_entry_t** map = libtabfs_fat_map_range(fat, startBlockIndex, blocksToTouch);
+
     // iterate over the blocks
+    unsigned long int done = 0;
     for (int i = 0; i < blocksToTouch; i++) {
-        libtabfs_fat_entry_t* fatentry = NULL;
-        int blockIndex = startBlockIndex + i;
-        libtabfs_error err = libtabfs_fat_findlatest(blockIndex, fat, &fatentry, NULL, NULL);
-        if (err == LIBTABFS_ERR_NOT_FOUND) {
-            // TODO: maybe optimize this a bit and dont create blocks when only reading... only make file bigger when writing!
-
-            err = libtabfs_fat_findfree(fat, &fatentry, NULL, NULL);
-            if (err != LIBTABFS_ERR_NONE) {
-                return err;
-            }
-
-            libtabfs_lba_28_t blockLba = libtabfs_bat_allocateChainedBlocks(fat->__volume, 1);
-            if (LIBTABFS_IS_INVALID_LBA28(blockLba)) {
-                return LIBTABFS_ERR_DEVICE_NOSPACE;
-            }
-
-            fatentry->index = blockIndex;
-            fatentry->lba = blockLba;
-            libtabfs_get_current_time(&(fatentry->modify_date));
-
-            #ifdef LIBTABFS_DEBUG_PRINTF
-                printf("-> creating new block for index %d with lba 0x%x\n", blockIndex, blockLba);
-            #endif
-        }
-        else if (err != LIBTABFS_ERR_NONE) {
-            return err;
-        }
+        libtabfs_fat_entry_t* fatentry = map[i];
 
         // copy bytes into buffer
         int block_off = 0;
@@ -311,26 +589,48 @@ libtabfs_error libtabfs_fatfile_read(
 
         if (i >= (blocksToTouch - 1)) {
             // if last block, only copy the fraction we actually want
-            block_len = len - (*bytesRead);
+            block_len = len - done;
         }
 
         #ifdef LIBTABFS_DEBUG_PRINTF
-            printf("-> i=%d | blockIndex=%d | block_off=%d | block_len=%d\n", i, blockIndex, block_off, block_len);
+            printf("-> i=%d | blockIndex=%d | block_off=%d | block_len=%d\n", i, startBlockIndex + i, block_off, block_len);
         #endif
 
-        libtabfs_read_device(
-            volume->__dev_data,
-            fatentry->lba, volume->flags.absolute_lbas,
-            block_off, buffer + (i * volume->blockSize), block_len
-        );
+        if (fatentry != NULL) {
+            libtabfs_read_device(
+                volume->__dev_data,
+                fatentry->lba, volume->flags.absolute_lbas,
+                block_off, buffer + done, block_len
+            );
+        }
+        else {
+            // blocks that were never written read as zeros
+            libtabfs_memset(buffer + done, 0, block_len);
+        }
 
+        done += block_len;
         *bytesRead += block_len;
     }
 
+    libtabfs_fat_unmap_range(map, blocksToTouch);
     return LIBTABFS_ERR_NONE;
 }
 
-libtabfs_error libtabfs_fatfile_write(
+libtabfs_error libtabfs_fatfile_read(
+    libtabfs_volume_t* volume,
+    libtabfs_entrytable_entry_t* entry,
+    unsigned long int offset, unsigned long int len, unsigned char* buffer,
+    unsigned long int* bytesRead
+) {
+    libtabfs_cache_enter(volume->__cache_budget);
+    void* lock = libtabfs_fatfile_lock(volume, entry, false);
+    libtabfs_error err = libtabfs_fatfile_read_impl(volume, entry, offset, len, buffer, bytesRead);
+    libtabfs_fatfile_unlock(lock, false);
+    libtabfs_cache_leave(volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_fatfile_write_impl(
     libtabfs_volume_t* volume,
     libtabfs_entrytable_entry_t* entry,
     unsigned long int offset, unsigned long int len, unsigned char* buffer,
@@ -357,33 +657,18 @@ libtabfs_error libtabfs_fatfile_write(
             offset, len, lenInclBlockOffset, blocksToTouch, startBlockIndex);
     #endif
 
+    // allocate all blocks that dont exist yet in one go
+    libtabfs_fat_entry_t** map = libtabfs_fat_map_range(fat, startBlockIndex - 1, blocksToTouch + 1);
+    libtabfs_error err = libtabfs_fat_allocate_missing(fat, map, startBlockIndex, blocksToTouch, false);
+    if (err != LIBTABFS_ERR_NONE) {
+        libtabfs_fat_unmap_range(map, blocksToTouch + 1);
+        return err;
+    }
+
     // iterate over the blocks
+    unsigned long int done = 0;
     for (int i = 0; i < blocksToTouch; i++) {
-        libtabfs_fat_entry_t* fatentry = NULL;
-        int blockIndex = startBlockIndex + i;
-        libtabfs_error err = libtabfs_fat_findlatest(blockIndex, fat, &fatentry, NULL, NULL);
-        if (err == LIBTABFS_ERR_NOT_FOUND) {
-            err = libtabfs_fat_findfree(fat, &fatentry, NULL, NULL);
-            if (err != LIBTABFS_ERR_NONE) {
-                return err;
-            }
-
-            libtabfs_lba_28_t blockLba = libtabfs_bat_allocateChainedBlocks(fat->__volume, 1);
-            if (LIBTABFS_IS_INVALID_LBA28(blockLba)) {
-                return LIBTABFS_ERR_DEVICE_NOSPACE;
-            }
-
-            fatentry->index = blockIndex;
-            fatentry->lba = blockLba;
-            libtabfs_get_current_time(&(fatentry->modify_date));
-
-            #ifdef LIBTABFS_DEBUG_PRINTF
-                printf("-> creating new block for index %d with lba 0x%x and modify_date %d\n", blockIndex, blockLba, fatentry->modify_date.i64_data);
-            #endif
-        }
-        else if (err != LIBTABFS_ERR_NONE) {
-            return err;
-        }
+        libtabfs_fat_entry_t* fatentry = map[i + 1];
 
         // copy bytes from buffer
         int block_off = 0;
@@ -399,17 +684,73 @@ libtabfs_error libtabfs_fatfile_write(
 
         if (i >= (blocksToTouch - 1)) {
             // if last block, only copy the fraction we actually want
-            block_len = len - (*bytesWritten);
+            block_len = len - done;
         }
 
         libtabfs_write_device(
             volume->__dev_data,
             fatentry->lba, volume->flags.absolute_lbas,
-            block_off, buffer + (i * volume->blockSize), block_len
+            block_off, buffer + done, block_len
         );
 
+        done += block_len;
         *bytesWritten += block_len;
     }
 
+    libtabfs_fat_unmap_range(map, blocksToTouch + 1);
     return LIBTABFS_ERR_NONE;
+}
+
+libtabfs_error libtabfs_fatfile_write(
+    libtabfs_volume_t* volume,
+    libtabfs_entrytable_entry_t* entry,
+    unsigned long int offset, unsigned long int len, unsigned char* buffer,
+    unsigned long int* bytesWritten
+) {
+    libtabfs_cache_enter(volume->__cache_budget);
+    void* lock = libtabfs_fatfile_lock(volume, entry, true);
+    libtabfs_error err = libtabfs_fatfile_write_impl(volume, entry, offset, len, buffer, bytesWritten);
+    libtabfs_fatfile_unlock(lock, true);
+    libtabfs_cache_leave(volume->__cache_budget);
+    return err;
+}
+
+static libtabfs_error libtabfs_fatfile_preallocate_impl(
+    libtabfs_volume_t* volume,
+    libtabfs_entrytable_entry_t* entry,
+    unsigned long int offset, unsigned long int len
+) {
+    if (entry == NULL || entry->flags.type != LIBTABFS_ENTRYTYPE_FILE_FAT) {
+        return LIBTABFS_ERR_ARGS;
+    }
+    if (len == 0) { return LIBTABFS_ERR_NONE; }
+
+    libtabfs_fat_t* fat = libtabfs_get_fat_section(volume, entry->data.lba_and_size.lba, entry->data.lba_and_size.size);
+
+    // same span of blocks a write of len bytes at offset would touch
+    unsigned long int startBlockIndex = offset / volume->blockSize;
+    unsigned long int endBlockIndex = (offset + len + volume->blockSize - 1) / volume->blockSize;
+
+    #ifdef LIBTABFS_DEBUG_PRINTF
+        printf("libtabfs_fatfile_preallocate(offset: %lu, len: %lu); blocks %lu - %lu\n", offset, len, startBlockIndex, endBlockIndex);
+    #endif
+
+    int count = endBlockIndex - startBlockIndex;
+    libtabfs_fat_entry_t** map = libtabfs_fat_map_range(fat, startBlockIndex - 1, count + 1);
+    libtabfs_error err = libtabfs_fat_allocate_missing(fat, map, startBlockIndex, count, true);
+    libtabfs_fat_unmap_range(map, count + 1);
+    return err;
+}
+
+libtabfs_error libtabfs_fatfile_preallocate(
+    libtabfs_volume_t* volume,
+    libtabfs_entrytable_entry_t* entry,
+    unsigned long int offset, unsigned long int len
+) {
+    libtabfs_cache_enter(volume->__cache_budget);
+    void* lock = libtabfs_fatfile_lock(volume, entry, true);
+    libtabfs_error err = libtabfs_fatfile_preallocate_impl(volume, entry, offset, len);
+    libtabfs_fatfile_unlock(lock, true);
+    libtabfs_cache_leave(volume->__cache_budget);
+    return err;
 }
\ No newline at end of file
@@ -0,0 +1,294 @@
+#include "bridge.h"
+
+#include "common.h"
+#include "volume.h"
+#include "bat.h"
+#include "entrytable.h"
+#include "dirindex.h"
+#include "hashdir.h"
+
+#define LIBTABFS_GET_TABLEINFO(table)   ((libtabfs_entrytable_tableinfo_t*) &( (table)->entries[0] ))
+
+static libtabfs_hashdir_table_t* libtabfs_hashdir_table_create(libtabfs_lba_28_t lba, unsigned int bucket_bits) {
+    libtabfs_hashdir_table_t* table = (libtabfs_hashdir_table_t*) libtabfs_alloc(sizeof(libtabfs_hashdir_table_t));
+    table->lba = lba;
+    table->count = 1u << bucket_bits;
+    table->buckets = (libtabfs_hashdir_bucket_t*) libtabfs_alloc(sizeof(libtabfs_hashdir_bucket_t) * table->count);
+    return table;
+}
+
+#define LIBTABFS_HASHDIR_TABLE_BYTES(table)   (sizeof(libtabfs_hashdir_table_t) + sizeof(libtabfs_hashdir_bucket_t) * (table)->count)
+
+/**
+ * @brief gets the bucket table of an directory; its only read from the device if its not in memory already
+ */
+static libtabfs_hashdir_table_t* libtabfs_hashdir_get_table(libtabfs_entrytable_t* first_section) {
+    libtabfs_volume_t* volume = first_section->__volume;
+    libtabfs_hashdir_table_t* table = (libtabfs_hashdir_table_t*) libtabfs_cache_find(volume->__bucket_tables, first_section->__lba);
+    if (table != NULL) {
+        return table;
+    }
+
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(first_section);
+    table = libtabfs_hashdir_table_create(first_section->__lba, tabinfo->bucket_bits);
+
+    unsigned long table_size = sizeof(libtabfs_hashdir_bucket_t) * table->count;
+    for (unsigned long offset = 0; offset < table_size; offset += volume->blockSize) {
+        unsigned long size = table_size - offset < volume->blockSize ? table_size - offset : volume->blockSize;
+        libtabfs_read_device(
+            volume->__dev_data, tabinfo->bucket_table_lba + (offset / volume->blockSize), volume->flags.absolute_lbas,
+            0, (void*) table->buckets + offset, size
+        );
+    }
+
+    // readers load the table under the shared lock of the directory; so an other thread might have been faster
+    libtabfs_hashdir_table_t* cached = (libtabfs_hashdir_table_t*) libtabfs_cache_add(
+        volume->__bucket_tables, table->lba, table, LIBTABFS_HASHDIR_TABLE_BYTES(table)
+    );
+    if (cached != table) {
+        libtabfs_hashdir_table_destroy(table);
+    }
+    return cached;
+}
+
+/**
+ * @brief writes one slot of the bucket table of an directory to the device; slots never cross an block boundary
+ */
+static void libtabfs_hashdir_bucket_sync(libtabfs_entrytable_t* first_section, libtabfs_hashdir_table_t* table, unsigned int bucket) {
+    libtabfs_volume_t* volume = first_section->__volume;
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(first_section);
+
+    unsigned long offset = (unsigned long) bucket * sizeof(libtabfs_hashdir_bucket_t);
+    libtabfs_write_device(
+        volume->__dev_data, tabinfo->bucket_table_lba + (offset / volume->blockSize), volume->flags.absolute_lbas,
+        offset % volume->blockSize, (void*) &(table->buckets[bucket]), sizeof(libtabfs_hashdir_bucket_t)
+    );
+}
+
+static unsigned int libtabfs_hashdir_bucket_of(libtabfs_entrytable_t* first_section, unsigned int hash) {
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(first_section);
+    return hash & ((1u << tabinfo->bucket_bits) - 1);
+}
+
+static libtabfs_entrytable_t* libtabfs_hashdir_bucket_next(libtabfs_entrytable_t* section) {
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(section);
+    if (tabinfo->bucket_next_size != 0 && !LIBTABFS_IS_INVALID_LBA28(tabinfo->bucket_next_lba)) {
+        return libtabfs_get_entrytable(section->__volume, tabinfo->bucket_next_lba, tabinfo->bucket_next_size);
+    }
+    return NULL;
+}
+
+libtabfs_error libtabfs_create_hashed_dir(
+    LIBTABFS_GENERIC_ENTRY_ARGS, unsigned int bucket_bits,
+    libtabfs_entrytable_t** entrytable_newdir_out
+) {
+    if (entrytable_newdir_out == NULL || bucket_bits > LIBTABFS_HASHDIR_MAX_BUCKET_BITS) {
+        return LIBTABFS_ERR_ARGS;
+    }
+
+    libtabfs_volume_t* volume = entrytable->__volume;
+    unsigned long table_size = sizeof(libtabfs_hashdir_bucket_t) << bucket_bits;
+    int table_blocks = (table_size + volume->blockSize - 1) / volume->blockSize;
+
+    libtabfs_lba_28_t table_lba = libtabfs_bat_allocateChainedBlocksAt(volume, table_blocks, entrytable->__lba);
+    if (LIBTABFS_IS_INVALID_LBA28(table_lba)) {
+        return LIBTABFS_ERR_DEVICE_NOSPACE;
+    }
+
+    // the parent stays locked until the layout is set, so nobody can put entries into the new directory before
+    void* lock = libtabfs_entrytable_lock(entrytable, true);
+    libtabfs_entrytable_t* dir = NULL;
+    libtabfs_error err = libtabfs_create_dir_locked(entrytable, name, fileflags, create_ts, userid, groupid, &dir);
+    if (err != LIBTABFS_ERR_NONE) {
+        libtabfs_entrytable_unlock(lock, true);
+        libtabfs_bat_freeChainedBlocks(volume, table_blocks, table_lba);
+        return err;
+    }
+
+    // all buckets are empty
+    for (int i = 0; i < table_blocks; i++) {
+        libtabfs_set_range_device(volume->__dev_data, table_lba + i, volume->flags.absolute_lbas, 0, 0, volume->blockSize);
+    }
+
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(dir);
+    tabinfo->format = LIBTABFS_DIRFORMAT_HASHED;
+    tabinfo->bucket_bits = bucket_bits;
+    tabinfo->bucket_table_lba = table_lba;
+    libtabfs_entrytable_sync(dir);
+
+    // the table is known to be empty, so it never needs to be read
+    libtabfs_hashdir_table_t* table = libtabfs_hashdir_table_create(dir->__lba, bucket_bits);
+    libtabfs_memset(table->buckets, 0, sizeof(libtabfs_hashdir_bucket_t) * table->count);
+    libtabfs_cache_add(volume->__bucket_tables, table->lba, table, LIBTABFS_HASHDIR_TABLE_BYTES(table));
+    libtabfs_entrytable_unlock(lock, true);
+
+    *entrytable_newdir_out = dir;
+    return LIBTABFS_ERR_NONE;
+}
+
+bool libtabfs_hashdir_is_hashed(libtabfs_entrytable_t* first_section) {
+    return LIBTABFS_GET_TABLEINFO(first_section)->format == LIBTABFS_DIRFORMAT_HASHED;
+}
+
+libtabfs_error libtabfs_hashdir_lookup_impl(
+    libtabfs_entrytable_t* first_section, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    if (entry_out == NULL) { return LIBTABFS_ERR_ARGS; }
+    *entry_out = NULL;
+
+    unsigned int hash = libtabfs_name_hash_n(name, namelen);
+    libtabfs_hashdir_table_t* table = libtabfs_hashdir_get_table(first_section);
+    libtabfs_hashdir_bucket_t* slot = &(table->buckets[libtabfs_hashdir_bucket_of(first_section, hash)]);
+    if (slot->size == 0) {
+        return LIBTABFS_ERR_NONE;
+    }
+
+    libtabfs_entrytable_t* section = libtabfs_get_entrytable(first_section->__volume, slot->lba, slot->size);
+    while (section != NULL) {
+        int entryCount = section->__byteSize / 64;
+        for (int i = 1; i < entryCount; i++) {
+            libtabfs_entrytable_entry_t* entry = &(section->entries[i]);
+            if (libtabfs_entry_has_name(section->__volume, entry, name, namelen, hash)) {
+                *entry_out = entry;
+                if (entrytable_out != NULL) { *entrytable_out = section; }
+                if (offset_out != NULL) { *offset_out = i; }
+                return LIBTABFS_ERR_NONE;
+            }
+        }
+        section = libtabfs_hashdir_bucket_next(section);
+    }
+    return LIBTABFS_ERR_NONE;
+}
+
+libtabfs_error libtabfs_hashdir_lookup(
+    libtabfs_entrytable_t* first_section, const char* name, int namelen,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    libtabfs_cache_enter(first_section->__volume->__cache_budget);
+    libtabfs_error err = libtabfs_hashdir_lookup_impl(first_section, name, namelen, entry_out, entrytable_out, offset_out);
+    if (err == LIBTABFS_ERR_NONE && *entry_out != NULL && entrytable_out != NULL) {
+        libtabfs_entrytable_pin(*entrytable_out);
+    }
+    libtabfs_cache_leave(first_section->__volume->__cache_budget);
+    return err;
+}
+
+libtabfs_error libtabfs_hashdir_findfree_impl(
+    libtabfs_entrytable_t* first_section, char* name,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    if (entry_out == NULL) { return LIBTABFS_ERR_ARGS; }
+    *entry_out = NULL;
+
+    libtabfs_volume_t* volume = first_section->__volume;
+    unsigned int bucket = libtabfs_hashdir_bucket_of(first_section, libtabfs_name_hash(name));
+    libtabfs_hashdir_table_t* table = libtabfs_hashdir_get_table(first_section);
+    libtabfs_hashdir_bucket_t* slot = &(table->buckets[bucket]);
+
+    if (slot->size != 0) {
+        libtabfs_entrytable_t* section = libtabfs_get_entrytable(volume, slot->lba, slot->size);
+        while (section != NULL) {
+            int offset = libtabfs_entrytable_first_free(section);
+            if (offset >= 0) {
+                *entry_out = &(section->entries[offset]);
+                if (entrytable_out != NULL) { *entrytable_out = section; }
+                if (offset_out != NULL) { *offset_out = offset; }
+                return LIBTABFS_ERR_NONE;
+            }
+            section = libtabfs_hashdir_bucket_next(section);
+        }
+    }
+
+    // the bucket is full; add an new section in front of it
+    libtabfs_lba_28_t section_lba = libtabfs_bat_allocateChainedBlocksAt(volume, 2, first_section->__lba);
+    if (LIBTABFS_IS_INVALID_LBA28(section_lba)) {
+        return LIBTABFS_ERR_DEVICE_NOSPACE;
+    }
+    int section_size = 2 * volume->blockSize;
+
+    libtabfs_entrytable_t* section = libtabfs_create_entrytable(
+        volume, section_lba, section_size, libtabfs_entrytable_get_parent(first_section)
+    );
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(section);
+    tabinfo->bucket_next_lba = slot->lba;
+    tabinfo->bucket_next_size = slot->size;
+
+    // and link it right after the first section, so the linear chain stays complete
+    libtabfs_entrytable_tableinfo_t* first_tabinfo = LIBTABFS_GET_TABLEINFO(first_section);
+    tabinfo->prev_lba = first_section->__lba;
+    tabinfo->prev_size = first_section->__byteSize;
+    tabinfo->next_lba = first_tabinfo->next_lba;
+    tabinfo->next_size = first_tabinfo->next_size;
+
+    libtabfs_entrytable_t* old_next = libtabfs_entrytable_nextsection(first_section);
+    if (old_next != NULL) {
+        libtabfs_entrytable_tableinfo_t* old_next_tabinfo = LIBTABFS_GET_TABLEINFO(old_next);
+        old_next_tabinfo->prev_lba = section_lba;
+        old_next_tabinfo->prev_size = section_size;
+        libtabfs_entrytable_sync(old_next);
+    }
+    first_tabinfo->next_lba = section_lba;
+    first_tabinfo->next_size = section_size;
+    libtabfs_entrytable_sync(first_section);
+
+    // the section needs to be on disk before the bucket table points to it
+    libtabfs_entrytable_sync(section);
+    slot->lba = section_lba;
+    slot->size = section_size;
+    libtabfs_hashdir_bucket_sync(first_section, table, bucket);
+
+    *entry_out = &(section->entries[1]);
+    if (entrytable_out != NULL) { *entrytable_out = section; }
+    if (offset_out != NULL) { *offset_out = 1; }
+    return LIBTABFS_ERR_NONE;
+}
+
+libtabfs_error libtabfs_hashdir_findfree(
+    libtabfs_entrytable_t* first_section, char* name,
+    libtabfs_entrytable_entry_t** entry_out,
+    libtabfs_entrytable_t** entrytable_out,
+    int* offset_out
+) {
+    libtabfs_cache_enter(first_section->__volume->__cache_budget);
+    libtabfs_error err = libtabfs_hashdir_findfree_impl(first_section, name, entry_out, entrytable_out, offset_out);
+    if (err == LIBTABFS_ERR_NONE && entrytable_out != NULL) {
+        libtabfs_entrytable_pin(*entrytable_out);
+    }
+    libtabfs_cache_leave(first_section->__volume->__cache_budget);
+    return err;
+}
+
+
+void libtabfs_hashdir_drop(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
+    libtabfs_hashdir_table_t* table = (libtabfs_hashdir_table_t*) libtabfs_cache_find(volume->__bucket_tables, lba);
+    if (table != NULL) {
+        libtabfs_cache_remove(volume->__bucket_tables, lba);
+        libtabfs_hashdir_table_destroy(table);
+    }
+}
+
+void libtabfs_hashdir_remove(libtabfs_entrytable_t* first_section) {
+    if (!libtabfs_hashdir_is_hashed(first_section)) {
+        return;
+    }
+
+    libtabfs_volume_t* volume = first_section->__volume;
+    libtabfs_entrytable_tableinfo_t* tabinfo = LIBTABFS_GET_TABLEINFO(first_section);
+    libtabfs_hashdir_drop(volume, first_section->__lba);
+
+    unsigned long table_size = sizeof(libtabfs_hashdir_bucket_t) << tabinfo->bucket_bits;
+    int table_blocks = (table_size + volume->blockSize - 1) / volume->blockSize;
+    libtabfs_bat_freeChainedBlocks(volume, table_blocks, tabinfo->bucket_table_lba);
+}
+
+void libtabfs_hashdir_table_destroy(libtabfs_hashdir_table_t* table) {
+    libtabfs_free(table->buckets, sizeof(libtabfs_hashdir_bucket_t) * table->count);
+    libtabfs_free(table, sizeof(libtabfs_hashdir_table_t));
+}
@@ -39,4 +39,13 @@ const char* libtabfs_errstr(libtabfs_error error) {
         libtabfs_free(old, old_size);
         return new_mem;
     }
+#endif
+
+#ifdef LIBTABFS_DEFAULT_MEMSET
+    void libtabfs_memset(void* dest, unsigned char value, int count) {
+        unsigned char* bytes = (unsigned char*) dest;
+        for (int i = 0; i < count; i++) {
+            bytes[i] = value;
+        }
+    }
 #endif
\ No newline at end of file
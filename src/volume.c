@@ -5,12 +5,23 @@
 #include "bat.h"
 #include "entrytable.h"
 #include "fatfile.h"
+#include "dirindex.h"
+#include "hashdir.h"
+#include "dcache.h"
+#include "lock.h"
 
 const char* libtabfs_magic = "TABFS-28\0\0\0\0\0\0\0";
 
 #define ASSURE_NON_NULLPTR(what)    if (what == 0) { return LIBTABFS_ERR_GENERIC; }
 
 libtabfs_error libtabfs_new_volume(void* dev_data, long long lba_address, bool absolute_lba, libtabfs_volume_t** volume_out) {
+    return libtabfs_new_volume_ex(dev_data, lba_address, absolute_lba, NULL, volume_out);
+}
+
+libtabfs_error libtabfs_new_volume_ex(
+    void* dev_data, long long lba_address, bool absolute_lba,
+    const libtabfs_volume_options_t* options, libtabfs_volume_t** volume_out
+) {
     if (volume_out == NULL) { return LIBTABFS_ERR_ARGS; }
 
     libtabfs_header_t header;
@@ -48,8 +59,55 @@ libtabfs_error libtabfs_new_volume(void* dev_data, long long lba_address, bool a
     // store the device arguments into the volume
     volume->__dev_data = dev_data;
     volume->__lba = LIBTABFS_LBA48_TO_LBA28(header.info_LBA);
-    volume->__table_cache = libtabfs_linkedlist_create( (libtabfs_free_callback) libtabfs_entrytable_cachefree_callback );
-    volume->__fat_cache = libtabfs_linkedlist_create( (libtabfs_free_callback) libtabfs_fat_cachefree_callback );
+    volume->__cache_budget = (libtabfs_cache_budget_t*) libtabfs_alloc(sizeof(libtabfs_cache_budget_t));
+    #ifdef LIBTABFS_THREADSAFE
+        // pointers handed out to other threads must stay valid; so nothing is ever evicted
+        libtabfs_cache_budget_init(volume->__cache_budget, 0);
+        volume->__object_locks = (void**) libtabfs_alloc(sizeof(void*) * LIBTABFS_VOLUME_OBJECT_LOCKS);
+        for (int i = 0; i < LIBTABFS_VOLUME_OBJECT_LOCKS; i++) {
+            volume->__object_locks[i] = LIBTABFS_RWLOCK_CREATE();
+        }
+    #else
+        libtabfs_cache_budget_init(volume->__cache_budget, options != NULL ? options->cache_budget : 0);
+        volume->__object_locks = NULL;
+    #endif
+    volume->__table_cache = libtabfs_cache_create(
+        (libtabfs_free_callback) libtabfs_entrytable_cachefree_callback, volume->__cache_budget
+    );
+    volume->__fat_cache = libtabfs_cache_create(
+        (libtabfs_free_callback) libtabfs_fat_cachefree_callback, volume->__cache_budget
+    );
+    // both are rebuild from the device when needed, so they can be evicted like the sections
+    volume->__dir_indexes = libtabfs_cache_create(
+        (libtabfs_free_callback) libtabfs_dirindex_destroy, volume->__cache_budget
+    );
+    volume->__bucket_tables = libtabfs_cache_create(
+        (libtabfs_free_callback) libtabfs_hashdir_table_destroy, volume->__cache_budget
+    );
+    volume->__dcache = (options != NULL && options->dentry_cache_slots > 0) ? libtabfs_dcache_create(options->dentry_cache_slots) : NULL;
+    volume->__bat_regions = NULL;
+    volume->__bat_region_count = 0;
+    volume->__alloc_groups = NULL;
+    volume->__alloc_group_count = 0;
+    volume->__bat_index_capacity = 0;
+    volume->__bat_grow_lock = LIBTABFS_LOCK_CREATE();
+    volume->__alloc_cursor = volume->bat_start_LBA;
+    libtabfs_volume_set_alloc_policy(volume, options != NULL ? options->alloc_policy : NULL);
+    #ifdef LIBTABFS_THREADSAFE
+        // the page eviction walks over the sections of all groups; so all sections stay in memory
+        volume->__bat_lazy = false;
+    #else
+        volume->__bat_lazy = options != NULL && options->lazy_bat;
+    #endif
+    volume->__bat_page_budget = volume->__bat_lazy ? options->bat_page_budget : 0;
+    volume->__bat_pages_loaded = 0;
+    volume->__bat_clock_bat = NULL;
+    volume->__bat_clock_page = 0;
+    volume->__discard_pending = (libtabfs_extenttree_t*) libtabfs_alloc(sizeof(libtabfs_extenttree_t));
+    libtabfs_extenttree_init(volume->__discard_pending);
+    volume->__discard_inflight = NULL;
+    volume->__discard_lock = LIBTABFS_LOCK_CREATE();
+    volume->__discard_pending_blocks = 0;
 
     *volume_out = volume;
 
@@ -60,9 +118,12 @@ libtabfs_error libtabfs_new_volume(void* dev_data, long long lba_address, bool a
         bat->__next_bat = libtabfs_load_bat(volume, bat->next_bat);
         bat = bat->__next_bat;
     }
+    libtabfs_bat_build_index(volume);
 
     // read the root entrytable
+    // the root table is held by the volume for its whole lifetime, so it can never be evicted
     volume->__root_table = libtabfs_read_entrytable(volume, volume->root_LBA, volume->root_size);
+    libtabfs_entrytable_pin(volume->__root_table);
 
     return LIBTABFS_ERR_NONE;
 };
@@ -75,14 +136,13 @@ void libtabfs_volume_sync(libtabfs_volume_t* volume) {
         (void*)volume, 256
     );
 
-    // sync all bats
+    // sync all bats; only then the freed blocks can be discarded
     libtabfs_bat_sync(volume->__bat_root);
+    libtabfs_bat_discard_flush(volume);
 
     // sync all entrytables
-    libtabfs_linkedlist_entry_t* tablecache_entry = volume->__table_cache->head;
-    while (tablecache_entry != NULL) {
-        libtabfs_entrytable_sync(tablecache_entry->data);
-        tablecache_entry = tablecache_entry->next;
+    LIBTABFS_CACHE_FOREACH(volume->__table_cache, slot) {
+        libtabfs_entrytable_sync(slot->data);
     }
 }
 
@@ -104,6 +164,55 @@ const char* libtabfs_volume_get_label(libtabfs_volume_t* volume) {
     return volume->volume_label;
 }
 
+void libtabfs_volume_set_alloc_policy(libtabfs_volume_t* volume, const struct libtabfs_alloc_policy* policy) {
+    volume->__alloc_policy = policy != NULL ? policy : &libtabfs_alloc_first_fit;
+}
+
+libtabfs_error libtabfs_volume_statfs(libtabfs_volume_t* volume, libtabfs_volume_statfs_t* stat_out) {
+    if (stat_out == NULL) { return LIBTABFS_ERR_ARGS; }
+
+    // sections that where never touched in lazy mode are not counted yet
+    unsigned long long free = 0;
+    unsigned int group_count = LIBTABFS_ATOMIC_LOAD(volume->__alloc_group_count);
+    for (unsigned int i = 0; i < group_count; i++) {
+        libtabfs_alloc_group_t* group = &(volume->__alloc_groups[i]);
+        LIBTABFS_LOCK(group->lock);
+        for (libtabfs_bat_t* bat = group->first; ; bat = bat->__next_bat) {
+            libtabfs_bat_ensure_indexed(bat);
+            if (bat == group->last) { break; }
+        }
+        LIBTABFS_UNLOCK(group->lock);
+        free += LIBTABFS_ATOMIC_LOAD(group->free_count);
+    }
+
+    unsigned long long total = 0;
+    unsigned int region_count = LIBTABFS_ATOMIC_LOAD(volume->__bat_region_count);
+    if (region_count > 0) {
+        libtabfs_lba_28_t end = volume->__bat_regions[region_count - 1].end_lba;
+        if (end > volume->max_LBA + 1) { end = volume->max_LBA + 1; }
+        if (end > volume->bat_start_LBA) { total = end - volume->bat_start_LBA; }
+    }
+
+    if (free > total) { free = total; }
+
+    stat_out->block_size = volume->blockSize;
+    stat_out->total_blocks = total;
+    stat_out->free_blocks = free;
+    stat_out->used_blocks = total - free;
+    stat_out->largest_free_extent = libtabfs_bat_largest_free(volume);
+    if (stat_out->largest_free_extent > free) { stat_out->largest_free_extent = free; }
+    return LIBTABFS_ERR_NONE;
+}
+
+void* libtabfs_volume_object_lock(libtabfs_volume_t* volume, libtabfs_lba_28_t lba) {
+    if (volume->__object_locks == NULL) {
+        return NULL;
+    }
+    // fibonacci hashing, so directories allocated next to each other get different locks
+    unsigned int bits = __builtin_ctz(LIBTABFS_VOLUME_OBJECT_LOCKS);
+    return volume->__object_locks[(unsigned int) (lba * 2654435769u) >> (32 - bits)];
+}
+
 void libtabfs_destroy_volume(libtabfs_volume_t* volume) {
     libtabfs_volume_sync(volume);
 
@@ -114,12 +223,29 @@ void libtabfs_destroy_volume(libtabfs_volume_t* volume) {
         cur = cur->__next_bat;
         libtabfs_bat_destroy(tmp);
     }
+    libtabfs_bat_free_index(volume);
+    libtabfs_extenttree_destroy(volume->__discard_pending);
+    libtabfs_free(volume->__discard_pending, sizeof(libtabfs_extenttree_t));
+    LIBTABFS_LOCK_DESTROY(volume->__discard_lock);
+    LIBTABFS_LOCK_DESTROY(volume->__bat_grow_lock);
 
     // free all tables; the root table is also inside our cache!
-    libtabfs_linkedlist_destroy(volume->__table_cache);
+    libtabfs_cache_destroy(volume->__table_cache);
 
     // free all fats
-    libtabfs_linkedlist_destroy(volume->__fat_cache);
+    libtabfs_cache_destroy(volume->__fat_cache);
+    libtabfs_cache_destroy(volume->__dir_indexes);
+    libtabfs_cache_destroy(volume->__bucket_tables);
+    if (volume->__dcache != NULL) {
+        libtabfs_dcache_destroy(volume->__dcache);
+    }
+    libtabfs_free(volume->__cache_budget, sizeof(libtabfs_cache_budget_t));
+    if (volume->__object_locks != NULL) {
+        for (int i = 0; i < LIBTABFS_VOLUME_OBJECT_LOCKS; i++) {
+            LIBTABFS_RWLOCK_DESTROY(volume->__object_locks[i]);
+        }
+        libtabfs_free(volume->__object_locks, sizeof(void*) * LIBTABFS_VOLUME_OBJECT_LOCKS);
+    }
 
     libtabfs_free(volume, sizeof(struct libtabfs_volume));
 }
\ No newline at end of file
@@ -43,10 +43,9 @@ void dump_bat_region(libtabfs_bat_t* bat) {
     printf("  - lba range: 0x%llx - 0x%llx\n", start_lba, start_lba + count - 1);
 
     printf("  - data:\n");
-    // dump_mem(bat->data, libtabfs_bat_getDatabyteCount(bat));
 
     int last_valueable_byte = libtabfs_bat_getDatabyteCount(bat) - 1;
-    while (bat->data[last_valueable_byte] == 0x00) {
+    while (*libtabfs_bat_getdata(bat, last_valueable_byte) == 0x00) {
         last_valueable_byte--;
     }
 
@@ -64,7 +63,7 @@ void dump_bat_region(libtabfs_bat_t* bat) {
         else {
             printf(" | ");
         }
-        unsigned char byte = bat->data[i];
+        unsigned char byte = *libtabfs_bat_getdata(bat, i);
         printf(
             "%c %c %c %c %c %c %c %c",
             BITVAL(7), BITVAL(6), BITVAL(5), BITVAL(4),
@@ -78,12 +77,10 @@ void dump_bat_region(libtabfs_bat_t* bat) {
 }
 
 void dump_entrytable_cache(libtabfs_volume_t* volume) {
-    libtabfs_linkedlist_entry_t* cur = volume->__table_cache->head;
     printf("Entrytable cache:\n");
-    while (cur != NULL) {
-        libtabfs_entrytable_t* tab = (libtabfs_entrytable_t*) cur->data;
+    LIBTABFS_CACHE_FOREACH(volume->__table_cache, slot) {
+        libtabfs_entrytable_t* tab = (libtabfs_entrytable_t*) slot->data;
         printf("  - entrytable on lba 0x%x; size %d\n", tab->__lba, tab->__byteSize);
-        cur = cur->next;
     }
 }
 
@@ -109,6 +106,12 @@ void dump_entrytable_entry(libtabfs_entrytable_entry_t* e, libtabfs_volume_t* vo
         printf("  - parent: lba 0x%X | size %d\n", tabinf->parent_lba, tabinf->parent_size);
         printf("  - prev section: lba 0x%X | size %d\n", tabinf->prev_lba, tabinf->prev_size);
         printf("  - next section: lba 0x%X | size %d\n", tabinf->next_lba, tabinf->next_size);
+        if (tabinf->format == LIBTABFS_DIRFORMAT_HASHED) {
+            printf("  - hashed: %u buckets | bucket table: lba 0x%X\n", 1u << tabinf->bucket_bits, tabinf->bucket_table_lba);
+        }
+        if (tabinf->bucket_next_size != 0) {
+            printf("  - next section of bucket: lba 0x%X | size %d\n", tabinf->bucket_next_lba, tabinf->bucket_next_size);
+        }
     }
     else {
         printf("\n");
@@ -172,6 +175,9 @@ void dump_entrytable_entry(libtabfs_entrytable_entry_t* e, libtabfs_volume_t* vo
             libtabfs_entrytable_t* tab = libtabfs_get_entrytable(volume, e->longname_data.longname_lba, e->longname_data.longname_lba_size);
             libtabfs_entrytable_longname_t* lne = (libtabfs_entrytable_longname_t*) &( tab->entries[e->longname_data.longname_offset] );
             printf("    - '%s'\n", lne->name);
+            if (e->longname_data.fingerprint_identifier == LIBTABFS_LONGNAME_FINGERPRINT) {
+                printf("    - fingerprint: 0x%08X\n", e->longname_data.fingerprint);
+            }
         }
     }
 }
@@ -202,6 +208,12 @@ void dump_entrytable_region(libtabfs_entrytable_t* entrytable) {
             printf("    - parent: lba 0x%X | size %d\n", tabinf->parent_lba, tabinf->parent_size);
             printf("    - prev section: lba 0x%X | size %d\n", tabinf->prev_lba, tabinf->prev_size);
             printf("    - next section: lba 0x%X | size %d\n", tabinf->next_lba, tabinf->next_size);
+            if (tabinf->format == LIBTABFS_DIRFORMAT_HASHED) {
+                printf("    - hashed: %u buckets | bucket table: lba 0x%X\n", 1u << tabinf->bucket_bits, tabinf->bucket_table_lba);
+            }
+            if (tabinf->bucket_next_size != 0) {
+                printf("    - next section of bucket: lba 0x%X | size %d\n", tabinf->bucket_next_lba, tabinf->bucket_next_size);
+            }
         }
         else {
             printf("  - entry %d: \n", i);
@@ -261,6 +273,9 @@ void dump_entrytable_region(libtabfs_entrytable_t* entrytable) {
             }
             else {
                 printf("    - name: longname { lba: 0x%X, off: %d }\n", e->longname_data.longname_lba, e->longname_data.longname_offset);
+                if (e->longname_data.fingerprint_identifier == LIBTABFS_LONGNAME_FINGERPRINT) {
+                    printf("      - fingerprint: 0x%08X\n", e->longname_data.fingerprint);
+                }
             }
         }
     }
@@ -109,6 +109,8 @@ bool search_lba_uses_in_entrytable(char* abspath, libtabfs_entrytable_t* entryta
     if (tabinf->next_lba   == lba_to_search) { REC("  - tableinfo.next_lba");   }
     if (tabinf->prev_lba   == lba_to_search) { REC("  - tableinfo.prev_lba");   }
     if (tabinf->parent_lba == lba_to_search) { REC("  - tableinfo.parent_lba"); }
+    if (tabinf->bucket_next_size != 0 && tabinf->bucket_next_lba == lba_to_search) { REC("  - tableinfo.bucket_next_lba"); }
+    if (tabinf->format == LIBTABFS_DIRFORMAT_HASHED && tabinf->bucket_table_lba == lba_to_search) { REC("  - tableinfo.bucket_table_lba"); }
 
     for (int i = 1; i < entryCount; i++) {
         libtabfs_entrytable_entry_t* entry = &(entrytable->entries[i]);
@@ -2,6 +2,17 @@ add_rules("mode.debug", "mode.release", "mode.asan")
 
 add_requires("cxxspec")
 
+-- lets the bitmap scans use AVX2 (see bitmap.h); off by default, since not every x86-64 cpu has it
+option("avx2")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Compile the bitmap scans with AVX2")
+option_end()
+
+if has_config("avx2") then
+    add_vectorexts("avx2")
+end
+
 -- public target that gets installed & should be used by any tool that also lives outside of this repo
 target("libtabfs")
     set_kind("static")
@@ -24,6 +35,8 @@ target("local_libtabfs")
     add_includedirs("include", {public = true})
     add_defines("DEBUG")
     add_defines("LIBTABFS_DEBUG_PRINTF")
+    -- the specs bridge records the discarded ranges
+    add_defines("LIBTABFS_DISCARD", {public = true})
 
 target("specs")
     set_default(false)
@@ -38,4 +51,38 @@ target("tabfs_inspect")
     set_kind("binary")
     add_deps("libtabfs")
     add_files("utils/tabfs_inspect.cpp", "utils/dump.cpp")
-    add_includedirs("utils")
\ No newline at end of file
+    add_includedirs("utils")
+
+-- one target per benchmark; the library is compiled into every one of them.
+-- only the benchmarks that run threads get an thread-safe libtabfs, the others measure the plain one
+local threaded_benches = { alloc_contention = true, lookup_scaling = true }
+for _, file in ipairs(os.files("bench/*.c")) do
+    local name = path.basename(file)
+    if name ~= "ramdisk" then
+        target(name)
+            set_default(false)
+            set_kind("binary")
+            add_files("src/*.c", file, "bench/ramdisk.c")
+            add_includedirs("include")
+            if threaded_benches[name] then
+                add_defines("LIBTABFS_THREADSAFE")
+                add_syslinks("pthread")
+            end
+        target_end()
+    end
+end
+
+-- the bitmap scan is also measured with the portable path and with AVX2, regardless of the avx2 option
+target("bitmap_scan_portable")
+    set_default(false)
+    set_kind("binary")
+    add_files("src/*.c", "bench/bitmap_scan.c", "bench/ramdisk.c")
+    add_includedirs("include")
+    add_defines("LIBTABFS_NO_SIMD")
+
+target("bitmap_scan_avx2")
+    set_default(false)
+    set_kind("binary")
+    add_files("src/*.c", "bench/bitmap_scan.c", "bench/ramdisk.c")
+    add_includedirs("include")
+    add_vectorexts("avx2")
\ No newline at end of file